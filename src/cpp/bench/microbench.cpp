@@ -0,0 +1,302 @@
+// delta_microbench — the library's hot kernels, each timed in isolation.
+//
+// Every kernel is warmed up, calibrated to a batch of calls lasting at
+// least --sample-ms, then timed over --samples batches.  The report gives
+// the median time per call with a 95% confidence interval of the median
+// (order statistics, no normality assumption), per item and per byte.
+//
+// Usage:
+//   delta_microbench [FILTER...] [--samples N] [--sample-ms MS] [--size MB]
+//
+// FILTER selects kernels whose name contains it ("crc", "table.").
+
+#include <delta/delta.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace delta;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Keep the compiler from discarding a result or hoisting the work.
+template <typename T>
+void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Options {
+    std::vector<std::string> filters;
+    size_t samples = 25;
+    double sample_ms = 20;
+    double warmup_ms = 100;
+    size_t size = size_t{16} << 20;
+};
+
+struct Kernel {
+    std::string name;
+    size_t bytes;   // per call; 0 = no GB/s column
+    size_t items;   // per call, for ns/item
+    std::function<void()> call;
+};
+
+double seconds(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double>(b - a).count();
+}
+
+void run(const Kernel& k, const Options& opts) {
+    // Warm up caches, page tables and branch predictors, and estimate
+    // the cost of one call.
+    size_t calls = 0;
+    auto t0 = Clock::now();
+    do {
+        k.call();
+        ++calls;
+    } while (seconds(t0, Clock::now()) * 1e3 < opts.warmup_ms);
+    double per_call = seconds(t0, Clock::now()) / calls;
+    size_t batch = std::max<size_t>(1,
+        static_cast<size_t>(std::ceil(opts.sample_ms / 1e3 / per_call)));
+
+    std::vector<double> ns;   // per call, one entry per sample
+    for (size_t s = 0; s < opts.samples; ++s) {
+        auto b0 = Clock::now();
+        for (size_t i = 0; i < batch; ++i) { k.call(); }
+        ns.push_back(seconds(b0, Clock::now()) * 1e9 / batch);
+    }
+    std::sort(ns.begin(), ns.end());
+
+    // 95% CI of the median: ranks n/2 -+ 1.96 sqrt(n)/2.
+    size_t n = ns.size();
+    double median = n % 2 ? ns[n / 2] : (ns[n / 2 - 1] + ns[n / 2]) / 2;
+    double half = 1.96 * std::sqrt(static_cast<double>(n)) / 2;
+    auto lo = static_cast<size_t>(std::max(0.0, std::floor(n / 2.0 - half)));
+    auto hi = std::min(n - 1, static_cast<size_t>(std::ceil(n / 2.0 + half)));
+    double ci = std::max(median - ns[lo], ns[hi] - median) / median * 100;
+
+    std::printf("%-34s %14.1f %6.1f%% %10.2f", k.name.c_str(), median, ci,
+        median / std::max<size_t>(k.items, 1));
+    if (k.bytes) {
+        std::printf(" %9.2f\n", k.bytes / median);   // bytes per ns = GB/s
+    } else {
+        std::printf(" %9s\n", "-");
+    }
+    std::fflush(stdout);
+}
+
+/// Copy i writes block i and reads block perm[i] of a random permutation.
+std::vector<Command> permutation_copies(size_t blocks, size_t block_len, uint32_t seed) {
+    std::vector<size_t> perm(blocks);
+    std::iota(perm.begin(), perm.end(), 0);
+    std::shuffle(perm.begin(), perm.end(), std::mt19937(seed));
+    std::vector<Command> cmds;
+    cmds.reserve(blocks);
+    for (size_t i = 0; i < blocks; ++i) {
+        // Constructed in place: moving a temporary Command trips GCC 12's
+        // -Wmaybe-uninitialized on the variant's AddCmd storage.
+        cmds.emplace_back(std::in_place_type<CopyCmd>, perm[i] * block_len, block_len);
+    }
+    return cmds;
+}
+
+/// Inputs and tables the kernels share; built once, outside the timing.
+struct Inputs {
+    using HSlot = std::optional<std::pair<uint64_t, size_t>>;
+    static constexpr size_t FP_CALLS = 4096;
+    static constexpr size_t KEYS = size_t{1} << 18;
+    static constexpr size_t BLOCKS = size_t{1} << 16, BLOCK_LEN = 64;
+
+    explicit Inputs(size_t size) {
+        // Realistic data: a 10%-edited pair from the synthetic generator.
+        SynthOptions so;
+        so.scenario = SynthScenario::Edits;
+        so.size = size;
+        pair = synth_pair(so);
+        mirror = pair.reference;
+
+        std::mt19937_64 rng(99);
+        keys.resize(KEYS);
+        for (auto& k : keys) { k = rng() % HASH_MOD; }
+        q = next_prime(2 * KEYS);
+
+        placed = place_commands(diff(Algorithm::Correcting, pair.reference, pair.version));
+        commands = unplace_commands(placed);
+        crc = crc64_xz(pair.version.data(), pair.version.size());
+        encoded = encode_delta(placed, false, pair.version.size(), crc, crc);
+        out.resize(pair.version.size());
+
+        perm_cmds = permutation_copies(BLOCKS, BLOCK_LEN, 7);
+        perm_ref.assign(BLOCKS * BLOCK_LEN, 0x5A);
+    }
+
+    SynthPair pair;
+    std::vector<uint8_t> mirror;        // equal bytes at another address
+    std::vector<uint64_t> keys;
+    size_t q = 0;
+    std::vector<HSlot> direct;
+    SeedIndex index;
+    SplayTree<size_t> splay;
+    std::vector<PlacedCommand> placed;
+    std::vector<Command> commands;
+    std::array<uint8_t, DELTA_CRC_SIZE> crc{};
+    std::vector<uint8_t> encoded;
+    std::vector<uint8_t> out;
+    std::vector<Command> perm_cmds;
+    std::vector<uint8_t> perm_ref;
+};
+
+std::vector<Kernel> kernels(Inputs& in) {
+    std::vector<Kernel> ks;
+    std::span<const uint8_t> r = in.pair.reference, v = in.pair.version;
+    const size_t n = r.size(), half = n / 2;
+
+    // ── hashing ──────────────────────────────────────────────────────
+    ks.push_back({"rolling_hash.roll", n - SEED_LEN, n - SEED_LEN, [r] {
+        RollingHash h(r, 0, SEED_LEN);
+        for (size_t i = 0; i + SEED_LEN < r.size(); ++i) { h.roll(r[i], r[i + SEED_LEN]); }
+        keep(h.value());
+    }});
+    ks.push_back({"fingerprint p=16", Inputs::FP_CALLS * SEED_LEN, Inputs::FP_CALLS, [r] {
+        uint64_t acc = 0;
+        for (size_t i = 0; i < Inputs::FP_CALLS; ++i) {
+            acc ^= fingerprint(r, i * 97, SEED_LEN);
+        }
+        keep(acc);
+    }});
+    ks.push_back({"crc64_xz", n, 1, [r] { keep(crc64_xz(r.data(), r.size())); }});
+
+    // ── match extension: the scan loops' step (5), over one long match
+    //    between R and an equal copy ─────────────────────────────────
+    ks.push_back({"extend.forward", half, half, [&in, half] {
+        const uint8_t* a = in.pair.reference.data();
+        const uint8_t* b = in.mirror.data();
+        size_t fwd = 0;
+        while (fwd < half && a[fwd] == b[fwd]) { ++fwd; }
+        keep(fwd);
+    }});
+    ks.push_back({"extend.backward", half, half, [&in, half] {
+        const uint8_t* a = in.pair.reference.data();
+        const uint8_t* b = in.mirror.data();
+        size_t bwd = 0;
+        while (bwd < half && a[half - bwd - 1] == b[half - bwd - 1]) { ++bwd; }
+        keep(bwd);
+    }});
+    ks.push_back({"extend.memcmp (reference)", half, 1, [&in, half] {
+        keep(std::memcmp(in.pair.reference.data(), in.mirror.data(), half));
+    }});
+
+    // ── seed tables: direct-mapped (correcting, onepass), SeedIndex
+    //    (hierarchical, rematch) and SplayTree (--splay) ──────────────
+    ks.push_back({"table.direct insert", 0, Inputs::KEYS, [&in] {
+        in.direct.assign(in.q, std::nullopt);
+        for (size_t i = 0; i < in.keys.size(); ++i) {
+            auto& slot = in.direct[fp_to_index(in.keys[i], in.q)];
+            if (!slot) { slot = std::pair{in.keys[i], i}; }
+        }
+        keep(in.direct.data());
+    }});
+    ks.push_back({"table.direct lookup", 0, Inputs::KEYS, [&in] {
+        size_t hits = 0;
+        for (uint64_t k : in.keys) {
+            const auto& slot = in.direct[fp_to_index(k, in.q)];
+            hits += slot && slot->first == k;
+        }
+        keep(hits);
+    }});
+    ks.push_back({"table.seed_index insert", 0, Inputs::KEYS, [&in] {
+        in.index.reset(Inputs::KEYS);
+        for (size_t i = 0; i < in.keys.size(); ++i) { in.index.insert(in.keys[i], i); }
+        keep(in.index.size());
+    }});
+    ks.push_back({"table.seed_index lookup", 0, Inputs::KEYS, [&in] {
+        size_t hits = 0;
+        for (uint64_t k : in.keys) { hits += in.index.find(k).has_value(); }
+        keep(hits);
+    }});
+    ks.push_back({"table.splay insert", 0, Inputs::KEYS, [&in] {
+        in.splay.clear();
+        for (size_t i = 0; i < in.keys.size(); ++i) { in.splay.insert_or_get(in.keys[i], i); }
+        keep(in.splay.size());
+    }});
+    ks.push_back({"table.splay lookup", 0, Inputs::KEYS, [&in] {
+        size_t hits = 0;
+        for (uint64_t k : in.keys) { hits += in.splay.find(k) != nullptr; }
+        keep(hits);
+    }});
+
+    // ── delta format and application ────────────────────────────────
+    size_t n_cmds = in.placed.size();
+    ks.push_back({"encode_delta", in.encoded.size(), n_cmds, [&in, v] {
+        keep(encode_delta(in.placed, false, v.size(), in.crc, in.crc).size());
+    }});
+    ks.push_back({"decode_delta", in.encoded.size(), n_cmds, [&in] {
+        keep(std::get<0>(decode_delta(in.encoded)).size());
+    }});
+    ks.push_back({"apply_placed_to", v.size(), n_cmds, [&in, r] {
+        keep(apply_placed_to(r, in.placed, in.out));
+    }});
+
+    // ── make_inplace: a random block permutation (copy i writes block
+    //    i and reads block perm[i], so the CRWI graph is the
+    //    permutation's cycles), and the edited pair's commands ────────
+    ks.push_back({"make_inplace perm localmin", 0, Inputs::BLOCKS, [&in] {
+        keep(make_inplace(in.perm_ref, in.perm_cmds, CyclePolicy::Localmin).size());
+    }});
+    ks.push_back({"make_inplace perm constant", 0, Inputs::BLOCKS, [&in] {
+        keep(make_inplace(in.perm_ref, in.perm_cmds, CyclePolicy::Constant).size());
+    }});
+    ks.push_back({"make_inplace edits", 0, in.commands.size(), [&in, r] {
+        keep(make_inplace(r, in.commands, CyclePolicy::Localmin).size());
+    }});
+    return ks;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> double {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "error: %s needs a value\n", arg.c_str());
+                std::exit(2);
+            }
+            return std::atof(argv[++i]);
+        };
+        if (arg == "--samples") {
+            opts.samples = std::max<size_t>(static_cast<size_t>(value()), 3);
+        } else if (arg == "--sample-ms") {
+            opts.sample_ms = value();
+        } else if (arg == "--size") {
+            opts.size = static_cast<size_t>(value() * (1 << 20));
+        } else if (arg == "-h" || arg == "--help") {
+            std::printf("usage: delta_microbench [FILTER...] [--samples N] "
+                        "[--sample-ms MS] [--size MB]\n");
+            return 0;
+        } else {
+            opts.filters.push_back(arg);
+        }
+    }
+
+    std::printf("%-34s %14s %7s %10s %9s\n", "Kernel", "ns/op", "+-CI95", "ns/item", "GB/s");
+    Inputs inputs(opts.size);
+    for (const auto& k : kernels(inputs)) {
+        bool selected = opts.filters.empty() || std::any_of(
+            opts.filters.begin(), opts.filters.end(),
+            [&](const std::string& f) { return k.name.find(f) != std::string::npos; });
+        if (selected) { run(k, opts); }
+    }
+}
@@ -4,15 +4,19 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <optional>
 #include <span>
+#include <string>
 #include <vector>
 
 #include "delta/types.h"
 
 namespace delta {
 
-/// Print shared verbose stats (result/copies summary) to stderr.
-void print_command_stats(const std::vector<Command>& commands);
+/// Print verbose stats (result/copies summary) to stderr: record_result()
+/// into stats, or a fresh DiffStats if null, then print_diff_stats().
+/// Each diff_* entry point calls it when opts.verbose is set.
+void print_command_stats(const std::vector<Command>& commands, DiffStats* stats = nullptr);
 
 /// Greedy algorithm (Section 3.1, Figure 2).
 ///
@@ -27,7 +31,7 @@ std::vector<Command> diff_greedy(
 /// One-Pass algorithm (Section 4.1, Figure 3).
 ///
 /// Scans R and V concurrently. Time: O(np + q), space: O(q).
-/// Auto-sizes hash table to max(q, num_seeds/p).
+/// Auto-sizes hash table to min(max_table, max(q, num_seeds/p)).
 std::vector<Command> diff_onepass(
     std::span<const uint8_t> r,
     std::span<const uint8_t> v,
@@ -42,11 +46,80 @@ std::vector<Command> diff_correcting(
     std::span<const uint8_t> v,
     const DiffOptions& opts = {});
 
-/// Dispatcher: call the appropriate algorithm by enum.
+/// Hierarchical two-resolution algorithm.
+///
+/// Coarse pass: R is indexed sparsely with long seeds (opts.coarse_p) at
+/// stride coarse_p (times opts.coarse_thin), and V is scanned against
+/// that index to find the large copies.  Fine pass (unless
+/// opts.fine_pass is false): each uncovered gap of V is matched with
+/// seed length opts.p against a small local index built over the R
+/// neighbourhood of the adjacent copies.  Space: O(|R| / coarse_p + largest gap).
+/// With opts.ref_index the coarse seeds are loaded from a persisted index
+/// (ref_index.h) instead of hashing R; throws DeltaError if it does not
+/// match R's size or the coarse seed length.
+std::vector<Command> diff_hierarchical(
+    std::span<const uint8_t> r,
+    std::span<const uint8_t> v,
+    const DiffOptions& opts = {});
+
+/// One entry of a best-of-N race.
+struct BestCandidate {
+    Algorithm algo;
+    DiffOptions opts;
+    std::string label;
+};
+
+/// Outcome of diff_best: the winner's commands and each candidate's
+/// encoded_cost(), or nullopt if it was cancelled.
+struct BestResult {
+    std::vector<Command> commands;
+    size_t winner;
+    std::vector<std::optional<size_t>> costs;
+};
+
+/// Default race for Algorithm::Best: hierarchical, correcting and
+/// onepass at opts.p, correcting at p/2 and 2p, and greedy when |R| is
+/// at most BEST_GREEDY_MAX.
+inline constexpr size_t BEST_GREEDY_MAX = 4 << 20;
+std::vector<BestCandidate> best_candidates(const DiffOptions& opts,
+                                           size_t r_size);
+
+/// Best-of-N: run the candidates concurrently on opts.threads workers
+/// (without post-passes) and keep the smallest encoded_cost(); ties go to
+/// the earlier candidate.  A candidate whose committed output already
+/// costs as much as a finished one is cancelled (race.h).
+BestResult diff_best(
+    std::span<const uint8_t> r,
+    std::span<const uint8_t> v,
+    const std::vector<BestCandidate>& candidates,
+    const DiffOptions& opts = {});
+
+/// Dispatcher: call the appropriate algorithm by enum, then run the
+/// post-passes enabled in opts (opts.rematch, then opts.optimize).
+/// With opts.trim, the common prefix and suffix of R and V are emitted
+/// as copies up front and only the middles are differenced.
 std::vector<Command> diff(
     Algorithm algo,
     std::span<const uint8_t> r,
     std::span<const uint8_t> v,
     const DiffOptions& opts = {});
 
+// ── Effort levels ────────────────────────────────────────────────────────
+
+inline constexpr int MIN_EFFORT = 1;
+inline constexpr int MAX_EFFORT = 9;
+inline constexpr int DEFAULT_EFFORT = 6;
+
+/// Algorithm and options selected by an effort level.
+struct EffortPreset {
+    Algorithm algo;
+    DiffOptions opts;
+    const char* description;
+};
+
+/// Map an effort level (1 = fastest .. 9 = smallest delta) to a concrete
+/// strategy.  r_size sizes the "full table" of the top levels.
+/// Throws DeltaError for levels outside [MIN_EFFORT, MAX_EFFORT].
+EffortPreset effort_preset(int level, size_t r_size);
+
 } // namespace delta
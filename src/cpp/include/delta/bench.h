@@ -0,0 +1,123 @@
+#pragma once
+
+/// End-to-end benchmark matrix: algorithms x flags over a corpus.
+///
+/// bench_matrix() expands the axes into configurations; bench_run()
+/// times the full encode (diff, placement or in-place conversion,
+/// serialization) and decode of one pair, repeat times, and checks the
+/// round trip.  bench_run_isolated() does the same in a forked child, so
+/// that peak RSS belongs to one configuration alone.  Results are written
+/// as CSV (one row per pair and configuration) or JSON, and
+/// bench_compare() flags the changes between two CSV files beyond a noise
+/// threshold.
+///
+/// A corpus directory holds NAME.ref / NAME.ver pairs (see `delta gen`);
+/// without any, its files in name order form successive pairs
+/// (v1 -> v2, v2 -> v3, ...).
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+/// Indexed by Algorithm.
+inline constexpr const char* ALGORITHM_NAMES[] = {
+    "greedy", "onepass", "correcting", "hierarchical", "best"};
+
+/// Throws DeltaError for an unknown name.
+Algorithm algorithm_from_name(const std::string& name);
+
+struct BenchConfig {
+    Algorithm algo = Algorithm::Onepass;
+    bool splay = false;
+    bool inplace = false;
+    CyclePolicy policy = CyclePolicy::Localmin;
+    size_t seed_len = SEED_LEN;
+    size_t max_table = MAX_TABLE_SIZE;
+
+    /// "correcting+splay+inplace/constant p16 t1000000"
+    std::string name() const;
+};
+
+struct BenchAxes {
+    std::vector<Algorithm> algorithms = {Algorithm::Onepass, Algorithm::Correcting};
+    std::vector<bool> splay = {false};
+    std::vector<bool> inplace = {false};
+    std::vector<CyclePolicy> policies = {CyclePolicy::Localmin};
+    std::vector<size_t> seed_lens = {SEED_LEN};
+    std::vector<size_t> max_tables = {MAX_TABLE_SIZE};
+};
+
+/// The cross product of the axes, without combinations that would
+/// repeat another: the policy varies only in-place, and splay only
+/// for greedy, onepass and correcting.
+std::vector<BenchConfig> bench_matrix(const BenchAxes& axes);
+
+struct BenchPair {
+    std::string name;
+    std::string reference;
+    std::string version;
+};
+
+/// Throws DeltaError if dir holds no pair.
+std::vector<BenchPair> bench_corpus(const std::string& dir);
+
+struct BenchResult {
+    std::string pair;
+    std::string config;
+    size_t r_size = 0;
+    size_t v_size = 0;
+    size_t delta_bytes = 0;
+    size_t runs = 0;
+    double encode_median = 0;   // seconds
+    double encode_p95 = 0;
+    double decode_median = 0;
+    size_t peak_rss = 0;        // bytes, process-wide (isolated: this run only)
+    size_t table_peak = 0;      // tracked table and graph bytes (memory.h)
+    bool ok = false;            // decoded output matched the version
+
+    double ratio() const { return v_size ? static_cast<double>(delta_bytes) / v_size : 0.0; }
+    double mbps() const { return encode_median > 0 ? v_size / encode_median / 1e6 : 0.0; }
+};
+
+/// Encode and decode v against r repeat times in this process.
+BenchResult bench_run(std::span<const uint8_t> r, std::span<const uint8_t> v,
+                      const BenchConfig& config, size_t repeat);
+
+/// bench_run() on the pair's files in a forked child.  A child that
+/// fails or dies yields a result with ok == false.
+BenchResult bench_run_isolated(const BenchPair& pair, const BenchConfig& config,
+                               size_t repeat);
+
+std::string bench_csv(const std::vector<BenchResult>& results);
+std::string bench_json(const std::vector<BenchResult>& results);
+
+/// Parse bench_csv() output, matching columns by header name.
+/// Throws DeltaError on a malformed file.
+std::vector<BenchResult> parse_bench_csv(const std::string& csv);
+
+struct BenchChange {
+    std::string pair;
+    std::string config;
+    std::string metric;       // encode_median, decode_median, peak_rss,
+                              // delta_bytes, ok, missing
+    double before = 0;
+    double after = 0;
+    bool regression = false;  // false: an improvement
+};
+
+/// Metrics of current that moved by more than a relative threshold from
+/// baseline, matched by (pair, config).  Times and RSS use
+/// time_threshold.  Delta sizes are deterministic, so they use
+/// size_threshold, which defaults to any change.
+std::vector<BenchChange> bench_compare(const std::vector<BenchResult>& baseline,
+                                       const std::vector<BenchResult>& current,
+                                       double time_threshold,
+                                       double size_threshold = 0);
+
+} // namespace delta
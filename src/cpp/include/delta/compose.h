@@ -0,0 +1,29 @@
+#pragma once
+
+/// Delta composition: turn A->B and B->C into A->C without building B.
+///
+/// Every command of the second delta that reads B is rewritten through
+/// the first delta's command map (interval mapping on B's offsets):
+/// pieces of B that were copied from A become copies from A, and pieces
+/// that were literal in A->B are carried over as literal bytes.  Works
+/// on standard and in-place deltas alike; the result is a standard
+/// delta in destination order.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+/// Compose placed deltas: ab reconstructs B (b_size bytes) from A, bc
+/// reconstructs C from B.  Returns placed commands reconstructing C
+/// from A.  Adjacent pieces that stay contiguous are merged.
+/// Throws DeltaError if ab does not cover B exactly or bc reads past B.
+std::vector<PlacedCommand> compose_deltas(
+    const std::vector<PlacedCommand>& ab,
+    size_t b_size,
+    const std::vector<PlacedCommand>& bc);
+
+} // namespace delta
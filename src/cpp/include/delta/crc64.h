@@ -19,4 +19,21 @@ namespace delta {
 /// Compute CRC-64/XZ of data[0..len]; returns DELTA_CRC_SIZE bytes big-endian.
 std::array<uint8_t, DELTA_CRC_SIZE> crc64_xz(const uint8_t* data, size_t len);
 
+/// Incremental CRC-64/XZ: update() with the input in pieces, then
+/// digest() — equal to crc64_xz over the concatenation.
+class Crc64Xz {
+public:
+    void update(const uint8_t* data, size_t len);
+    std::array<uint8_t, DELTA_CRC_SIZE> digest() const;
+
+private:
+    uint64_t state_ = 0xFFFFFFFFFFFFFFFFULL;
+};
+
+/// CRC of A followed by B, from crc(A), crc(B) and |B|, in O(log |B|).
+std::array<uint8_t, DELTA_CRC_SIZE> crc64_xz_combine(
+    const std::array<uint8_t, DELTA_CRC_SIZE>& crc_a,
+    const std::array<uint8_t, DELTA_CRC_SIZE>& crc_b,
+    uint64_t len_b);
+
 } // namespace delta
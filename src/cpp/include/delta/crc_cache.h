@@ -0,0 +1,95 @@
+#pragma once
+
+/// Cache of whole-file CRC-64/XZ values for immutable references.
+///
+/// Entries are keyed on the file's identity (dev, inode, size, mtime_ns,
+/// ctime_ns); any change to the file changes its ctime, so a stale entry
+/// never matches and the caller falls back to hashing.  The cache is a
+/// sidecar file rather than an xattr: writing an xattr would itself bump
+/// the ctime the entry is keyed on.
+///
+/// Cache file format (big-endian): magic "DLC\x01", then 48-byte records
+/// dev u64, ino u64, size u64, mtime_ns u64, ctime_ns u64, crc[8].
+/// Records are appended; the last one for an inode wins.  Once the file
+/// holds CRC_CACHE_MAX_RECORDS records it is rewritten with the newest
+/// record per inode, oldest evicted first down to CRC_CACHE_LOW_WATER,
+/// so a cache that has seen many distinct files still shrinks.  Cache
+/// I/O errors are never fatal: they read as a miss or skip the store.
+///
+/// A CrcCache loads the file once and afterwards reads only the records
+/// appended since (reloading when the file has been compacted), so
+/// repeated lookups do not re-read it.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "delta/types.h"
+
+namespace delta {
+
+inline constexpr uint8_t CRC_CACHE_MAGIC[4] = {'D', 'L', 'C', 0x01};
+inline constexpr size_t CRC_CACHE_MAX_RECORDS = 4096;
+inline constexpr size_t CRC_CACHE_LOW_WATER = CRC_CACHE_MAX_RECORDS / 2;
+inline constexpr uint64_t CRC_CACHE_SETTLE_NS = 2'000'000'000; // covers 1-2 s mtime granularity
+
+struct FileIdentity {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime_ns;
+    uint64_t ctime_ns;
+    bool operator==(const FileIdentity&) const = default;
+};
+
+/// Identity of the file at path, or nullopt if it cannot be stat'ed.
+std::optional<FileIdentity> file_identity(const std::string& path);
+
+/// Identity of the open file fd (fstat), or nullopt on error.
+std::optional<FileIdentity> file_identity(int fd);
+
+class CrcCache {
+public:
+    explicit CrcCache(std::string path) : path_(std::move(path)) {}
+
+    /// $DELTA_CRC_CACHE, else $XDG_CACHE_HOME/delta/crc64, else
+    /// $HOME/.cache/delta/crc64.
+    static std::string default_path();
+
+    std::optional<std::array<uint8_t, DELTA_CRC_SIZE>> lookup(const FileIdentity& id) const;
+    void store(const FileIdentity& id, const std::array<uint8_t, DELTA_CRC_SIZE>& crc) const;
+
+    const std::string& path() const { return path_; }
+
+private:
+    using Record = std::pair<FileIdentity, std::array<uint8_t, DELTA_CRC_SIZE>>;
+
+    /// Bring entries_ up to date with the file; caller holds mu_.
+    void refresh() const;
+
+    std::string path_;
+    mutable std::mutex mu_;
+    mutable std::map<std::pair<uint64_t, uint64_t>, Record> entries_; // (dev, ino)
+    mutable std::optional<FileIdentity> loaded_id_; // cache file as last read
+    mutable uint64_t loaded_end_ = 0;                // offset read up to
+};
+
+/// CRC of `data`, the mapped contents of the open file fd: from the cache
+/// when the file's identity matches an entry, otherwise computed and
+/// stored (only if the identity did not change while hashing and the
+/// file has settled).  The identity comes from fstat on fd, so it always
+/// describes the file that was mapped, even if its path has since been
+/// replaced.  Sets *hit.
+std::array<uint8_t, DELTA_CRC_SIZE> cached_file_crc(
+    const CrcCache& cache,
+    int fd,
+    std::span<const uint8_t> data,
+    bool* hit = nullptr);
+
+} // namespace delta
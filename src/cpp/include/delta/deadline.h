@@ -0,0 +1,82 @@
+#pragma once
+
+/// Wall-clock deadline for budgeted encoding (DiffOptions::time_budget).
+///
+/// Algorithms poll it every DEADLINE_CHECK_INTERVAL positions, so the
+/// clock is read rarely enough to be free.  A default-constructed
+/// Deadline never expires (its end is time_point::max()).
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "delta/types.h"
+
+namespace delta {
+
+inline constexpr size_t DEADLINE_CHECK_INTERVAL = 1 << 16;
+
+/// Upper bound on how fast a build or scan visits positions (a rolling
+/// hash each).  Under a deadline, tables are sized for the positions a
+/// phase can reach at this rate: zeroing a table sized for all of a
+/// large input could otherwise take the whole budget by itself.
+inline constexpr double BUDGET_MAX_RATE = 256e6; // positions per second
+
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Deadline() = default;
+
+    /// opts.deadline if set, else now + opts.time_budget, else unbounded.
+    explicit Deadline(const DiffOptions& opts) {
+        if (opts.deadline != Clock::time_point{}) {
+            end_ = opts.deadline;
+        } else if (opts.time_budget > 0) {
+            end_ = Clock::now() + to_duration(opts.time_budget);
+        }
+    }
+
+    bool enabled() const { return end_ != Clock::time_point::max(); }
+
+    bool expired() const { return enabled() && Clock::now() >= end_; }
+
+    /// Seconds left (0 once expired); a large value when unbounded.
+    double remaining() const {
+        if (!enabled()) { return 1e18; }
+        double s = std::chrono::duration<double>(end_ - Clock::now()).count();
+        return s > 0 ? s : 0;
+    }
+
+    /// Positions a phase can visit before the deadline at BUDGET_MAX_RATE
+    /// (at least 1); SIZE_MAX when unbounded.
+    size_t reach() const {
+        if (!enabled()) { return SIZE_MAX; }
+        double n = remaining() * BUDGET_MAX_RATE;
+        return n >= 1e18 ? SIZE_MAX : std::max<size_t>(static_cast<size_t>(n), 1);
+    }
+
+    /// A deadline at `frac` of the remaining time from now.
+    Deadline share(double frac) const {
+        Deadline d;
+        if (enabled()) { d.end_ = Clock::now() + to_duration(remaining() * frac); }
+        return d;
+    }
+
+    /// Write the absolute deadline back into opts (for nested calls).
+    void apply(DiffOptions& opts) const {
+        if (enabled()) { opts.deadline = end_; }
+    }
+
+private:
+    static Clock::duration to_duration(double seconds) {
+        // Cap at ~30 years so now() + duration cannot overflow.
+        return std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(std::min(seconds, 1e9)));
+    }
+
+    Clock::time_point end_ = Clock::time_point::max();
+};
+
+} // namespace delta
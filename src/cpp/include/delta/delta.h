@@ -5,8 +5,27 @@
 #include "delta/types.h"
 #include "delta/hash.h"
 #include "delta/crc64.h"
+#include "delta/crc_cache.h"
 #include "delta/encoding.h"
 #include "delta/splay.h"
+#include "delta/seed_index.h"
+#include "delta/deadline.h"
+#include "delta/race.h"
+#include "delta/memory.h"
+#include "delta/perf.h"
+#include "delta/stats.h"
+#include "delta/trace.h"
 #include "delta/algorithm.h"
+#include "delta/postpass.h"
+#include "delta/sketch.h"
+#include "delta/synth.h"
+#include "delta/bench.h"
+#include "delta/loadtest.h"
+#include "delta/compose.h"
+#include "delta/store.h"
+#include "delta/ref_index.h"
+#include "delta/server.h"
+#include "delta/shard.h"
+#include "delta/verify.h"
 #include "delta/apply.h"
 #include "delta/inplace.h"
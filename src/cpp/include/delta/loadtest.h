@@ -0,0 +1,105 @@
+#pragma once
+
+/// Concurrent decode load test: replay (reference, delta) pairs through
+/// the decode path the server uses, and report throughput and latency
+/// percentiles.
+///
+/// load_run() issues requests round-robin over the corpus from a pool of
+/// `concurrency` worker threads.  Closed loop (rate == 0), each worker
+/// starts its next request as soon as the last one ends.  Open loop,
+/// request i is due at start + i / rate, and its latency runs from that
+/// time, so a pool that falls behind shows up as queueing delay rather
+/// than a lower request rate.
+///
+/// Each request reads the delta, parses it, checks the reference CRC
+/// (cached per reference, as serve() does), allocates the output,
+/// applies the commands and checks the output CRC.  The time spent in
+/// each of these phases, the process's page faults and context switches
+/// are reported alongside, so that allocator contention, page-cache
+/// state and thread count can be told apart.
+///
+/// A corpus directory holds NAME.ref / NAME.delta pairs.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+/// Where a request finds its files.
+enum class LoadCache {
+    Memory,   // read once up front; requests do no I/O
+    Hot,      // read per request, page cache warmed up front
+    Cold,     // read per request, evicted from the page cache first
+};
+
+/// Indexed by LoadCache.
+inline constexpr const char* LOAD_CACHE_NAMES[] = {"memory", "hot", "cold"};
+
+/// Throws DeltaError for an unknown name.
+LoadCache load_cache_from_name(const std::string& name);
+
+enum LoadPhase : size_t {
+    LOAD_READ, LOAD_PARSE, LOAD_ALLOC, LOAD_APPLY, LOAD_VERIFY, LOAD_PHASES
+};
+
+/// Indexed by LoadPhase.
+inline constexpr const char* LOAD_PHASE_NAMES[] = {
+    "read", "parse", "alloc", "apply", "verify"};
+
+struct LoadPair {
+    std::string name;
+    std::string reference;
+    std::string delta;
+};
+
+/// Throws DeltaError if dir holds no pair.
+std::vector<LoadPair> load_corpus(const std::string& dir);
+
+struct LoadOptions {
+    size_t concurrency = 1;       // worker threads
+    double rate = 0;              // requests per second; 0 = closed loop
+    size_t requests = 1000;
+    double duration = 0;          // seconds; stop issuing after it (0 = no limit)
+    LoadCache cache = LoadCache::Hot;
+    bool reuse_buffers = false;   // one output buffer per worker, not per request
+};
+
+struct LoadResult {
+    size_t concurrency = 0;
+    double rate = 0;
+    std::string cache;
+    bool reuse_buffers = false;
+    size_t requests = 0;          // completed, including failures
+    size_t errors = 0;
+    std::string first_error;
+    double wall = 0;              // seconds, first issue to last completion
+    size_t output_bytes = 0;
+    double mean = 0;              // latency, seconds, successful requests
+    double p50 = 0;
+    double p99 = 0;
+    double p999 = 0;
+    double max = 0;
+    std::array<double, LOAD_PHASES> phase_seconds{};   // summed over requests
+    size_t minor_faults = 0;
+    size_t major_faults = 0;
+    size_t voluntary_switches = 0;
+    size_t involuntary_switches = 0;
+    size_t peak_rss = 0;          // bytes, process-wide
+
+    double throughput() const { return wall > 0 ? requests / wall : 0.0; }
+    double mbps() const { return wall > 0 ? output_bytes / wall / 1e6 : 0.0; }
+};
+
+/// Replay the corpus under opts.  Request failures (a bad delta, a CRC
+/// mismatch, an unreadable file) are counted, not thrown; setup errors
+/// throw DeltaError.
+LoadResult load_run(const std::vector<LoadPair>& corpus, const LoadOptions& opts);
+
+std::string load_csv(const std::vector<LoadResult>& results);
+
+} // namespace delta
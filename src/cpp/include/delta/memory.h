@@ -0,0 +1,129 @@
+#pragma once
+
+/// Heap accounting for the library's large allocations.
+///
+/// The seed tables (hash tables, splay trees, seed indexes) and the CRWI
+/// graph of make_inplace() allocate through TrackingAllocator, which
+/// charges every allocation to a process-wide counter per category and
+/// keeps the peak.  A MemoryWatch records the peak over its own lifetime,
+/// so overlapping phases, in one thread or several, each get their own
+/// high-water mark; PhaseTimer (stats.h) holds one.  Each charge costs
+/// a few contended atomics, so only large allocations go through
+/// TrackingAllocator.  Structures built from many small ones (greedy's
+/// offset lists, splay tree nodes, the CRWI graph's edge lists) charge
+/// their footprint through a MemoryCharge instead, once per table or in
+/// coarse steps.
+///
+/// DiffOptions::memory_limit sizes the tables to a byte budget through
+/// table_slots(), so callers need not translate bytes into --max-table.
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+enum MemCategory : size_t {
+    MEM_TABLES,     // seed lookup structures
+    MEM_GRAPH,      // make_inplace's CRWI graph
+    MEM_CATEGORY_COUNT
+};
+
+/// JSON / verbose names, indexed by MemCategory.
+inline constexpr const char* MEM_CATEGORY_NAMES[MEM_CATEGORY_COUNT] = {
+    "tables", "graph"};
+
+void memory_charge(MemCategory category, size_t bytes);
+void memory_release(MemCategory category, size_t bytes);
+
+/// Tracked bytes now and at their peak since the process started.
+struct MemoryUsage {
+    std::array<size_t, MEM_CATEGORY_COUNT> current{}, peak{};
+    size_t total_current = 0, total_peak = 0;
+};
+
+MemoryUsage memory_usage();
+
+/// Peak of the total tracked bytes between construction and peak().
+/// Up to 64 watches can be live at once; beyond that peak() reads 0.
+class MemoryWatch {
+public:
+    MemoryWatch();
+    ~MemoryWatch();
+    MemoryWatch(MemoryWatch&& o) noexcept : slot_(o.slot_) { o.slot_ = -1; }
+    MemoryWatch& operator=(MemoryWatch&& o) noexcept;
+    MemoryWatch(const MemoryWatch&) = delete;
+    MemoryWatch& operator=(const MemoryWatch&) = delete;
+
+    size_t peak() const;
+
+private:
+    void release();
+    int slot_ = -1;
+};
+
+/// Bytes one owner holds charged to a category; released on destruction.
+class MemoryCharge {
+public:
+    explicit MemoryCharge(MemCategory category = MEM_TABLES) : category_(category) {}
+    ~MemoryCharge() { set(0); }
+    MemoryCharge(MemoryCharge&& o) noexcept : category_(o.category_), bytes_(o.bytes_) {
+        o.bytes_ = 0;
+    }
+    MemoryCharge& operator=(MemoryCharge&& o) noexcept;
+    MemoryCharge(const MemoryCharge&) = delete;
+    MemoryCharge& operator=(const MemoryCharge&) = delete;
+
+    /// Charge or release the difference to the new total.
+    void set(size_t bytes);
+    size_t bytes() const { return bytes_; }
+
+private:
+    MemCategory category_;
+    size_t bytes_ = 0;
+};
+
+/// std::allocator that charges its allocations to category C.
+template <typename T, MemCategory C>
+struct TrackingAllocator {
+    using value_type = T;
+    template <typename U>
+    struct rebind { using other = TrackingAllocator<U, C>; };
+
+    TrackingAllocator() = default;
+    template <typename U>
+    TrackingAllocator(const TrackingAllocator<U, C>&) noexcept {}
+
+    T* allocate(size_t n) {
+        T* p = std::allocator<T>().allocate(n);
+        memory_charge(C, n * sizeof(T));
+        return p;
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        memory_release(C, n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    friend bool operator==(const TrackingAllocator&, const TrackingAllocator&) {
+        return true;
+    }
+};
+
+template <typename T, MemCategory C = MEM_TABLES>
+using TrackedVector = std::vector<T, TrackingAllocator<T, C>>;
+
+template <typename K, typename V>
+using TrackedHashMap = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>,
+    TrackingAllocator<std::pair<const K, V>, MEM_TABLES>>;
+
+/// Number of table slots of slot_bytes each that fit opts.memory_limit,
+/// never more than opts.max_table (and at least 1).
+size_t table_slots(const DiffOptions& opts, size_t slot_bytes);
+
+} // namespace delta
@@ -0,0 +1,74 @@
+#pragma once
+
+/// Optional per-phase performance counters (Linux perf_event_open).
+///
+/// enable_perf_counters() opens one user-space counter per event for the
+/// calling thread, inherited by threads it starts afterwards (rematch
+/// and best-of-N workers; their counts fold in when they exit, which is
+/// before their phase ends).  From then on every PhaseTimer (stats.h)
+/// snapshots the counters, so each PhaseTime carries its phase's counts.
+/// Events the kernel or hardware does not offer (VMs and containers
+/// often hide the PMU; perf_event_paranoid > 2 forbids everything) are
+/// skipped one by one; PerfCounts::mask says which were counted.
+///
+/// Cycles and instructions open as one group (cycles the leader), so
+/// both count over the same intervals and IPC stays consistent.  The
+/// other events open on their own: a group is scheduled all or nothing,
+/// and with the NMI watchdog holding a general-purpose counter a group
+/// of every hardware event may never fit, which would lose all of them.
+/// Reads stay per event (no PERF_FORMAT_GROUP), which inherit requires.
+///
+/// Events the PMU multiplexes run for only part of the time they are
+/// enabled.  Snapshots keep the raw count with both times, and
+/// operator- scales the difference by the interval's time enabled /
+/// time running, so deltas never go negative.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace delta {
+
+enum PerfEvent : size_t {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,      // last-level cache read misses
+    PERF_DTLB_MISSES,     // data TLB read misses
+    PERF_BRANCH_MISSES,
+    PERF_PAGE_FAULTS,     // software event: available without a PMU
+    PERF_EVENT_COUNT
+};
+
+/// JSON / verbose names, indexed by PerfEvent.
+inline constexpr const char* PERF_EVENT_NAMES[PERF_EVENT_COUNT] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses",
+    "page_faults"};
+
+struct PerfCounts {
+    std::array<uint64_t, PERF_EVENT_COUNT> value{};
+    std::array<uint64_t, PERF_EVENT_COUNT> enabled{}; // ns; raw snapshots only
+    std::array<uint64_t, PERF_EVENT_COUNT> running{}; // ns; raw snapshots only
+    uint32_t mask = 0; // bit e set if event e was counted
+
+    bool has(PerfEvent e) const { return (mask >> e) & 1; }
+    PerfCounts& operator+=(const PerfCounts& o);
+};
+
+/// Counts accrued between two raw snapshots, scaled for multiplexing.
+PerfCounts operator-(const PerfCounts& later, const PerfCounts& earlier);
+
+/// Open the counters (idempotent).  Returns how many events opened;
+/// error (if given) names the first event that did not, and why.
+size_t enable_perf_counters(std::string* error = nullptr);
+
+bool perf_counters_enabled();
+
+/// Current raw totals of the open counters, with their times; mask 0
+/// if none are open.  Only differences of these are meaningful.
+PerfCounts read_perf_counters();
+
+/// "cycles=… instructions=… IPC=…" for the counted events.
+std::string format_perf_counts(const PerfCounts& counts);
+
+} // namespace delta
@@ -0,0 +1,57 @@
+#pragma once
+
+/// Post-passes over algorithm output.
+///
+/// Each pass takes a command stream produced by any algorithm and
+/// returns an equivalent stream (same reconstructed version) that
+/// encodes smaller.
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+/// Gap re-matching: search every ADD of at least opts.rematch_min bytes
+/// for copies, using seeds of opts.rematch_p bytes and a dense local index
+/// over the R neighbourhood of the neighbouring copies' sources.  The
+/// neighbourhood reaches at most REMATCH_MAX_REACH bytes past each anchor,
+/// less under opts.memory_limit.  Gaps are independent and are processed
+/// on opts.threads workers.
+std::vector<Command> rematch_adds(
+    std::span<const uint8_t> r,
+    std::vector<Command> commands,
+    const DiffOptions& opts = {});
+
+/// Command optimizer driven by a per-format cost model:
+///   - merges copies that are contiguous in R (onepass emits these after
+///     table flushes),
+///   - absorbs copies that cost more than their literal bytes into the
+///     neighbouring ADDs (reading the bytes from r),
+///   - coalesces adjacent ADDs.
+/// Never increases encoded_cost(); at equal cost prefers fewer commands.
+std::vector<Command> optimize_commands(
+    std::span<const uint8_t> r,
+    std::vector<Command> commands,
+    const CostModel& cost = V3_COST_MODEL);
+
+/// Reverse delta from a forward one: given the commands that rebuild V
+/// from r, return commands that rebuild r from V, without indexing
+/// either file again.  Every forward copy becomes a copy in the other
+/// direction; R bytes no forward copy used become ADDs.  Running
+/// rematch_adds(v, ...) on the result recovers R bytes that V holds at
+/// places the forward matcher did not use.
+std::vector<Command> reverse_commands(
+    std::span<const uint8_t> r,
+    const std::vector<Command>& forward);
+
+/// Encoded size of the command stream under a cost model, excluding the
+/// format's header and END marker.
+size_t encoded_cost(
+    const std::vector<Command>& commands,
+    const CostModel& cost = V3_COST_MODEL);
+
+} // namespace delta
@@ -0,0 +1,70 @@
+#pragma once
+
+/// Best-of-N race support (Algorithm::Best).
+///
+/// Candidates share an atomic holding the smallest encoded_cost() of any
+/// finished candidate.  Each algorithm meters a lower bound on its final
+/// cost, usually the commands it has already committed (they are final:
+/// later output only adds cost), and gives up with DiffCancelled once it
+/// is over that bound.  A run that only ties the bound carries on:
+/// diff_best breaks ties by candidate index, so it may still win.  Checks
+/// run at the algorithms' periodic deadline checks.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <variant>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+class CostMeter {
+public:
+    explicit CostMeter(const DiffOptions& opts) : bound_(opts.size_bound) {}
+
+    bool enabled() const { return bound_ != nullptr; }
+
+    /// Add the cost of commands appended since the last call; throw
+    /// DiffCancelled once it exceeds the bound.
+    void check(const std::vector<Command>& commands) {
+        if (!bound_) { return; }
+        for (; counted_ < commands.size(); ++counted_) {
+            add(command_cost(commands[counted_]));
+        }
+        check();
+    }
+
+    /// Add cost known to be in the final output (safe from several
+    /// threads, unlike check(commands)).
+    void add(size_t cost) { cost_.fetch_add(cost, std::memory_order_relaxed); }
+
+    /// Throw DiffCancelled once the cost added so far exceeds the bound.
+    void check() const {
+        if (bound_ && cost_.load(std::memory_order_relaxed)
+                          > bound_->load(std::memory_order_relaxed)) {
+            throw DiffCancelled("cancelled: cannot beat the best candidate");
+        }
+    }
+
+    static size_t command_cost(const Command& cmd) {
+        if (auto* a = std::get_if<AddCmd>(&cmd)) {
+            return V3_COST_MODEL.add_cost + a->data.size();
+        }
+        return V3_COST_MODEL.copy_cost;
+    }
+
+    /// Least an ADD of n bytes can cost once gap re-matching may still
+    /// replace it: one command, a copy or a shorter add.
+    static size_t rematch_floor(size_t n) {
+        return std::min(V3_COST_MODEL.copy_cost, V3_COST_MODEL.add_cost + n);
+    }
+
+private:
+    const std::atomic<size_t>* bound_;
+    size_t counted_ = 0;
+    std::atomic<size_t> cost_{0};
+};
+
+} // namespace delta
@@ -0,0 +1,71 @@
+#pragma once
+
+/// Persisted coarse seed index of a reference file.
+///
+/// Holds the seeds hierarchical's coarse pass looks up: (offset,
+/// fingerprint) pairs of coarse_p-byte seeds whose starts are at most
+/// `stride` apart, so any common substring of seed_len + stride - 1
+/// bytes contains an indexed seed.  Passed as DiffOptions::ref_index,
+/// it lets diff_hierarchical skip hashing R.
+///
+/// update_ref_index() carries an index across a delta R -> R': seeds in
+/// copied ranges are relocated without touching R', and R' is hashed
+/// only where the relocated seeds leave a gap wider than stride (added
+/// ranges and command boundaries).  Update cost is therefore the index
+/// size plus the changed bytes, not |R'|.
+///
+/// Serialized format (big-endian):
+///   magic "DLX\x01" (4) + seed_len u32 + stride u64 + ref_size u64
+///   + ref_crc[8] + count u64 + count x (offset u64, fp u64)
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+inline constexpr uint8_t REF_INDEX_MAGIC[4] = {'D', 'L', 'X', 0x01};
+
+struct RefSeed {
+    uint64_t offset;
+    uint64_t fp;
+    bool operator==(const RefSeed&) const = default;
+};
+
+struct RefIndex {
+    size_t seed_len = COARSE_SEED_LEN;
+    size_t stride = COARSE_SEED_LEN;
+    uint64_t ref_size = 0;
+    std::array<uint8_t, DELTA_CRC_SIZE> ref_crc{};
+    std::vector<RefSeed> seeds; // ascending offsets
+    bool operator==(const RefIndex&) const = default;
+};
+
+/// Coarse seed stride for a reference of r_size bytes: coarse_p times
+/// opts.coarse_thin, grown in multiples of coarse_p only if
+/// opts.max_table cannot hold every block.
+size_t coarse_stride(size_t r_size, const DiffOptions& opts);
+
+/// Index r the way diff_hierarchical would (aligned seeds at the stride).
+RefIndex build_ref_index(std::span<const uint8_t> r, const DiffOptions& opts = {});
+
+/// Index of r_new from the index of the old reference and the placed
+/// commands of a delta old -> r_new (standard or in-place).  new_crc is
+/// r_new's CRC (the delta's destination CRC).  Throws DeltaError if the
+/// delta does not fit the index or r_new.
+RefIndex update_ref_index(
+    const RefIndex& index,
+    const std::vector<PlacedCommand>& delta,
+    std::span<const uint8_t> r_new,
+    const std::array<uint8_t, DELTA_CRC_SIZE>& new_crc);
+
+std::vector<uint8_t> encode_ref_index(const RefIndex& index);
+
+/// Throws DeltaError on a malformed index.
+RefIndex decode_ref_index(std::span<const uint8_t> data);
+
+} // namespace delta
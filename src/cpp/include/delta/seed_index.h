@@ -0,0 +1,82 @@
+#pragma once
+
+/// Open-addressing fingerprint index for local and sparse seed tables.
+///
+/// Linear probing with a first-found policy: inserting a fingerprint
+/// that is already present keeps the original offset.  Capacity is a
+/// power of two kept at most half full; Karp-Rabin fingerprints are
+/// uniform over [0, 2^61-1), so the low bits index well without F mod q.
+/// Unlike the algorithms' fixed-size tables, no seed is ever dropped on a
+/// slot collision — suitable for small indexes rebuilt many times.
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "delta/memory.h"
+
+namespace delta {
+
+class SeedIndex {
+public:
+    /// Clear the index and size it for up to n entries.
+    /// Reuses the existing allocation when it is large enough.
+    void reset(size_t n) {
+        size_t cap = std::bit_ceil(std::max<size_t>(2 * n, 2));
+        slots_.assign(cap, Slot{0, EMPTY});
+        mask_ = cap - 1;
+        size_ = 0;
+    }
+
+    /// Insert fp -> off unless fp is already present.
+    void insert(uint64_t fp, size_t off) {
+        size_t i = static_cast<size_t>(fp) & mask_;
+        while (slots_[i].off != EMPTY) {
+            if (slots_[i].fp == fp) { return; } // retain first-found
+            i = (i + 1) & mask_;
+        }
+        slots_[i] = Slot{fp, off};
+        ++size_;
+    }
+
+    /// Offset stored for fp, or nullopt.
+    std::optional<size_t> find(uint64_t fp) const {
+        if (slots_.empty()) { return std::nullopt; }
+        size_t i = static_cast<size_t>(fp) & mask_;
+        while (slots_[i].off != EMPTY) {
+            if (slots_[i].fp == fp) { return slots_[i].off; }
+            i = (i + 1) & mask_;
+        }
+        return std::nullopt;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return slots_.size(); }
+    static constexpr size_t slot_bytes() { return sizeof(Slot); }
+
+    /// Call fn(n) for each entry, n being the probes find() needs to
+    /// reach it (1 if it sits in its home slot).
+    template <class Fn>
+    void for_each_probe_length(Fn&& fn) const {
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            if (slots_[i].off == EMPTY) { continue; }
+            size_t home = static_cast<size_t>(slots_[i].fp) & mask_;
+            fn(((i - home) & mask_) + 1);
+        }
+    }
+
+private:
+    static constexpr size_t EMPTY = SIZE_MAX;
+    struct Slot {
+        uint64_t fp;
+        size_t off;
+    };
+    TrackedVector<Slot> slots_;
+    size_t mask_ = 0;
+    size_t size_ = 0;
+};
+
+} // namespace delta
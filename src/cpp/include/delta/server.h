@@ -0,0 +1,69 @@
+#pragma once
+
+/// Local encode/decode daemon over a Unix domain socket (POSIX).
+///
+/// serve() keeps an LRU cache of references — mmapped, with their CRC
+/// and, once hierarchical has needed it, their coarse seed index
+/// (ref_index.h) — within a byte budget.  A cached reference is reused
+/// while its size and mtime are unchanged, so a repeated request against
+/// a hot reference pays only for reading V and the scan.  Each
+/// connection is served on its own thread.
+///
+/// Framing: every message is a u32 big-endian length plus payload.
+/// Request payload: op u8, flags u8 (bit 0 = in-place), then four
+/// strings (u32 length + bytes): algorithm, reference, input, output.
+/// Paths are read and written by the server, so they must be absolute.
+/// Reply payload: status u8 (0 = ok) + message string.
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+inline constexpr size_t SERVER_CACHE_BYTES = size_t{4} << 30;
+inline constexpr size_t SERVER_MAX_FRAME = 1 << 20;
+
+enum class ServerOp : uint8_t { Encode = 1, Decode = 2, Shutdown = 3 };
+
+struct ServerRequest {
+    ServerOp op = ServerOp::Encode;
+    bool inplace = false;
+    std::string algorithm;   // encode: greedy/onepass/correcting/hierarchical/best
+    std::string reference;
+    std::string input;       // encode: version file; decode: delta file
+    std::string output;      // encode: delta file; decode: version file
+};
+
+struct ServerReply {
+    bool ok = false;
+    std::string message;     // summary on success, error text otherwise
+};
+
+struct ServerOptions {
+    size_t cache_bytes = SERVER_CACHE_BYTES;
+    bool verbose = false;
+};
+
+std::vector<uint8_t> encode_server_request(const ServerRequest& req);
+/// Throws DeltaError on a malformed request.
+ServerRequest decode_server_request(std::span<const uint8_t> data);
+std::vector<uint8_t> encode_server_reply(const ServerReply& reply);
+/// Throws DeltaError on a malformed reply.
+ServerReply decode_server_reply(std::span<const uint8_t> data);
+
+/// Listen on socket_path (replacing a stale socket file, mode 0600) and
+/// serve until a Shutdown request arrives.  Shutdown lets in-flight
+/// requests finish and closes idle connections.  Request failures are
+/// reported to the client; only socket setup errors throw DeltaError.
+void serve(const std::string& socket_path, const ServerOptions& opts = {});
+
+/// Send one request and wait for the reply.  Throws DeltaError if the
+/// server cannot be reached.
+ServerReply server_call(const std::string& socket_path, const ServerRequest& req);
+
+} // namespace delta
@@ -0,0 +1,56 @@
+#pragma once
+
+/// Sharded encoding: slices of V encoded independently against all of R,
+/// merged afterwards into one standard delta.
+///
+/// A shard file wraps an ordinary standard delta of V's slice
+/// [v_offset, v_offset + slice size), whose destination offsets and
+/// dst CRC are relative to the slice, with a small header:
+///   magic "DLH\x01" (4) + index u32 + count u32 + v_offset u64
+///   + v_total u64, then the embedded delta.
+/// merge_shards() shifts each shard's commands by its v_offset and
+/// combines the slice CRCs (crc64_xz_combine), so V is never read.
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+inline constexpr uint8_t SHARD_MAGIC[4] = {'D', 'L', 'H', 0x01};
+
+struct DeltaShard {
+    uint32_t index = 0;
+    uint32_t count = 1;
+    uint64_t v_offset = 0;
+    uint64_t v_total = 0;
+    std::vector<uint8_t> delta; // standard delta of the slice
+};
+
+/// [begin, end) of slice i of n over a version of v_size bytes.
+std::pair<size_t, size_t> shard_range(size_t v_size, size_t i, size_t n);
+
+std::vector<uint8_t> encode_shard(const DeltaShard& shard);
+
+/// Throws DeltaError on a malformed shard file.
+DeltaShard decode_shard(std::span<const uint8_t> data);
+
+/// True if data starts with SHARD_MAGIC.
+bool is_shard(std::span<const uint8_t> data);
+
+/// Merge a complete set of shards (any order) into one standard delta.
+/// With a non-empty reference, a seam pass re-matches the commands
+/// between the last copy before and the first copy after each shard
+/// boundary (rematch_adds), recovering matches a slice edge cut short.
+/// Throws DeltaError if shards are missing, overlap, or disagree on
+/// the reference.
+std::vector<uint8_t> merge_shards(
+    std::vector<DeltaShard> shards,
+    std::span<const uint8_t> reference = {},
+    const DiffOptions& opts = {});
+
+} // namespace delta
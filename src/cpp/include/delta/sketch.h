@@ -0,0 +1,63 @@
+#pragma once
+
+/// Seed-set sketches for reference selection.
+///
+/// A sketch is the bottom-k of a file's p-byte seed fingerprints
+/// (RollingHash), after a bijective mix so that the k minima are a uniform
+/// sample of the distinct seeds (Broder's bottom-k MinHash).  From two
+/// sketches we estimate the Jaccard similarity of the seed sets, the
+/// number of distinct seeds, and hence the fraction of V's seeds that R
+/// contains — a proxy for the delta ratio, computed in O(k) time
+/// regardless of file size.
+///
+/// Serialized format (big-endian):
+///   magic "DLS\x01" (4) + seed_len u32 + k u32 + file_size u64
+///   + count u32 + count x u64 minima (ascending)
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+inline constexpr size_t SKETCH_SIZE = 1024;
+inline constexpr uint8_t SKETCH_MAGIC[4] = {'D', 'L', 'S', 0x01};
+
+struct Sketch {
+    uint64_t file_size = 0;
+    size_t seed_len = SEED_LEN;
+    size_t k = SKETCH_SIZE;
+    std::vector<uint64_t> mins; // ascending; fewer than k if exact
+    bool operator==(const Sketch&) const = default;
+};
+
+/// Sketch every p-byte seed of data.  O(|data| log k).
+Sketch make_sketch(std::span<const uint8_t> data,
+                   size_t p = SEED_LEN, size_t k = SKETCH_SIZE);
+
+/// Estimated number of distinct seeds (exact when mins.size() < k).
+double sketch_distinct(const Sketch& s);
+
+/// Estimated Jaccard similarity of the two seed sets.
+/// Throws DeltaError if the sketches use different seed lengths.
+double sketch_jaccard(const Sketch& a, const Sketch& b);
+
+/// Estimated fraction of v's distinct seeds that also occur in r.
+double sketch_containment(const Sketch& v, const Sketch& r);
+
+/// Predicted delta/version ratio of v against r: the fraction of v's
+/// seeds r cannot supply, clamped to [0, 1].
+double predicted_ratio(const Sketch& v, const Sketch& r);
+
+std::vector<uint8_t> encode_sketch(const Sketch& s);
+
+/// Throws DeltaError on a malformed sketch.
+Sketch decode_sketch(std::span<const uint8_t> data);
+
+/// True if data starts with SKETCH_MAGIC.
+bool is_sketch(std::span<const uint8_t> data);
+
+} // namespace delta
@@ -14,6 +14,8 @@
 #include <functional>
 #include <utility>
 
+#include "delta/memory.h"
+
 namespace delta {
 
 template <typename V>
@@ -28,7 +30,7 @@ public:
     SplayTree& operator=(const SplayTree&) = delete;
 
     SplayTree(SplayTree&& o) noexcept
-        : root_(o.root_), size_(o.size_) {
+        : root_(o.root_), size_(o.size_), charge_(std::move(o.charge_)) {
         o.root_ = nullptr;
         o.size_ = 0;
     }
@@ -38,6 +40,7 @@ public:
             clear();
             root_ = o.root_;
             size_ = o.size_;
+            charge_ = std::move(o.charge_);
             o.root_ = nullptr;
             o.size_ = 0;
         }
@@ -56,8 +59,7 @@ public:
     /// the (possibly pre-existing) value.  Splays to root.
     V& insert_or_get(uint64_t key, V value) {
         if (!root_) {
-            root_ = new Node{key, std::move(value), nullptr, nullptr};
-            ++size_;
+            root_ = new_node(key, std::move(value));
             return root_->value;
         }
 
@@ -67,8 +69,7 @@ public:
             return root_->value; // already present — retain existing
         }
 
-        auto* n = new Node{key, std::move(value), nullptr, nullptr};
-        ++size_;
+        auto* n = new_node(key, std::move(value));
 
         if (key < root_->key) {
             n->left = root_->left;
@@ -86,8 +87,7 @@ public:
     /// Insert key with value, overwriting any existing entry.
     void insert(uint64_t key, V value) {
         if (!root_) {
-            root_ = new Node{key, std::move(value), nullptr, nullptr};
-            ++size_;
+            root_ = new_node(key, std::move(value));
             return;
         }
 
@@ -98,8 +98,7 @@ public:
             return;
         }
 
-        auto* n = new Node{key, std::move(value), nullptr, nullptr};
-        ++size_;
+        auto* n = new_node(key, std::move(value));
 
         if (key < root_->key) {
             n->left = root_->left;
@@ -118,6 +117,7 @@ public:
         destroy(root_);
         root_ = nullptr;
         size_ = 0;
+        charge_.set(0);
     }
 
     size_t size() const { return size_; }
@@ -131,8 +131,13 @@ private:
         Node* right;
     };
 
+    /// Nodes are charged to MEM_TABLES in steps of this many, not one
+    /// by one, to keep the counters' atomics off the insert path.
+    static constexpr size_t CHARGE_NODES = 4096;
+
     Node* root_ = nullptr;
     size_t size_ = 0;
+    MemoryCharge charge_;
 
     /// Top-down splay (Sleator & Tarjan 1985).
     ///
@@ -192,6 +197,15 @@ private:
     /// Recursively destroy subtree (iterative stack would be safer
     /// for very deep trees, but fingerprints are well-distributed
     /// and splay keeps depth reasonable).
+    Node* new_node(uint64_t key, V value) {
+        auto* n = new Node{key, std::move(value), nullptr, nullptr};
+        if (size_ % CHARGE_NODES == 0) {
+            charge_.set((size_ / CHARGE_NODES + 1) * CHARGE_NODES * sizeof(Node));
+        }
+        ++size_;
+        return n;
+    }
+
     void destroy(Node* n) {
         if (!n) { return; }
         destroy(n->left);
@@ -0,0 +1,245 @@
+#pragma once
+
+/// Structured diagnostics for diff() (DiffOptions::stats).
+///
+/// Every algorithm, diff()'s trim and the post-passes fill the DiffStats
+/// they are handed: table parameters, per-phase counters and wall times,
+/// and a summary of the result.  Counters live in locals while a loop
+/// runs and are stored once at the end, so collecting them costs nothing
+/// per position.  Building with -DDELTA_NO_STATS (CMake option
+/// DELTA_STATS=OFF) turns the counters into empty types; the struct
+/// keeps its layout and those fields read zero.
+///
+/// opts.verbose prints the same data to stderr via print_diff_stats().
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "delta/memory.h"
+#include "delta/perf.h"
+#include "delta/types.h"
+
+namespace delta {
+
+#ifdef DELTA_NO_STATS
+inline constexpr bool DELTA_STATS_ENABLED = false;
+
+/// Counter that compiles to nothing.
+struct StatCounter {
+    constexpr StatCounter(size_t = 0) {}
+    constexpr StatCounter& operator++() { return *this; }
+    constexpr StatCounter& operator+=(size_t) { return *this; }
+    constexpr operator size_t() const { return 0; }
+};
+#else
+inline constexpr bool DELTA_STATS_ENABLED = true;
+using StatCounter = size_t;
+#endif
+
+/// Log-bucketed histogram in the style of HdrHistogram, in constant
+/// memory (about 4 KB).  Values below 16 are counted exactly; each power
+/// of two above that is split into 8 linear sub-buckets, so a percentile
+/// is reported within 12.5% of the true value.  Count, sum, min and max
+/// are exact.  Under DELTA_NO_STATS record() does nothing.
+class Histogram {
+public:
+    static constexpr unsigned SUB_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = size_t{1} << SUB_BITS;
+    static constexpr size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    void record(uint64_t v, uint64_t n = 1) {
+        if constexpr (DELTA_STATS_ENABLED) {
+            counts_[bucket_of(v)] += n;
+            count_ += n;
+            sum_ += v * n;
+            min_ = std::min(min_, v);
+            max_ = std::max(max_, v);
+        }
+    }
+    Histogram& operator+=(const Histogram& o);
+
+    uint64_t count() const { return count_; }
+    uint64_t sum() const { return sum_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+    /// Highest value in the bucket holding the q-quantile (0 <= q <= 1),
+    /// clamped to [min, max].
+    uint64_t percentile(double q) const;
+
+    uint64_t bucket_count(size_t i) const { return counts_[i]; }
+    static size_t bucket_of(uint64_t v) {
+        unsigned width = static_cast<unsigned>(std::bit_width(v));
+        if (width <= SUB_BITS + 1) { return static_cast<size_t>(v); }
+        unsigned shift = width - 1 - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<size_t>((v >> shift) - SUB_BUCKETS);
+    }
+    static uint64_t bucket_low(size_t i) {
+        if (i < 2 * SUB_BUCKETS) { return i; }
+        size_t shift = i / SUB_BUCKETS - 1;
+        return static_cast<uint64_t>(SUB_BUCKETS + i % SUB_BUCKETS) << shift;
+    }
+    static uint64_t bucket_high(size_t i) {
+        if (i < 2 * SUB_BUCKETS) { return i; }
+        return bucket_low(i) + (uint64_t{1} << (i / SUB_BUCKETS - 1)) - 1;
+    }
+
+private:
+    std::array<uint64_t, BUCKETS> counts_{};
+    uint64_t count_ = 0, sum_ = 0;
+    uint64_t min_ = UINT64_MAX, max_ = 0;
+};
+
+/// Wall-clock and process CPU seconds spent in one phase (CPU time
+/// counts every thread, so it can exceed wall time), its perf counts if
+/// enable_perf_counters() was called (perf.h), the peak of the tracked
+/// heap during the phase (memory.h) and the process's peak RSS at its end.
+struct PhaseTime {
+    double wall = 0;
+    double cpu = 0;
+    PerfCounts perf;
+    size_t mem_peak = 0;
+    size_t rss = 0;
+    PhaseTime& operator+=(const PhaseTime& o) {
+        wall += o.wall;
+        cpu += o.cpu;
+        perf += o.perf;
+        mem_peak = std::max(mem_peak, o.mem_peak);
+        rss = std::max(rss, o.rss);
+        return *this;
+    }
+};
+
+/// Times a phase from construction to elapsed().
+class PhaseTimer {
+public:
+    PhaseTimer();
+    PhaseTime elapsed() const;
+
+private:
+    std::chrono::steady_clock::time_point wall0_;
+    double cpu0_;
+    PerfCounts perf0_;
+    MemoryWatch mem_;
+};
+
+/// CPU seconds used by all threads of this process so far.
+double process_cpu_seconds();
+
+/// Peak resident set size of this process, in bytes.
+size_t peak_rss_bytes();
+
+/// One best-of-N candidate: its label and encoded cost (nullopt if it
+/// was cancelled by the race).
+struct CandidateStats {
+    std::string label;
+    std::optional<size_t> cost;
+};
+
+struct DiffStats {
+    const char* algorithm = "";     // "onepass", "correcting", ...
+    size_t r_size = 0, v_size = 0, seed_len = 0;
+
+    // Seed lookup structure.
+    const char* table_kind = "";    // "hash table", "splay tree", ...
+    size_t table_capacity = 0;
+    size_t table_entries = 0;
+
+    // Correcting checkpointing (Section 8.1): |F|, modulus m, residue k.
+    uint64_t f_size = 0, checkpoint_m = 0, checkpoint_k = 0;
+
+    // Hierarchical coarse pass.
+    size_t coarse_len = 0, coarse_stride = 0, coarse_copies = 0;
+    bool index_loaded = false;      // seeds came from a RefIndex
+
+    // Build phase: seeds of R hashed, passing the checkpoint test, stored.
+    size_t build_seeds = 0, build_passed = 0, build_stored = 0;
+    size_t build_collisions = 0;
+    PhaseTime build;
+
+    // Scan phase: positions of V visited, table lookups, verified matches.
+    size_t scan_positions = 0, scan_lookups = 0, scan_matches = 0;
+    size_t scan_fp_mismatch = 0, scan_byte_mismatch = 0;
+    PhaseTime scan;                 // best-of-N: the whole candidate race
+
+    // Time budget: thinning factors, the part of R indexed, and where the
+    // scan stopped or handed over to a onepass tail (SIZE_MAX if it did not).
+    bool budget = false;
+    size_t build_thin = 1, scan_thin = 1, build_indexed = 0;
+    size_t scan_stopped_at = SIZE_MAX;
+    size_t tail_v = SIZE_MAX, tail_r = 0;
+
+    // diff() wrapper and post-passes.
+    size_t trim_prefix = 0, trim_suffix = 0;
+    PhaseTime diff_time;            // the algorithm call, fine pass included
+    size_t rematch_gaps = 0, rematch_gap_bytes = 0, rematch_searched = 0;
+    size_t rematch_copies = 0, rematch_threads = 0;
+    size_t rematch_min_add = 0, rematch_seed_len = 0;
+    PhaseTime rematch;
+    bool optimized = false;
+    size_t optimize_commands_before = 0, optimize_cost_before = 0;
+    size_t optimize_cost_after = 0;
+    PhaseTime optimize;
+
+    // Best-of-N.
+    std::vector<CandidateStats> candidates;
+    size_t winner = 0, best_threads = 0;
+
+    // Result (the commands diff() returns).
+    size_t num_copies = 0, copy_bytes = 0, num_adds = 0, add_bytes = 0;
+    size_t copy_min = 0, copy_max = 0, copy_median = 0;
+    size_t command_heap_bytes = 0;  // command vector and literal buffers
+    size_t memory_limit = 0;        // DiffOptions::memory_limit
+
+    // Distributions, for tuning seed length and table size.
+    Histogram copy_lengths, add_lengths;   // result
+    Histogram match_extension;  // bytes a verified seed grew by when extended
+    Histogram checkpoint_gaps;  // correcting: R offsets between passing seeds
+    Histogram bucket_occupancy; // greedy: R offsets stored per fingerprint
+    Histogram probe_lengths;    // greedy: candidates per hit; seed index:
+                                // probes to reach each entry
+
+    /// The histograms with their --verbose / JSON names.
+    std::array<std::pair<const char*, const Histogram*>, 6> histograms() const {
+        return {{{"copy_length", &copy_lengths}, {"add_length", &add_lengths},
+                 {"match_extension", &match_extension},
+                 {"checkpoint_gap", &checkpoint_gaps},
+                 {"bucket_occupancy", &bucket_occupancy},
+                 {"probe_length", &probe_lengths}}};
+    }
+};
+
+/// Report of one CLI run (--stats-json): labels, phases in run order,
+/// counts, and the DiffStats of the diff if the run made one.
+struct StatsReport {
+    std::string command;            // "encode", "decode", "inplace"
+    std::vector<std::pair<std::string, std::string>> labels;
+    std::vector<std::pair<std::string, PhaseTime>> phases;
+    std::vector<std::pair<std::string, uint64_t>> counts;
+    const DiffStats* diff = nullptr;
+    PhaseTime total;
+};
+
+/// Fill the result fields of stats from commands: counts, byte totals,
+/// and the copy/add length histograms.
+void record_result(DiffStats& stats, const std::vector<Command>& commands);
+
+/// Render stats in the --verbose text format.
+void print_diff_stats(const DiffStats& stats, std::FILE* out = stderr);
+
+/// Print report's phases as a table (wall, CPU and perf counts).
+void print_phases(const StatsReport& report, std::FILE* out = stderr);
+
+/// Render report as one JSON object, with peak_rss_bytes appended.
+std::string stats_json(const StatsReport& report);
+
+} // namespace delta
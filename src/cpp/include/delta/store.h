@@ -0,0 +1,95 @@
+#pragma once
+
+/// Versioned delta store: a base plus forward deltas in one pack file.
+///
+/// Each version is stored either as a full snapshot or as a delta
+/// (unified DLT format) against the previous version.  A new snapshot is
+/// written whenever the chain back to the last snapshot would exceed
+/// max_depth deltas, or its delta bytes would exceed max_chain_ratio of
+/// the version size, so retrieval is bounded regardless of history
+/// length: get() composes at most max_depth deltas (compose.h) and
+/// applies them once.
+///
+/// Pack layout (big-endian):
+///   magic "DLP\x01"
+///   records: snapshot bytes or delta files, in id order
+///   index:   count u32, then per version
+///            kind u8, parent u32, depth u32, offset u64, length u64,
+///            version_size u64, chain_bytes u64, crc[8]
+///   footer:  index_offset u64 + "DLPI"
+/// Adding a version appends the record and a fresh index after the old
+/// footer, syncs them, and only then writes the new footer, so a crash
+/// mid-add leaves a torn tail that open() drops, falling back to the last
+/// durable footer.  Superseded indexes stay behind as dead space until
+/// it outweighs the records, when the pack is compacted as prune()
+/// does.  Version ids are stable across prune.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+inline constexpr uint8_t STORE_MAGIC[4] = {'D', 'L', 'P', 0x01};
+inline constexpr uint8_t STORE_INDEX_MAGIC[4] = {'D', 'L', 'P', 'I'};
+inline constexpr size_t STORE_MAX_DEPTH = 16;
+inline constexpr double STORE_MAX_CHAIN_RATIO = 0.5;
+
+enum class StoreKind : uint8_t { Pruned = 0, Snapshot = 1, Delta = 2 };
+
+struct StoreEntry {
+    StoreKind kind;
+    uint32_t parent;      // previous version (deltas only)
+    uint32_t depth;       // deltas back to the snapshot (0 for snapshots)
+    uint64_t offset;      // record position in the pack
+    uint64_t length;      // record bytes
+    uint64_t version_size;
+    uint64_t chain_bytes; // delta bytes back to the snapshot
+    std::array<uint8_t, DELTA_CRC_SIZE> crc;
+};
+
+struct StoreOptions {
+    size_t max_depth = STORE_MAX_DEPTH;
+    double max_chain_ratio = STORE_MAX_CHAIN_RATIO;
+    Algorithm algo = Algorithm::Correcting;
+    DiffOptions diff;
+};
+
+class DeltaStore {
+public:
+    /// Open an existing pack, or create an empty one if it does not exist.
+    /// Throws DeltaError on a malformed pack or I/O failure.
+    static DeltaStore open(const std::string& path);
+
+    /// Append a version; returns its id.
+    uint32_t add(std::span<const uint8_t> version, const StoreOptions& opts = {});
+
+    /// Reconstruct a version.  Throws DeltaError for pruned or unknown ids.
+    std::vector<uint8_t> get(uint32_t id) const;
+
+    /// Drop every version before the newest `keep`, turning the oldest
+    /// kept version into a snapshot if needed, and compact the pack.
+    void prune(size_t keep);
+
+    const std::vector<StoreEntry>& entries() const { return entries_; }
+    const std::string& path() const { return path_; }
+
+private:
+    std::vector<uint8_t> read_record(const StoreEntry& e) const;
+    /// Write records at offset followed by the index, then the footer.
+    void write_tail(uint64_t offset, std::span<const uint8_t> records);
+    /// Rewrite the pack through a temporary file, pruning ids below first.
+    void rewrite(size_t first);
+
+    std::string path_;
+    std::vector<StoreEntry> entries_;
+    uint64_t index_offset_ = 0;
+    uint64_t end_ = 0;        // file size: the footer's end
+};
+
+} // namespace delta
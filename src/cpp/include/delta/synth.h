@@ -0,0 +1,101 @@
+#pragma once
+
+/// Deterministic synthetic reference/version pairs for benchmarks.
+///
+/// A pair is described by a SynthPlan: the reference is a content stream
+/// (random, disk image or text) addressed by offset, and the version is a
+/// list of segments, each copied from the reference, taken from a second
+/// "fresh" stream or zero-filled, plus single-byte mutations.  Every byte
+/// is a function of (seed, offset), so any range of either file can be
+/// generated on its own: synth_generate() fills fixed chunks on all cores,
+/// and the same seed yields the same pair on every platform.
+///
+/// Scenarios (rate is the probability that a block is changed):
+///   transpose  blocks of [block_min, block_max] bytes; a rate fraction
+///              of them displaced (tests/gen_transpositions.py)
+///   edits      one insertion or deletion of up to SYNTH_MAX_EDIT bytes
+///              in a rate fraction of the blocks
+///   mutate     one flipped byte in a rate fraction of the blocks
+///   append     the reference followed by rate x size fresh bytes
+///   image      4 KiB sectors, a quarter random and the rest zero; a rate
+///              fraction of the sectors rewritten or zeroed
+///   text       word-like text with Zipf-distributed words, then edits
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "delta/types.h"
+
+namespace delta {
+
+enum class SynthScenario { Transpose, Edits, Mutate, Append, Image, Text };
+
+inline constexpr const char* SYNTH_SCENARIO_NAMES[] = {
+    "transpose", "edits", "mutate", "append", "image", "text"};
+
+/// Longest insertion or deletion of the edits and text scenarios.
+inline constexpr size_t SYNTH_MAX_EDIT = 256;
+
+/// Sector size of the image scenario.
+inline constexpr size_t SYNTH_SECTOR = 4096;
+
+/// Unit of work of synth_generate().
+inline constexpr size_t SYNTH_CHUNK = size_t{4} << 20;
+
+struct SynthOptions {
+    SynthScenario scenario = SynthScenario::Transpose;
+    uint64_t size = uint64_t{16} << 20;   // reference bytes
+    uint64_t seed = 1;
+    size_t block_min = 1024;
+    size_t block_max = 16384;
+    double rate = 0.1;
+    size_t threads = 0;                   // 0 = hardware concurrency
+};
+
+/// Throws DeltaError for an unknown name.
+SynthScenario synth_scenario(const std::string& name);
+
+struct SynthSegment {
+    enum Kind : uint8_t { Copy, Fresh, Zero };
+    uint64_t start;    // offset in the version
+    uint64_t length;
+    uint64_t source;   // reference offset (Copy) or fresh-stream offset
+    Kind kind;
+};
+
+struct SynthPlan {
+    SynthOptions opts;
+    uint64_t ref_size = 0;
+    uint64_t version_size = 0;
+    std::vector<SynthSegment> segments;   // ascending, covering the version
+    std::vector<uint64_t> mutations;      // ascending version offsets
+    size_t blocks_changed = 0;
+};
+
+/// Lay out the version.  Serial, O(size / block size).
+/// Throws DeltaError on inconsistent options.
+SynthPlan synth_plan(const SynthOptions& opts);
+
+/// Reference bytes [offset, offset + out.size()).
+void synth_fill_reference(const SynthPlan& plan, uint64_t offset, std::span<uint8_t> out);
+
+/// Version bytes [offset, offset + out.size()).
+void synth_fill_version(const SynthPlan& plan, uint64_t offset, std::span<uint8_t> out);
+
+/// Fill both files in SYNTH_CHUNK pieces on opts.threads workers.
+/// ref must hold plan.ref_size bytes and ver plan.version_size, or be
+/// empty to skip that file.
+void synth_generate(const SynthPlan& plan, std::span<uint8_t> ref, std::span<uint8_t> ver);
+
+struct SynthPair {
+    std::vector<uint8_t> reference;
+    std::vector<uint8_t> version;
+};
+
+/// Plan and generate a pair in memory.
+SynthPair synth_pair(const SynthOptions& opts);
+
+} // namespace delta
@@ -0,0 +1,98 @@
+#pragma once
+
+/// Timeline tracing in the Chrome trace-event format (chrome://tracing,
+/// ui.perfetto.dev).
+///
+/// start_tracing() turns on recording; from then on every TraceSpan
+/// appends one complete ("X") event, begin time and duration, to a
+/// ring buffer owned by the calling thread.  Buffers are registered on a
+/// thread's first event, so recording takes no lock.  A ring starts at
+/// TRACE_INITIAL_EVENTS and doubles as it fills, up to events_per_thread,
+/// so short-lived threads cost what they record; a full ring overwrites
+/// its oldest events and counts them as dropped.
+/// The library marks its phases (diff, build, scan, rematch, optimize,
+/// in-place conversion, apply, verify, CRC) and its worker tasks; callers
+/// add their own spans the same way.  With tracing off a span costs one
+/// relaxed load.
+///
+/// trace_json() collects every thread's events.  Call it (and
+/// start_tracing() again) only while no traced work is running, e.g.
+/// after the call being traced has returned and joined its workers.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace delta {
+
+/// Events kept per thread by default (48 bytes each).
+inline constexpr size_t TRACE_DEFAULT_EVENTS = size_t{1} << 16;
+
+/// Size of a thread's ring after its first event.
+inline constexpr size_t TRACE_INITIAL_EVENTS = 64;
+
+/// Discard any previous trace and start recording, keeping at most
+/// events_per_thread events per thread.
+void start_tracing(size_t events_per_thread = TRACE_DEFAULT_EVENTS);
+
+/// Stop recording; the events stay available to trace_json().
+void stop_tracing();
+
+bool tracing_enabled();
+
+/// Nanoseconds since start_tracing().
+uint64_t trace_clock();
+
+/// Record a span that began at trace_clock() value begin and ends now.
+/// name, cat and arg_name must outlive the trace (literals, or
+/// trace_intern()).
+void trace_complete(const char* name, const char* cat, uint64_t begin,
+                    const char* arg_name = nullptr, uint64_t arg = 0);
+
+/// Name the calling thread in the trace ("main", "rematch worker").
+void trace_thread_name(const char* name);
+
+/// A copy of name that lives as long as the process, for span names
+/// built at run time.
+const char* trace_intern(const std::string& name);
+
+/// The recorded events as one Chrome trace JSON object.
+std::string trace_json();
+
+/// Events overwritten because a thread's ring was full.
+uint64_t trace_dropped_events();
+
+/// Records [construction, destruction or end()) as one span if tracing was on
+/// when it was constructed.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, const char* cat = "phase",
+                       const char* arg_name = nullptr, uint64_t arg = 0)
+    {
+        if (tracing_enabled()) {
+            name_ = name;
+            cat_ = cat;
+            arg_name_ = arg_name;
+            arg_ = arg;
+            begin_ = trace_clock();
+        }
+    }
+    ~TraceSpan() { end(); }
+
+    /// Record the span now rather than at destruction.
+    void end() {
+        if (name_) { trace_complete(name_, cat_, begin_, arg_name_, arg_); }
+        name_ = nullptr;
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_ = nullptr;
+    const char* cat_ = nullptr;
+    const char* arg_name_ = nullptr;
+    uint64_t arg_ = 0;
+    uint64_t begin_ = 0;
+};
+
+} // namespace delta
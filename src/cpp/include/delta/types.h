@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <span>
@@ -19,12 +21,21 @@ namespace delta {
 //   Q (HASH_MOD)  = Mersenne prime 2^61-1 for fingerprint arithmetic
 //   q (TABLE_SIZE) = hash table capacity; correcting uses checkpointing
 //                    (Section 8) to fit any |R| into fixed-size table
+//   COARSE_SEED_LEN = long seed for hierarchical's sparse first pass
+//   LOCAL_SLACK     = R slack around neighbouring copies for local indexes
+//   REMATCH_SEED_LEN / REMATCH_MIN_ADD = gap re-matching seed and threshold
+//   REMATCH_MAX_REACH = cap on the R searched past a gap's anchor
 // Delta commands: Section 2.1.1
 // ============================================================================
 
 inline constexpr size_t SEED_LEN = 16;
 inline constexpr size_t TABLE_SIZE = 1048573;       // largest prime < 2^20
 inline constexpr size_t MAX_TABLE_SIZE = 1073741827; // prime near 2^30; default ceiling for auto-sizing
+inline constexpr size_t COARSE_SEED_LEN = 256;
+inline constexpr size_t LOCAL_SLACK = 4096;
+inline constexpr size_t REMATCH_SEED_LEN = 8;
+inline constexpr size_t REMATCH_MIN_ADD = 64;
+inline constexpr size_t REMATCH_MAX_REACH = size_t{256} << 10;
 inline constexpr uint64_t HASH_BASE = 263;
 inline constexpr uint64_t HASH_MOD = (1ULL << 61) - 1; // Mersenne prime 2^61-1
 inline constexpr uint8_t DELTA_MAGIC[4] = {'D', 'L', 'T', 0x03};
@@ -82,7 +93,7 @@ using PlacedCommand = std::variant<PlacedCopy, PlacedAdd>;
 // Algorithm and Policy enums
 // ============================================================================
 
-enum class Algorithm { Greedy, Onepass, Correcting };
+enum class Algorithm { Greedy, Onepass, Correcting, Hierarchical, Best };
 
 enum class CyclePolicy { Localmin, Constant };
 
@@ -95,6 +106,12 @@ public:
     using std::runtime_error::runtime_error;
 };
 
+/// Thrown by an algorithm abandoned by a best-of-N race (race.h).
+class DiffCancelled : public DeltaError {
+public:
+    using DeltaError::DeltaError;
+};
+
 // ============================================================================
 // Summary statistics
 // ============================================================================
@@ -111,17 +128,48 @@ struct DeltaSummary {
 DeltaSummary delta_summary(const std::vector<Command>& commands);
 DeltaSummary placed_summary(const std::vector<PlacedCommand>& commands);
 
+// ============================================================================
+// Cost model — encoded bytes per command, used by the command optimizer
+// ============================================================================
+
+struct CostModel {
+    size_t copy_cost; // whole COPY command
+    size_t add_cost;  // ADD command excluding its literal bytes
+};
+
+/// DLT\x03: COPY = type + src + dst + len, ADD = type + dst + len + data.
+inline constexpr CostModel V3_COST_MODEL{
+    1 + DELTA_COPY_PAYLOAD, 1 + DELTA_ADD_HEADER};
+
 // ============================================================================
 // Diff options — replaces positional parameter lists
 // ============================================================================
 
+struct RefIndex;  // ref_index.h
+struct DiffStats; // stats.h
+
 struct DiffOptions {
     size_t p = SEED_LEN;
     size_t q = TABLE_SIZE;
     size_t buf_cap = DELTA_BUF_CAP;
-    bool verbose = false;
+    bool verbose = false;              // diff(): print DiffStats to stderr (stats.h)
     bool use_splay = false;
     size_t max_table = MAX_TABLE_SIZE;
+    size_t memory_limit = 0;           // bytes for seed tables; 0 = max_table only (memory.h)
+    size_t coarse_p = COARSE_SEED_LEN; // hierarchical: coarse seed length
+    size_t coarse_thin = 1;            // hierarchical: index every n-th coarse block
+    bool fine_pass = true;             // hierarchical: re-match gaps with p-byte seeds
+    bool rematch = false;              // run rematch_adds after diff()
+    bool optimize = false;             // run optimize_commands after diff()
+    bool trim = false;                 // diff() strips common prefix/suffix
+    size_t rematch_p = REMATCH_SEED_LEN;
+    size_t rematch_min = REMATCH_MIN_ADD;
+    size_t threads = 0;                // 0 = hardware concurrency
+    double time_budget = 0;            // seconds for diff(); 0 = unbounded
+    std::chrono::steady_clock::time_point deadline{}; // absolute; overrides time_budget
+    const std::atomic<size_t>* size_bound = nullptr;  // best-of-N race (race.h)
+    const RefIndex* ref_index = nullptr; // hierarchical: prebuilt coarse index of R
+    DiffStats* stats = nullptr;        // filled by diff() and the algorithms if set
 };
 
 } // namespace delta
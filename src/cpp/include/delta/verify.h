@@ -0,0 +1,49 @@
+#pragma once
+
+/// Verify-only decode: check that a delta reconstructs the version it
+/// records, without materialising the version.
+///
+/// Commands are visited in destination order and their bytes (reference
+/// ranges for copies, literals for adds) are fed straight into an
+/// incremental CRC-64, so nothing is written.  Memory is O(commands),
+/// not constant: this is a deliberate adaptation, since the decoded
+/// command list and its destination order are needed to stream in
+/// output order, and they are small next to the version.
+///
+/// Where commands overlap in the output, each byte is taken from the
+/// last of them in file order, as a full decode would write it; the
+/// commands covering a position are kept in a heap while sweeping.
+/// An in-place delta streams the same way (unwritten bytes keep the
+/// reference bytes its buffer starts with) as long as no copy reads
+/// bytes an earlier command already overwrote.  make_inplace orders
+/// commands so that always holds, but it is checked rather than
+/// trusted; a delta that fails it is applied in full (in a buffer of
+/// max(|R|, |V|)) instead.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "delta/types.h"
+
+namespace delta {
+
+struct VerifyResult {
+    bool ok = false;
+    std::string error;       // why verification failed
+    size_t version_size = 0;
+    bool inplace = false;
+    bool streamed = true;    // false if an in-place delta needed a full apply
+};
+
+/// Verify delta against reference r.  r_crc, if given, is r's CRC
+/// (saves re-hashing a reference shared by many deltas).  Never throws
+/// for a malformed delta; the problem is reported in the result.
+VerifyResult verify_delta(
+    std::span<const uint8_t> r,
+    std::span<const uint8_t> delta,
+    const std::array<uint8_t, DELTA_CRC_SIZE>* r_crc = nullptr);
+
+} // namespace delta
@@ -1,13 +1,19 @@
 #include <CLI/CLI.hpp>
 #include <delta/delta.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
+#include <thread>
 #include <vector>
 
 // POSIX mmap
@@ -51,6 +57,28 @@ public:
         return mf;
     }
 
+    /// Create (or truncate) path at size bytes, mapped writable.
+    static MappedFile create(const std::string& path, size_t size) {
+        MappedFile mf;
+        mf.fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (mf.fd_ < 0 || ::ftruncate(mf.fd_, static_cast<off_t>(size)) < 0) {
+            std::fprintf(stderr, "Error creating %s: %s\n",
+                path.c_str(), std::strerror(errno));
+            std::exit(1);
+        }
+        mf.size_ = size;
+        if (mf.size_ > 0) {
+            mf.data_ = static_cast<uint8_t*>(
+                ::mmap(nullptr, mf.size_, PROT_READ | PROT_WRITE, MAP_SHARED, mf.fd_, 0));
+            if (mf.data_ == MAP_FAILED) {
+                std::fprintf(stderr, "Error mmap %s: %s\n",
+                    path.c_str(), std::strerror(errno));
+                std::exit(1);
+            }
+        }
+        return mf;
+    }
+
     ~MappedFile() {
         if (data_ && data_ != MAP_FAILED) ::munmap(data_, size_);
         if (fd_ >= 0) ::close(fd_);
@@ -75,7 +103,9 @@ public:
     std::span<const uint8_t> span() const {
         return {data_, size_};
     }
+    std::span<uint8_t> writable() { return {data_, size_}; }
     size_t size() const { return size_; }
+    int fd() const { return fd_; }
 
 private:
     uint8_t* data_ = nullptr;
@@ -114,6 +144,80 @@ static std::string hex_str(const std::array<uint8_t, DELTA_CRC_SIZE>& bytes) {
     return s;
 }
 
+/// CRC of a mapped reference file, through the CRC cache when enabled.
+static std::array<uint8_t, DELTA_CRC_SIZE> reference_crc(
+        const MappedFile& file, bool use_cache, bool* hit = nullptr) {
+    if (hit) { *hit = false; }
+    auto r = file.span();
+    if (!use_cache) { return crc64_xz(r.data(), r.size()); }
+    return cached_file_crc(CrcCache(CrcCache::default_path()), file.fd(), r, hit);
+}
+
+/// --perf: open the counters before any phase starts.  Runs go on
+/// without them (with a warning) where perf_event_open is not allowed.
+static void start_perf(bool wanted) {
+    if (!wanted) { return; }
+    std::string error;
+    if (enable_perf_counters(&error) == 0) {
+        std::fprintf(stderr, "warning: perf counters unavailable (%s)\n", error.c_str());
+    } else if (!error.empty()) {
+        std::fprintf(stderr, "warning: some perf counters unavailable (%s)\n",
+            error.c_str());
+    }
+}
+
+/// --trace: record spans from here on, the calling thread as "main".
+static void start_trace(const std::string& path) {
+    if (path.empty()) { return; }
+    start_tracing();
+    trace_thread_name("main");
+}
+
+/// Write the --trace timeline; nothing if no path was given.
+static void write_trace(const std::string& path) {
+    if (path.empty()) { return; }
+    stop_tracing();
+    auto json = trace_json();
+    write_file(path, {reinterpret_cast<const uint8_t*>(json.data()), json.size()});
+}
+
+/// Write a --stats-json report; nothing if no path was given.
+static void write_stats_json(const std::string& path, const StatsReport& report) {
+    if (path.empty()) { return; }
+    auto json = stats_json(report);
+    write_file(path, {reinterpret_cast<const uint8_t*>(json.data()), json.size()});
+}
+
+/// Forward a request to a `delta serve` daemon and print its reply.
+/// Paths are made absolute, since the server does the file I/O.
+static int call_server(const std::string& socket_path, ServerRequest req) {
+    for (auto* path : {&req.reference, &req.input, &req.output}) {
+        if (!path->empty()) { *path = std::filesystem::absolute(*path).string(); }
+    }
+    auto reply = server_call(socket_path, req);
+    if (!reply.ok) {
+        std::fprintf(stderr, "error: %s\n", reply.message.c_str());
+        return 1;
+    }
+    std::fputs(reply.message.c_str(), stdout);
+    return 0;
+}
+
+/// The first option given to `cmd` that a `--server` request does not
+/// carry ("" if none).  The server encodes with default tuning, and
+/// stats, traces and the CRC cache belong to the client process.
+static std::string unforwarded_option(const CLI::App* cmd,
+                                      const std::vector<std::string>& forwarded) {
+    for (const auto* opt : cmd->get_options()) {
+        if (opt->get_positional() || opt->count() == 0) { continue; }
+        auto name = opt->get_name();
+        if (std::find(forwarded.begin(), forwarded.end(), name) == forwarded.end()) {
+            return name;
+        }
+    }
+    return {};
+}
+
 /// Parse a size string with optional k/M/B suffix (decimal multipliers).
 static size_t parse_size_suffix(const std::string& s) {
     if (s.empty()) { return 0; }
@@ -123,9 +227,43 @@ static size_t parse_size_suffix(const std::string& s) {
     if (last == 'k' || last == 'K') { mult = 1000ULL;           num = s.substr(0, s.size() - 1); }
     else if (last == 'M' || last == 'm') { mult = 1'000'000ULL;         num = s.substr(0, s.size() - 1); }
     else if (last == 'B' || last == 'b') { mult = 1'000'000'000ULL;     num = s.substr(0, s.size() - 1); }
+    else if (last == 'G' || last == 'g') { mult = 1'000'000'000ULL;     num = s.substr(0, s.size() - 1); }
     return static_cast<size_t>(std::stoull(num)) * mult;
 }
 
+/// Split a comma-separated list ("onepass,correcting").
+static std::vector<std::string> split_list(const std::string& s) {
+    std::vector<std::string> items;
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos) { end = s.size(); }
+        if (end > pos) { items.push_back(s.substr(pos, end - pos)); }
+        pos = end + 1;
+    }
+    return items;
+}
+
+/// Parse an effort level list such as "1-9" or "2,6,9".
+static std::vector<int> parse_levels(const std::string& s) {
+    std::vector<int> levels;
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos) { end = s.size(); }
+        std::string item = s.substr(pos, end - pos);
+        size_t dash = item.find('-');
+        int lo = std::atoi(item.substr(0, dash).c_str());
+        int hi = (dash == std::string::npos) ? lo : std::atoi(item.substr(dash + 1).c_str());
+        for (int l = lo; l <= hi; ++l) {
+            if (l < MIN_EFFORT || l > MAX_EFFORT) { return {}; }
+            levels.push_back(l);
+        }
+        pos = end + 1;
+    }
+    return levels;
+}
+
 // ── main ─────────────────────────────────────────────────────────────────
 
 int main(int argc, char** argv) {
@@ -135,27 +273,278 @@ int main(int argc, char** argv) {
     // ── encode subcommand ────────────────────────────────────────────
     auto* enc = app.add_subcommand("encode", "Compute delta encoding");
     std::string enc_algo_str;
-    enc->add_option("algorithm", enc_algo_str, "Algorithm (greedy/onepass/correcting)")
+    enc->add_option("algorithm", enc_algo_str,
+                    "Algorithm (greedy/onepass/correcting/hierarchical/best/auto)")
         ->required();
     std::string enc_ref, enc_ver, enc_delta;
     enc->add_option("reference", enc_ref, "Reference file")->required();
     enc->add_option("version", enc_ver, "Version file")->required();
     enc->add_option("delta_file", enc_delta, "Output delta file")->required();
     size_t enc_seed_len = SEED_LEN;
-    enc->add_option("--seed-len", enc_seed_len, "Seed length");
+    auto* enc_seed_opt = enc->add_option("--seed-len", enc_seed_len, "Seed length");
     size_t enc_table_size = TABLE_SIZE;
-    enc->add_option("--table-size", enc_table_size, "Hash table floor size");
+    auto* enc_table_opt = enc->add_option("--table-size", enc_table_size,
+                                          "Hash table floor size");
     std::string enc_max_table_str = std::to_string(MAX_TABLE_SIZE);
-    enc->add_option("--max-table", enc_max_table_str,
+    auto* enc_max_table_opt = enc->add_option("--max-table", enc_max_table_str,
                     "Max hash table size (k/M/B suffix: e.g. 512M, 2B)");
+    std::string enc_memory_limit_str;
+    enc->add_option("--memory-limit", enc_memory_limit_str,
+        "Size seed tables to fit this many bytes (k/M/G suffix: e.g. 512M, 4G)");
     bool enc_inplace = false;
     enc->add_flag("--inplace", enc_inplace, "Produce in-place delta");
     std::string enc_policy_str = "localmin";
     enc->add_option("--policy", enc_policy_str, "Cycle policy (localmin/constant)");
     bool enc_verbose = false;
     enc->add_flag("--verbose", enc_verbose, "Print diagnostics");
+    std::string enc_stats_json;
+    enc->add_option("--stats-json", enc_stats_json,
+        "Write per-phase wall/CPU times, counters and peak RSS as JSON");
+    bool enc_perf = false;
+    enc->add_flag("--perf", enc_perf,
+        "Count cycles, cache/TLB/branch misses per phase (perf_event_open)");
+    std::string enc_trace;
+    enc->add_option("--trace", enc_trace,
+        "Write a Chrome trace-event timeline of phases and worker tasks");
     bool enc_splay = false;
     enc->add_flag("--splay", enc_splay, "Use splay tree instead of hash table");
+    size_t enc_coarse_len = COARSE_SEED_LEN;
+    auto* enc_coarse_opt = enc->add_option("--coarse-len", enc_coarse_len,
+                    "Coarse seed length (hierarchical)");
+    bool enc_rematch = false;
+    enc->add_flag("--rematch", enc_rematch,
+                  "Re-match long adds against nearby reference bytes");
+    size_t enc_rematch_min = REMATCH_MIN_ADD;
+    auto* enc_rematch_min_opt = enc->add_option("--rematch-min", enc_rematch_min,
+                    "Minimum add length searched by --rematch");
+    size_t enc_rematch_seed = REMATCH_SEED_LEN;
+    auto* enc_rematch_seed_opt = enc->add_option("--rematch-seed", enc_rematch_seed,
+                    "Seed length used by --rematch");
+    bool enc_optimize = false;
+    enc->add_flag("--optimize", enc_optimize,
+                  "Merge and absorb commands to minimize encoded size");
+    std::string enc_reverse;
+    enc->add_option("--reverse", enc_reverse,
+        "Also write the version->reference delta, from the same matches");
+    std::string enc_shard;
+    enc->add_option("--shard", enc_shard,
+        "Encode only slice i of N of the version (i/N), for 'merge'");
+    bool enc_crc_cache = false;
+    enc->add_flag("--crc-cache", enc_crc_cache,
+        "Reuse the reference CRC cached for this file identity");
+    std::string enc_server;
+    enc->add_option("--server", enc_server,
+        "Send the request to a 'delta serve' socket (default tuning only)");
+    std::string enc_index;
+    enc->add_option("--index", enc_index,
+        "Persisted reference index (hierarchical; see 'index build')");
+    size_t enc_threads = 0;
+    enc->add_option("--threads", enc_threads,
+                    "Worker threads for post-passes (0 = all cores)");
+    double enc_time_budget = 0;
+    enc->add_option("--time-budget", enc_time_budget,
+        "Seconds allowed for differencing; degrade to cheaper matching to meet it");
+    int enc_effort = DEFAULT_EFFORT;
+    auto* enc_effort_opt = enc->add_option("--effort", enc_effort,
+        "Effort level 1 (fastest) to 9 (smallest), with algorithm 'auto'");
+
+    // ── bench subcommands ────────────────────────────────────────────
+    auto* bch = app.add_subcommand("bench", "Measure effort levels on a file pair");
+    std::string bch_ref, bch_ver;
+    bch->add_option("reference", bch_ref, "Reference file")->required();
+    bch->add_option("version", bch_ver, "Version file")->required();
+    std::string bch_levels = "1-9";
+    bch->add_option("--levels", bch_levels, "Effort levels (e.g. 1-9, 2,6,9)");
+    size_t bch_repeat = 3;
+    bch->add_option("--repeat", bch_repeat, "Timed runs per level (median reported)");
+
+    auto* bmx = app.add_subcommand("bench-matrix",
+        "Benchmark algorithms x flags over a corpus directory");
+    std::string bmx_corpus;
+    bmx->add_option("corpus", bmx_corpus,
+                    "Directory of NAME.ref/NAME.ver pairs (else successive files)")
+        ->required();
+    std::string bmx_algos = "onepass,correcting", bmx_splay = "off",
+        bmx_inplace = "off", bmx_policy = "localmin", bmx_seed_lens, bmx_max_tables;
+    bmx->add_option("--algorithms", bmx_algos, "Algorithms to run");
+    bmx->add_option("--splay", bmx_splay, "Splay settings (off,on)");
+    bmx->add_option("--inplace", bmx_inplace, "In-place settings (off,on)");
+    bmx->add_option("--policy", bmx_policy, "In-place cycle policies (localmin,constant)");
+    bmx->add_option("--seed-len", bmx_seed_lens, "Seed lengths (e.g. 16,32)");
+    bmx->add_option("--max-table", bmx_max_tables, "Table caps (e.g. 100k,1B)");
+    size_t bmx_repeat = 5;
+    bmx->add_option("--repeat", bmx_repeat, "Timed runs per configuration");
+    std::string bmx_csv, bmx_json;
+    bmx->add_option("--csv", bmx_csv, "Write results as CSV");
+    bmx->add_option("--json", bmx_json, "Write results as JSON");
+    bool bmx_in_process = false;
+    bmx->add_flag("--in-process", bmx_in_process,
+                  "Run in this process (peak RSS then covers all runs so far)");
+
+    auto* bcp = app.add_subcommand("bench-compare",
+        "Flag changes between two bench-matrix CSV files");
+    std::string bcp_base, bcp_cur;
+    bcp->add_option("baseline", bcp_base, "Baseline CSV")->required();
+    bcp->add_option("current", bcp_cur, "Current CSV")->required();
+    double bcp_threshold = 0.10, bcp_size_threshold = 0;
+    bcp->add_option("--threshold", bcp_threshold,
+                    "Relative noise threshold for times and RSS");
+    bcp->add_option("--size-threshold", bcp_size_threshold,
+                    "Relative threshold for delta sizes");
+
+    auto* ldt = app.add_subcommand("loadtest",
+        "Replay reference/delta pairs through decode concurrently");
+    std::string ldt_corpus;
+    ldt->add_option("corpus", ldt_corpus, "Directory of NAME.ref/NAME.delta pairs")
+        ->required();
+    std::string ldt_concurrency = "1", ldt_cache = "hot", ldt_reuse = "off";
+    ldt->add_option("--concurrency", ldt_concurrency, "Worker threads (e.g. 1,2,4,8)");
+    ldt->add_option("--cache", ldt_cache, "Page-cache states (memory,hot,cold)");
+    ldt->add_option("--reuse-buffers", ldt_reuse,
+                    "Per-worker output buffers instead of one per request (off,on)");
+    LoadOptions ldt_opts;
+    ldt->add_option("--rate", ldt_opts.rate, "Requests per second (0 = closed loop)");
+    ldt->add_option("--requests", ldt_opts.requests, "Requests per run (0 = no limit)");
+    ldt->add_option("--duration", ldt_opts.duration, "Seconds per run (0 = no limit)");
+    std::string ldt_csv;
+    ldt->add_option("--csv", ldt_csv, "Write results as CSV");
+
+    // ── gen subcommand ───────────────────────────────────────────────
+    auto* gen = app.add_subcommand("gen", "Generate a synthetic reference/version pair");
+    std::string gen_scenario, gen_ref, gen_ver;
+    gen->add_option("scenario", gen_scenario,
+                    "Scenario (transpose/edits/mutate/append/image/text)")->required();
+    gen->add_option("reference", gen_ref, "Reference output file")->required();
+    gen->add_option("version", gen_ver, "Version output file")->required();
+    std::string gen_size_str = "16M";
+    gen->add_option("--size", gen_size_str, "Reference size (k/M/G suffixes)");
+    SynthOptions gen_opts;
+    gen->add_option("--seed", gen_opts.seed, "Generator seed");
+    gen->add_option("--block-min", gen_opts.block_min, "Smallest block (bytes)");
+    gen->add_option("--block-max", gen_opts.block_max, "Largest block (bytes)");
+    gen->add_option("--rate", gen_opts.rate,
+                    "Fraction of blocks changed (append: growth fraction)");
+    gen->add_option("--threads", gen_opts.threads, "Worker threads (0 = all cores)");
+
+    // ── sketch / estimate subcommands ────────────────────────────────
+    auto* skc = app.add_subcommand("sketch", "Write a seed-set sketch of a file");
+    std::string skc_file, skc_out;
+    skc->add_option("file", skc_file, "Input file")->required();
+    skc->add_option("sketch_out", skc_out, "Output sketch file")->required();
+    size_t skc_seed_len = SEED_LEN;
+    skc->add_option("--seed-len", skc_seed_len, "Seed length");
+    size_t skc_size = SKETCH_SIZE;
+    skc->add_option("--size", skc_size, "Number of minima kept (k)");
+
+    auto* est = app.add_subcommand("estimate",
+        "Rank candidate references by predicted delta ratio");
+    std::string est_ver;
+    std::vector<std::string> est_cands;
+    est->add_option("version", est_ver, "Version file or sketch")->required();
+    est->add_option("candidates", est_cands,
+                    "Candidate reference files or sketches")->required();
+    size_t est_top = 0;
+    est->add_option("--top", est_top, "Show only the best N (0 = all)");
+    size_t est_seed_len = SEED_LEN;
+    est->add_option("--seed-len", est_seed_len,
+                    "Seed length for files sketched on the fly");
+    size_t est_size = SKETCH_SIZE;
+    est->add_option("--size", est_size,
+                    "Sketch size for files sketched on the fly");
+
+    // ── compose / apply-chain subcommands ────────────────────────────
+    auto* cmp = app.add_subcommand("compose",
+        "Compose a chain of deltas A->B, B->C, ... into one A->Z delta");
+    std::vector<std::string> cmp_deltas;
+    cmp->add_option("deltas", cmp_deltas, "Delta files, oldest first")->required();
+    std::string cmp_output;
+    cmp->add_option("-o,--output", cmp_output, "Output delta file")->required();
+
+    auto* chn = app.add_subcommand("apply-chain",
+        "Apply a chain of deltas in one pass, without intermediate versions");
+    std::string chn_ref, chn_output;
+    std::vector<std::string> chn_deltas;
+    chn->add_option("reference", chn_ref, "Reference file")->required();
+    chn->add_option("output", chn_output, "Output file")->required();
+    chn->add_option("deltas", chn_deltas, "Delta files, oldest first")->required();
+    bool chn_crc_cache = false;
+    chn->add_flag("--crc-cache", chn_crc_cache,
+        "Reuse the reference CRC cached for this file identity");
+
+    // ── merge subcommand ─────────────────────────────────────────────
+    auto* mrg = app.add_subcommand("merge", "Merge 'encode --shard' outputs into one delta");
+    std::vector<std::string> mrg_shards;
+    mrg->add_option("shards", mrg_shards, "Shard files, any order")->required();
+    std::string mrg_output;
+    mrg->add_option("-o,--output", mrg_output, "Output delta file")->required();
+    std::string mrg_seam;
+    mrg->add_option("--seam", mrg_seam,
+        "Reference file: re-match commands around each shard boundary");
+
+    // ── store subcommands ────────────────────────────────────────────
+    auto* sto = app.add_subcommand("store", "Versioned delta store (pack file)");
+    sto->require_subcommand(1);
+    auto* sto_add = sto->add_subcommand("add", "Append a version; prints its id");
+    std::string sto_add_pack, sto_add_file;
+    sto_add->add_option("store", sto_add_pack, "Pack file (created if missing)")->required();
+    sto_add->add_option("file", sto_add_file, "Version file")->required();
+    size_t sto_max_depth = STORE_MAX_DEPTH;
+    sto_add->add_option("--max-depth", sto_max_depth,
+        "Deltas allowed between snapshots");
+    double sto_max_chain_ratio = STORE_MAX_CHAIN_RATIO;
+    sto_add->add_option("--max-chain-ratio", sto_max_chain_ratio,
+        "Snapshot once chained delta bytes exceed this fraction of the version");
+
+    auto* sto_get = sto->add_subcommand("get", "Reconstruct a version");
+    std::string sto_get_pack, sto_get_output;
+    uint32_t sto_get_id = 0;
+    sto_get->add_option("store", sto_get_pack, "Pack file")->required();
+    sto_get->add_option("id", sto_get_id, "Version id")->required();
+    sto_get->add_option("output", sto_get_output, "Output file")->required();
+
+    auto* sto_prune = sto->add_subcommand("prune", "Drop old versions and compact");
+    std::string sto_prune_pack;
+    size_t sto_keep = 0;
+    sto_prune->add_option("store", sto_prune_pack, "Pack file")->required();
+    sto_prune->add_option("--keep", sto_keep, "Newest versions to keep")->required();
+
+    auto* sto_list = sto->add_subcommand("list", "List versions");
+    std::string sto_list_pack;
+    sto_list->add_option("store", sto_list_pack, "Pack file")->required();
+
+    // ── index subcommands ────────────────────────────────────────────
+    auto* idx = app.add_subcommand("index", "Persisted reference index for hierarchical");
+    idx->require_subcommand(1);
+    auto* idx_build = idx->add_subcommand("build", "Index a reference file");
+    std::string idx_build_ref, idx_build_out;
+    idx_build->add_option("reference", idx_build_ref, "Reference file")->required();
+    idx_build->add_option("index_out", idx_build_out, "Output index file")->required();
+    size_t idx_coarse_len = COARSE_SEED_LEN;
+    idx_build->add_option("--coarse-len", idx_coarse_len, "Coarse seed length");
+    std::string idx_max_table_str = std::to_string(MAX_TABLE_SIZE);
+    idx_build->add_option("--max-table", idx_max_table_str,
+        "Max hash table size (k/M/B suffix: e.g. 512M, 2B)");
+
+    auto* idx_update = idx->add_subcommand("update",
+        "Carry an index across a delta to the new reference");
+    std::string idx_update_in, idx_update_delta, idx_update_ref, idx_update_out;
+    idx_update->add_option("index", idx_update_in, "Index of the old reference")->required();
+    idx_update->add_option("delta_file", idx_update_delta, "Delta old -> new reference")->required();
+    idx_update->add_option("reference", idx_update_ref, "New reference file")->required();
+    idx_update->add_option("index_out", idx_update_out, "Output index file")->required();
+
+    // ── serve subcommand ─────────────────────────────────────────────
+    auto* srv = app.add_subcommand("serve",
+        "Serve encode/decode requests on a Unix socket, caching references");
+    std::string srv_socket;
+    srv->add_option("socket", srv_socket, "Socket path")->required();
+    std::string srv_cache_str = std::to_string(SERVER_CACHE_BYTES);
+    srv->add_option("--cache-size", srv_cache_str,
+        "Reference cache budget (k/M/B suffix: e.g. 512M, 4B)");
+    bool srv_stop = false;
+    srv->add_flag("--stop", srv_stop, "Ask the server on this socket to exit");
+    bool srv_verbose = false;
+    srv->add_flag("--verbose", srv_verbose, "Log each request to stderr");
 
     // ── decode subcommand ────────────────────────────────────────────
     auto* dec = app.add_subcommand("decode", "Reconstruct version from delta");
@@ -163,10 +552,40 @@ int main(int argc, char** argv) {
     dec->add_option("reference", dec_ref, "Reference file")->required();
     dec->add_option("delta_file", dec_delta, "Delta file")->required();
     dec->add_option("output", dec_output, "Output file")->required();
+    bool dec_crc_cache = false;
+    dec->add_flag("--crc-cache", dec_crc_cache,
+        "Reuse the reference CRC cached for this file identity");
+    std::string dec_server;
+    dec->add_option("--server", dec_server, "Send the request to a 'delta serve' socket");
+    std::string dec_stats_json;
+    dec->add_option("--stats-json", dec_stats_json,
+        "Write per-phase wall/CPU times, counters and peak RSS as JSON");
+    bool dec_perf = false;
+    dec->add_flag("--perf", dec_perf,
+        "Count cycles, cache/TLB/branch misses per phase (perf_event_open)");
+    std::string dec_trace;
+    dec->add_option("--trace", dec_trace,
+        "Write a Chrome trace-event timeline of phases and worker tasks");
     bool dec_ignore_hash = false;
     dec->add_flag("--ignore-hash", dec_ignore_hash,
                   "Skip hash verification (for partial recovery)");
 
+    // ── verify subcommand ────────────────────────────────────────────
+    auto* vfy = app.add_subcommand("verify",
+        "Check that deltas reconstruct their versions, without writing them");
+    std::string vfy_ref;
+    vfy->add_option("reference", vfy_ref, "Reference file");
+    std::vector<std::string> vfy_deltas;
+    vfy->add_option("deltas", vfy_deltas, "Delta files");
+    std::string vfy_list;
+    vfy->add_option("--list", vfy_list,
+        "File of 'REFERENCE DELTA' lines, one pair per line");
+    size_t vfy_threads = 0;
+    vfy->add_option("--threads", vfy_threads, "Worker threads (0 = all cores)");
+    std::string vfy_trace;
+    vfy->add_option("--trace", vfy_trace,
+        "Write a Chrome trace-event timeline of phases and worker tasks");
+
     // ── info subcommand ──────────────────────────────────────────────
     auto* inf = app.add_subcommand("info", "Show delta file statistics");
     std::string info_delta;
@@ -180,17 +599,78 @@ int main(int argc, char** argv) {
     inp->add_option("delta_out", inp_delta_out, "Output (in-place) delta file")->required();
     std::string inp_policy_str = "localmin";
     inp->add_option("--policy", inp_policy_str, "Cycle policy (localmin/constant)");
+    std::string inp_stats_json;
+    inp->add_option("--stats-json", inp_stats_json,
+        "Write per-phase wall/CPU times, counters and peak RSS as JSON");
+    bool inp_perf = false;
+    inp->add_flag("--perf", inp_perf,
+        "Count cycles, cache/TLB/branch misses per phase (perf_event_open)");
+    std::string inp_trace;
+    inp->add_option("--trace", inp_trace,
+        "Write a Chrome trace-event timeline of phases and worker tasks");
 
     CLI11_PARSE(app, argc, argv);
 
-    if (enc->parsed()) {
-        Algorithm algo;
-        if (enc_algo_str == "greedy") {
+    if (enc->parsed() && !enc_server.empty()) {
+        if (auto opt = unforwarded_option(enc, {"--server", "--inplace"}); !opt.empty()) {
+            std::fprintf(stderr, "error: %s cannot be used with --server "
+                "(only the algorithm and --inplace are forwarded)\n", opt.c_str());
+            return 1;
+        }
+        ServerRequest req;
+        req.op = ServerOp::Encode;
+        req.inplace = enc_inplace;
+        req.algorithm = enc_algo_str;
+        req.reference = enc_ref;
+        req.input = enc_ver;
+        req.output = enc_delta;
+        return call_server(enc_server, req);
+
+    } else if (dec->parsed() && !dec_server.empty()) {
+        if (auto opt = unforwarded_option(dec, {"--server"}); !opt.empty()) {
+            std::fprintf(stderr, "error: %s cannot be used with --server\n", opt.c_str());
+            return 1;
+        }
+        ServerRequest req;
+        req.op = ServerOp::Decode;
+        req.reference = dec_ref;
+        req.input = dec_delta;
+        req.output = dec_output;
+        return call_server(dec_server, req);
+
+    } else if (srv->parsed()) {
+        if (srv_stop) {
+            ServerRequest req;
+            req.op = ServerOp::Shutdown;
+            return call_server(srv_socket, req);
+        }
+        ServerOptions opts;
+        opts.cache_bytes = parse_size_suffix(srv_cache_str);
+        opts.verbose = srv_verbose;
+        serve(srv_socket, opts);
+
+    } else if (enc->parsed()) {
+        Algorithm algo = Algorithm::Onepass;
+        bool use_effort = (enc_algo_str == "auto");
+        if (use_effort) {
+            if (enc_effort < MIN_EFFORT || enc_effort > MAX_EFFORT) {
+                std::fprintf(stderr, "error: --effort must be in %d..%d\n",
+                    MIN_EFFORT, MAX_EFFORT);
+                return 1;
+            }
+        } else if (enc_effort_opt->count() > 0) {
+            std::fprintf(stderr, "error: --effort requires algorithm 'auto'\n");
+            return 1;
+        } else if (enc_algo_str == "greedy") {
             algo = Algorithm::Greedy;
         } else if (enc_algo_str == "onepass") {
             algo = Algorithm::Onepass;
         } else if (enc_algo_str == "correcting") {
             algo = Algorithm::Correcting;
+        } else if (enc_algo_str == "hierarchical") {
+            algo = Algorithm::Hierarchical;
+        } else if (enc_algo_str == "best") {
+            algo = Algorithm::Best;
         } else {
             std::fprintf(stderr, "Unknown algorithm: %s\n", enc_algo_str.c_str());
             return 1;
@@ -199,56 +679,182 @@ int main(int argc, char** argv) {
         CyclePolicy pol = CyclePolicy::Localmin;
         if (enc_policy_str == "constant") { pol = CyclePolicy::Constant; }
 
+        // Phases are timed back to back for --stats-json.
+        start_perf(enc_perf);
+        start_trace(enc_trace);
+        StatsReport report;
+        report.command = "encode";
+        PhaseTimer t_total, t_phase;
+        uint64_t trace_phase = trace_clock();
+        auto phase = [&](const char* name) {
+            report.phases.emplace_back(name, t_phase.elapsed());
+            trace_complete(name, "cli", trace_phase);
+            t_phase = PhaseTimer();
+            trace_phase = trace_clock();
+        };
+
         auto r_file = MappedFile::open_read(enc_ref);
         auto v_file = MappedFile::open_read(enc_ver);
         auto r = r_file.span();
         auto v = v_file.span();
+        phase("mmap");
 
         if (enc_seed_len == 0) {
             std::fprintf(stderr, "error: --seed-len must be >= 1\n");
             return 1;
         }
 
-        auto src_crc = crc64_xz(r.data(), r.size());
+        // A shard encodes one slice of V against all of R.
+        size_t shard_i = 0, shard_n = 0, v_offset = 0, v_total = v.size();
+        if (!enc_shard.empty()) {
+            if (std::sscanf(enc_shard.c_str(), "%zu/%zu", &shard_i, &shard_n) != 2
+                || shard_n == 0 || shard_i >= shard_n) {
+                std::fprintf(stderr, "error: --shard must be i/N with 0 <= i < N\n");
+                return 1;
+            }
+            if (enc_inplace || !enc_reverse.empty()) {
+                std::fprintf(stderr,
+                    "error: --shard cannot be combined with --inplace or --reverse\n");
+                return 1;
+            }
+            auto [begin, end] = shard_range(v.size(), shard_i, shard_n);
+            v_offset = begin;
+            v = v.subspan(begin, end - begin);
+        }
+
+        auto src_crc = reference_crc(r_file, enc_crc_cache);
         auto dst_crc = crc64_xz(v.data(), v.size());
+        phase("crc");
 
         auto t0 = std::chrono::steady_clock::now();
         DiffOptions opts;
-        opts.p = enc_seed_len;
-        opts.q = enc_table_size;
-        opts.max_table = parse_size_suffix(enc_max_table_str);
-        opts.verbose = enc_verbose;
-        opts.use_splay = enc_splay;
+        std::string algo_label = enc_algo_str;
+        if (use_effort) {
+            auto preset = effort_preset(enc_effort, r.size());
+            algo = preset.algo;
+            opts = preset.opts;
+            algo_label = "effort " + std::to_string(enc_effort)
+                + " (" + preset.description + ")";
+        }
+        // Explicit tuning flags override the effort preset.
+        if (!use_effort || enc_seed_opt->count() > 0) { opts.p = enc_seed_len; }
+        if (!use_effort || enc_table_opt->count() > 0) { opts.q = enc_table_size; }
+        if (!use_effort || enc_max_table_opt->count() > 0) {
+            opts.max_table = parse_size_suffix(enc_max_table_str);
+        }
+        if (!use_effort || enc_coarse_opt->count() > 0) { opts.coarse_p = enc_coarse_len; }
+        if (!use_effort || enc_rematch_min_opt->count() > 0) {
+            opts.rematch_min = enc_rematch_min;
+        }
+        if (!use_effort || enc_rematch_seed_opt->count() > 0) {
+            opts.rematch_p = enc_rematch_seed;
+        }
+        opts.use_splay = opts.use_splay || enc_splay;
+        opts.rematch = opts.rematch || enc_rematch;
+        opts.optimize = opts.optimize || enc_optimize;
+        DiffStats diff_stats;
+        opts.stats = &diff_stats;
+        opts.threads = enc_threads;
+        if (enc_time_budget < 0) {
+            std::fprintf(stderr, "error: --time-budget must be >= 0\n");
+            return 1;
+        }
+        opts.time_budget = enc_time_budget;
+        opts.memory_limit = parse_size_suffix(enc_memory_limit_str);
+        RefIndex ref_index;
+        if (!enc_index.empty()) {
+            if (algo != Algorithm::Hierarchical) {
+                std::fprintf(stderr, "error: --index requires algorithm 'hierarchical'\n");
+                return 1;
+            }
+            ref_index = decode_ref_index(read_file(enc_index));
+            if (ref_index.ref_crc != src_crc) {
+                std::fprintf(stderr,
+                    "error: %s indexes a different reference: expected %s, got %s\n",
+                    enc_index.c_str(), hex_str(ref_index.ref_crc).c_str(),
+                    hex_str(src_crc).c_str());
+                return 1;
+            }
+            opts.ref_index = &ref_index;
+            phase("index");
+        }
+        t_phase = PhaseTimer();
+        trace_phase = trace_clock();
         auto commands = diff(algo, r, v, opts);
+        if (enc_verbose) { print_diff_stats(diff_stats); }
+        report.phases.emplace_back("build", diff_stats.build);
+        report.phases.emplace_back("scan", diff_stats.scan);
+        report.phases.emplace_back("rematch", diff_stats.rematch);
+        report.phases.emplace_back("optimize", diff_stats.optimize);
+        t_phase = PhaseTimer();
+        trace_phase = trace_clock();
 
         std::vector<PlacedCommand> placed;
         if (enc_inplace) {
             placed = make_inplace(r, commands, pol);
+            phase("inplace");
         } else {
             placed = place_commands(commands);
+            phase("place");
         }
         auto t1 = std::chrono::steady_clock::now();
         double elapsed = std::chrono::duration<double>(t1 - t0).count();
 
         auto delta_bytes = encode_delta(placed, enc_inplace, v.size(), src_crc, dst_crc);
+        if (!enc_shard.empty()) {
+            delta_bytes = encode_shard({static_cast<uint32_t>(shard_i),
+                                        static_cast<uint32_t>(shard_n),
+                                        v_offset, v_total, std::move(delta_bytes)});
+        }
+        phase("encode");
         write_file(enc_delta, delta_bytes);
+        phase("write");
+
+        // The reverse delta reuses the forward matches.  R bytes the
+        // forward copies skipped are re-matched locally against V, which
+        // stands in for a second full index; post-passes run with the
+        // roles of R and V swapped.
+        std::vector<uint8_t> reverse_bytes;
+        if (!enc_reverse.empty()) {
+            DiffOptions rev_opts = opts;
+            rev_opts.stats = nullptr;
+            auto rev = rematch_adds(v, reverse_commands(r, commands), rev_opts);
+            if (opts.optimize) { rev = optimize_commands(v, std::move(rev)); }
+            auto rev_placed = enc_inplace ? make_inplace(v, rev, pol)
+                                          : place_commands(rev);
+            reverse_bytes = encode_delta(rev_placed, enc_inplace, r.size(),
+                                         dst_crc, src_crc);
+            write_file(enc_reverse, reverse_bytes);
+            phase("reverse");
+            t1 = std::chrono::steady_clock::now();
+            elapsed = std::chrono::duration<double>(t1 - t0).count();
+        }
 
         auto stats = placed_summary(placed);
         double ratio = v.empty() ? 0.0
             : static_cast<double>(delta_bytes.size()) / v.size();
 
         if (enc_inplace) {
-            std::printf("Algorithm:    %s%s + in-place (%s)\n",
-                enc_algo_str.c_str(), enc_splay ? " [splay]" : "",
-                enc_policy_str.c_str());
+            std::printf("Algorithm:    %s%s%s + in-place (%s)\n",
+                algo_label.c_str(), enc_splay ? " [splay]" : "",
+                enc_rematch ? " + rematch" : "", enc_policy_str.c_str());
         } else {
-            std::printf("Algorithm:    %s%s\n",
-                enc_algo_str.c_str(), enc_splay ? " [splay]" : "");
+            std::printf("Algorithm:    %s%s%s\n",
+                algo_label.c_str(), enc_splay ? " [splay]" : "",
+                enc_rematch ? " + rematch" : "");
         }
         std::printf("Reference:    %s (%zu bytes)\n", enc_ref.c_str(), r.size());
         std::printf("Version:      %s (%zu bytes)\n", enc_ver.c_str(), v.size());
+        if (!enc_shard.empty()) {
+            std::printf("Shard:        %zu/%zu (bytes %zu-%zu of %zu)\n", shard_i, shard_n,
+                v_offset, v_offset + v.size(), v_total);
+        }
         std::printf("Delta:        %s (%zu bytes)\n", enc_delta.c_str(), delta_bytes.size());
         std::printf("Compression:  %.4f (delta/version)\n", ratio);
+        if (!enc_reverse.empty()) {
+            std::printf("Reverse:      %s (%zu bytes)\n",
+                enc_reverse.c_str(), reverse_bytes.size());
+        }
         std::printf("Commands:     %zu copies, %zu adds\n", stats.num_copies, stats.num_adds);
         std::printf("Copy bytes:   %zu\n", stats.copy_bytes);
         std::printf("Add bytes:    %zu\n", stats.add_bytes);
@@ -256,15 +862,562 @@ int main(int argc, char** argv) {
         std::printf("Dst CRC:      %s\n", hex_str(dst_crc).c_str());
         std::printf("Time:         %.3fs\n", elapsed);
 
+        report.labels = {{"algorithm", algo_label}, {"reference", enc_ref},
+                         {"version", enc_ver}, {"delta", enc_delta}};
+        report.counts = {{"r_size", r.size()}, {"v_size", v.size()},
+                         {"delta_bytes", delta_bytes.size()},
+                         {"reverse_bytes", reverse_bytes.size()},
+                         {"copies", stats.num_copies}, {"adds", stats.num_adds},
+                         {"copy_bytes", stats.copy_bytes}, {"add_bytes", stats.add_bytes}};
+        report.diff = &diff_stats;
+        report.total = t_total.elapsed();
+        if (enc_perf) { print_phases(report); }
+        write_stats_json(enc_stats_json, report);
+        write_trace(enc_trace);
+
+    } else if (bch->parsed()) {
+        auto levels = parse_levels(bch_levels);
+        if (levels.empty() || bch_repeat == 0) {
+            std::fprintf(stderr, "error: bad --levels or --repeat\n");
+            return 1;
+        }
+
+        auto r_file = MappedFile::open_read(bch_ref);
+        auto v_file = MappedFile::open_read(bch_ver);
+        auto r = r_file.span();
+        auto v = v_file.span();
+        auto src_crc = crc64_xz(r.data(), r.size());
+        auto dst_crc = crc64_xz(v.data(), v.size());
+
+        std::printf("Reference:    %s (%zu bytes)\n", bch_ref.c_str(), r.size());
+        std::printf("Version:      %s (%zu bytes)\n", bch_ver.c_str(), v.size());
+        std::printf("%-6s %9s %9s %12s %8s  %s\n",
+            "Level", "Time(s)", "MB/s", "Delta", "Ratio", "Strategy");
+
+        for (int level : levels) {
+            auto preset = effort_preset(level, r.size());
+            std::vector<double> times;
+            std::vector<PlacedCommand> placed;
+            size_t delta_size = 0;
+            for (size_t i = 0; i < bch_repeat; ++i) {
+                auto t0 = std::chrono::steady_clock::now();
+                auto commands = diff(preset.algo, r, v, preset.opts);
+                placed = place_commands(commands);
+                delta_size = encode_delta(placed, false, v.size(),
+                                          src_crc, dst_crc).size();
+                auto t1 = std::chrono::steady_clock::now();
+                times.push_back(std::chrono::duration<double>(t1 - t0).count());
+            }
+
+            // Every level must reconstruct V exactly.
+            std::vector<uint8_t> out(v.size(), 0);
+            apply_placed_to(r, placed, out);
+            if (!std::equal(out.begin(), out.end(), v.begin(), v.end())) {
+                std::fprintf(stderr, "error: effort %d failed to roundtrip\n", level);
+                return 1;
+            }
+
+            std::sort(times.begin(), times.end());
+            double median = times[times.size() / 2];
+            double mbps = median > 0 ? v.size() / median / 1e6 : 0.0;
+            double ratio = v.empty() ? 0.0
+                : static_cast<double>(delta_size) / v.size();
+            std::printf("%-6d %9.3f %9.1f %12zu %8.4f  %s\n",
+                level, median, mbps, delta_size, ratio, preset.description);
+        }
+
+    } else if (bmx->parsed()) {
+        BenchAxes axes;
+        std::vector<BenchPair> corpus;
+        auto on_off = [](const std::string& list) {
+            std::vector<bool> out;
+            for (const auto& item : split_list(list)) {
+                if (item != "on" && item != "off") {
+                    throw DeltaError("expected on/off, got '" + item + "'");
+                }
+                out.push_back(item == "on");
+            }
+            return out;
+        };
+        try {
+            axes.algorithms.clear();
+            for (const auto& a : split_list(bmx_algos)) {
+                axes.algorithms.push_back(algorithm_from_name(a));
+            }
+            axes.splay = on_off(bmx_splay);
+            axes.inplace = on_off(bmx_inplace);
+            axes.policies.clear();
+            for (const auto& pol : split_list(bmx_policy)) {
+                if (pol != "localmin" && pol != "constant") {
+                    throw DeltaError("unknown policy '" + pol + "'");
+                }
+                axes.policies.push_back(pol == "constant" ? CyclePolicy::Constant
+                                                          : CyclePolicy::Localmin);
+            }
+            if (!bmx_seed_lens.empty()) {
+                axes.seed_lens.clear();
+                for (const auto& p : split_list(bmx_seed_lens)) {
+                    axes.seed_lens.push_back(parse_size_suffix(p));
+                }
+            }
+            if (!bmx_max_tables.empty()) {
+                axes.max_tables.clear();
+                for (const auto& t : split_list(bmx_max_tables)) {
+                    axes.max_tables.push_back(parse_size_suffix(t));
+                }
+            }
+            corpus = bench_corpus(bmx_corpus);
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "error: %s\n", e.what());
+            return 1;
+        }
+        auto configs = bench_matrix(axes);
+        if (configs.empty() || bmx_repeat == 0) {
+            std::fprintf(stderr, "error: empty matrix or --repeat 0\n");
+            return 1;
+        }
+
+        std::printf("%-24s %-44s %9s %9s %9s %8s %9s %s\n", "Pair", "Config",
+            "Median(s)", "P95(s)", "MB/s", "Ratio", "RSS(MB)", "");
+        std::vector<BenchResult> results;
+        bool all_ok = true;
+        for (const auto& pair : corpus) {
+            for (const auto& config : configs) {
+                BenchResult res;
+                if (bmx_in_process) {
+                    auto r_file = MappedFile::open_read(pair.reference);
+                    auto v_file = MappedFile::open_read(pair.version);
+                    res = bench_run(r_file.span(), v_file.span(), config, bmx_repeat);
+                    res.pair = pair.name;
+                } else {
+                    res = bench_run_isolated(pair, config, bmx_repeat);
+                }
+                std::printf("%-24s %-44s %9.3f %9.3f %9.1f %8.4f %9.1f %s\n",
+                    res.pair.c_str(), res.config.c_str(), res.encode_median,
+                    res.encode_p95, res.mbps(), res.ratio(), res.peak_rss / 1e6,
+                    res.ok ? "" : "FAILED");
+                std::fflush(stdout);
+                all_ok = all_ok && res.ok;
+                results.push_back(std::move(res));
+            }
+        }
+        if (!bmx_csv.empty()) {
+            auto csv = bench_csv(results);
+            write_file(bmx_csv, {reinterpret_cast<const uint8_t*>(csv.data()), csv.size()});
+        }
+        if (!bmx_json.empty()) {
+            auto json = bench_json(results);
+            write_file(bmx_json, {reinterpret_cast<const uint8_t*>(json.data()), json.size()});
+        }
+        if (!all_ok) { return 1; }
+
+    } else if (bcp->parsed()) {
+        std::vector<BenchChange> changes;
+        try {
+            auto load = [](const std::string& path) {
+                auto bytes = read_file(path);
+                return parse_bench_csv(std::string(bytes.begin(), bytes.end()));
+            };
+            changes = bench_compare(load(bcp_base), load(bcp_cur),
+                                    bcp_threshold, bcp_size_threshold);
+        } catch (const DeltaError& e) {
+            std::fprintf(stderr, "error: %s\n", e.what());
+            return 1;
+        }
+        size_t regressions = 0;
+        for (const auto& c : changes) {
+            double pct = c.before != 0 ? (c.after - c.before) / c.before * 100 : 0.0;
+            std::printf("%-11s %-24s %-44s %-14s %14.6g -> %-14.6g %+7.1f%%\n",
+                c.regression ? "REGRESSION" : "improvement", c.pair.c_str(),
+                c.config.c_str(), c.metric.c_str(), c.before, c.after, pct);
+            regressions += c.regression;
+        }
+        std::printf("%zu regressions, %zu improvements (threshold %.0f%%)\n",
+            regressions, changes.size() - regressions, bcp_threshold * 100);
+        if (regressions > 0) { return 1; }
+
+    } else if (ldt->parsed()) {
+        std::vector<LoadPair> corpus;
+        std::vector<size_t> concurrency;
+        std::vector<LoadCache> caches;
+        std::vector<bool> reuse;
+        try {
+            for (const auto& c : split_list(ldt_concurrency)) {
+                concurrency.push_back(parse_size_suffix(c));
+            }
+            for (const auto& c : split_list(ldt_cache)) {
+                caches.push_back(load_cache_from_name(c));
+            }
+            for (const auto& item : split_list(ldt_reuse)) {
+                if (item != "on" && item != "off") {
+                    throw DeltaError("expected on/off, got '" + item + "'");
+                }
+                reuse.push_back(item == "on");
+            }
+            corpus = load_corpus(ldt_corpus);
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "error: %s\n", e.what());
+            return 1;
+        }
+
+        std::printf("%5s %-6s %-5s %7s %5s %8s %8s %8s %8s %8s %8s  %-29s %8s %7s %8s\n",
+            "Conc", "Cache", "Reuse", "Reqs", "Err", "Req/s", "MB/s", "p50(ms)",
+            "p99(ms)", "p999(ms)", "max(ms)", "read/parse/alloc/apply/verify%",
+            "minflt", "majflt", "ctxsw");
+        std::vector<LoadResult> results;
+        bool all_ok = true;
+        for (auto cache : caches) {
+            for (bool r : reuse) {
+                for (size_t c : concurrency) {
+                    auto opts = ldt_opts;
+                    opts.cache = cache;
+                    opts.reuse_buffers = r;
+                    opts.concurrency = c;
+                    LoadResult res;
+                    try {
+                        res = load_run(corpus, opts);
+                    } catch (const DeltaError& e) {
+                        std::fprintf(stderr, "error: %s\n", e.what());
+                        return 1;
+                    }
+                    double busy = 0;
+                    for (double t : res.phase_seconds) { busy += t; }
+                    std::string shares;
+                    for (double t : res.phase_seconds) {
+                        if (!shares.empty()) { shares += '/'; }
+                        shares += std::to_string(
+                            static_cast<int>(std::lround(busy > 0 ? t / busy * 100 : 0)));
+                    }
+                    std::printf("%5zu %-6s %-5s %7zu %5zu %8.1f %8.1f %8.3f %8.3f %8.3f "
+                                "%8.3f  %-29s %8zu %7zu %8zu\n",
+                        res.concurrency, res.cache.c_str(), r ? "on" : "off",
+                        res.requests, res.errors, res.throughput(), res.mbps(),
+                        res.p50 * 1e3, res.p99 * 1e3, res.p999 * 1e3, res.max * 1e3,
+                        shares.c_str(), res.minor_faults, res.major_faults,
+                        res.voluntary_switches + res.involuntary_switches);
+                    std::fflush(stdout);
+                    if (res.errors) {
+                        std::fprintf(stderr, "error: %s\n", res.first_error.c_str());
+                        all_ok = false;
+                    }
+                    results.push_back(std::move(res));
+                }
+            }
+        }
+        if (!ldt_csv.empty()) {
+            auto csv = load_csv(results);
+            write_file(ldt_csv, {reinterpret_cast<const uint8_t*>(csv.data()), csv.size()});
+        }
+        if (!all_ok) { return 1; }
+
+    } else if (gen->parsed()) {
+        SynthPlan plan;
+        try {
+            gen_opts.scenario = synth_scenario(gen_scenario);
+            gen_opts.size = parse_size_suffix(gen_size_str);
+            plan = synth_plan(gen_opts);
+        } catch (const DeltaError& e) {
+            std::fprintf(stderr, "error: %s\n", e.what());
+            return 1;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        {
+            auto r_file = MappedFile::create(gen_ref, plan.ref_size);
+            auto v_file = MappedFile::create(gen_ver, plan.version_size);
+            synth_generate(plan, r_file.writable(), v_file.writable());
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double secs = std::chrono::duration<double>(t1 - t0).count();
+
+        std::printf("Scenario:     %s (seed %llu)\n", gen_scenario.c_str(),
+            static_cast<unsigned long long>(gen_opts.seed));
+        std::printf("Reference:    %s (%llu bytes)\n", gen_ref.c_str(),
+            static_cast<unsigned long long>(plan.ref_size));
+        std::printf("Version:      %s (%llu bytes)\n", gen_ver.c_str(),
+            static_cast<unsigned long long>(plan.version_size));
+        std::printf("Changed:      %zu blocks, %zu segments\n",
+            plan.blocks_changed, plan.segments.size());
+        std::printf("Time:         %.3fs (%.1f MB/s)\n", secs,
+            secs > 0 ? (plan.ref_size + plan.version_size) / secs / 1e6 : 0.0);
+
+    } else if (skc->parsed()) {
+        auto f = MappedFile::open_read(skc_file);
+        auto t0 = std::chrono::steady_clock::now();
+        auto sk = make_sketch(f.span(), skc_seed_len, skc_size);
+        auto t1 = std::chrono::steady_clock::now();
+        auto bytes = encode_sketch(sk);
+        write_file(skc_out, bytes);
+
+        std::printf("File:         %s (%zu bytes)\n", skc_file.c_str(), f.size());
+        std::printf("Sketch:       %s (%zu bytes, k=%zu, seed_len=%zu)\n",
+            skc_out.c_str(), bytes.size(), sk.k, sk.seed_len);
+        std::printf("Distinct:     ~%.0f seeds\n", sketch_distinct(sk));
+        std::printf("Time:         %.3fs\n",
+            std::chrono::duration<double>(t1 - t0).count());
+
+    } else if (est->parsed()) {
+        // Files that are not sketches are sketched on the fly, with the
+        // version sketch's parameters when the version is a sketch.
+        auto load = [](const std::string& path, size_t p, size_t k) {
+            auto f = MappedFile::open_read(path);
+            return is_sketch(f.span()) ? decode_sketch(f.span())
+                                       : make_sketch(f.span(), p, k);
+        };
+        auto t0 = std::chrono::steady_clock::now();
+        auto v_sk = load(est_ver, est_seed_len, est_size);
+        std::vector<Sketch> cands;
+        cands.reserve(est_cands.size());
+        for (const auto& c : est_cands) {
+            cands.push_back(load(c, v_sk.seed_len, v_sk.k));
+        }
+        auto t1 = std::chrono::steady_clock::now();
+
+        struct Ranked { size_t idx; double ratio; double jaccard; };
+        std::vector<Ranked> ranked;
+        ranked.reserve(cands.size());
+        for (size_t i = 0; i < cands.size(); ++i) {
+            ranked.push_back({i, predicted_ratio(v_sk, cands[i]),
+                              sketch_jaccard(v_sk, cands[i])});
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+            [](const Ranked& a, const Ranked& b) { return a.ratio < b.ratio; });
+        auto t2 = std::chrono::steady_clock::now();
+
+        std::printf("Version:      %s (%llu bytes, ~%.0f distinct seeds)\n",
+            est_ver.c_str(), (unsigned long long)v_sk.file_size,
+            sketch_distinct(v_sk));
+        std::printf("%-5s %10s %8s  %s\n", "Rank", "Predicted", "Jaccard",
+            "Reference");
+        size_t shown = (est_top > 0) ? std::min(est_top, ranked.size())
+                                     : ranked.size();
+        for (size_t i = 0; i < shown; ++i) {
+            const auto& e = ranked[i];
+            std::printf("%-5zu %10.4f %8.4f  %s (%llu bytes)\n",
+                i + 1, e.ratio, e.jaccard, est_cands[e.idx].c_str(),
+                (unsigned long long)cands[e.idx].file_size);
+        }
+        std::printf("Load:         %.3fs\n",
+            std::chrono::duration<double>(t1 - t0).count());
+        std::printf("Rank:         %.3fms for %zu candidates\n",
+            std::chrono::duration<double, std::milli>(t2 - t1).count(),
+            cands.size());
+
+    } else if (cmp->parsed() || chn->parsed()) {
+        // Fold the chain left to right; each link's source CRC must be the
+        // previous link's destination CRC.
+        const auto& paths = cmp->parsed() ? cmp_deltas : chn_deltas;
+        auto t0 = std::chrono::steady_clock::now();
+        auto first_bytes = read_file(paths[0]);
+        auto [placed, first_ip, version_size, src_crc, dst_crc] =
+            decode_delta(first_bytes);
+        for (size_t i = 1; i < paths.size(); ++i) {
+            auto bytes = read_file(paths[i]);
+            auto [next, ip, next_size, next_src, next_dst] = decode_delta(bytes);
+            if (next_src != dst_crc) {
+                std::fprintf(stderr,
+                    "error: %s does not apply to the output of %s "
+                    "(source CRC %s, expected %s)\n",
+                    paths[i].c_str(), paths[i - 1].c_str(),
+                    hex_str(next_src).c_str(), hex_str(dst_crc).c_str());
+                return 1;
+            }
+            placed = compose_deltas(placed, version_size, next);
+            version_size = next_size;
+            dst_crc = next_dst;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        auto stats = placed_summary(placed);
+
+        if (cmp->parsed()) {
+            auto out = encode_delta(placed, false, version_size, src_crc, dst_crc);
+            write_file(cmp_output, out);
+            std::printf("Chain:        %zu deltas\n", paths.size());
+            std::printf("Output delta: %s (%zu bytes)\n", cmp_output.c_str(), out.size());
+        } else {
+            auto r_file = MappedFile::open_read(chn_ref);
+            auto r = r_file.span();
+            auto r_crc = reference_crc(r_file, chn_crc_cache);
+            if (r_crc != src_crc) {
+                std::fprintf(stderr,
+                    "source file does not match delta: expected %s, got %s\n",
+                    hex_str(src_crc).c_str(), hex_str(r_crc).c_str());
+                return 1;
+            }
+            std::vector<uint8_t> out(version_size, 0);
+            apply_placed_to(r, placed, out);
+            if (crc64_xz(out.data(), out.size()) != dst_crc) {
+                std::fprintf(stderr, "output integrity check failed\n");
+                return 1;
+            }
+            write_file(chn_output, out);
+            t1 = std::chrono::steady_clock::now();
+            std::printf("Chain:        %zu deltas\n", paths.size());
+            std::printf("Reference:    %s (%zu bytes)\n", chn_ref.c_str(), r.size());
+            std::printf("Output:       %s (%zu bytes)\n", chn_output.c_str(), out.size());
+            std::printf("Dst CRC:      %s  OK\n", hex_str(dst_crc).c_str());
+        }
+        std::printf("Commands:     %zu copies, %zu adds\n",
+            stats.num_copies, stats.num_adds);
+        std::printf("Copy bytes:   %zu\n", stats.copy_bytes);
+        std::printf("Add bytes:    %zu\n", stats.add_bytes);
+        std::printf("Time:         %.3fs\n",
+            std::chrono::duration<double>(t1 - t0).count());
+
+    } else if (mrg->parsed()) {
+        std::vector<DeltaShard> shards;
+        for (const auto& path : mrg_shards) {
+            shards.push_back(decode_shard(read_file(path)));
+        }
+        std::optional<MappedFile> r_file;
+        std::span<const uint8_t> r;
+        if (!mrg_seam.empty()) {
+            r_file = MappedFile::open_read(mrg_seam);
+            r = r_file->span();
+            auto [cmds, ip, size, src_crc, dst_crc] = decode_delta(shards.front().delta);
+            auto r_crc = crc64_xz(r.data(), r.size());
+            if (r_crc != src_crc) {
+                std::fprintf(stderr,
+                    "source file does not match delta: expected %s, got %s\n",
+                    hex_str(src_crc).c_str(), hex_str(r_crc).c_str());
+                return 1;
+            }
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        auto out = merge_shards(std::move(shards), r);
+        auto t1 = std::chrono::steady_clock::now();
+        write_file(mrg_output, out);
+        auto [placed, ip, version_size, src_crc, dst_crc] = decode_delta(out);
+        auto stats = placed_summary(placed);
+        std::printf("Shards:       %zu%s\n", mrg_shards.size(),
+            mrg_seam.empty() ? "" : " (seam pass)");
+        std::printf("Output delta: %s (%zu bytes)\n", mrg_output.c_str(), out.size());
+        std::printf("Version size: %zu bytes\n", version_size);
+        std::printf("Commands:     %zu copies, %zu adds\n", stats.num_copies, stats.num_adds);
+        std::printf("Dst CRC:      %s\n", hex_str(dst_crc).c_str());
+        std::printf("Time:         %.3fs\n",
+            std::chrono::duration<double>(t1 - t0).count());
+
+    } else if (sto_add->parsed()) {
+        auto store = DeltaStore::open(sto_add_pack);
+        auto v = read_file(sto_add_file);
+        StoreOptions opts;
+        opts.max_depth = sto_max_depth;
+        opts.max_chain_ratio = sto_max_chain_ratio;
+        auto t0 = std::chrono::steady_clock::now();
+        auto id = store.add(v, opts);
+        auto t1 = std::chrono::steady_clock::now();
+        const auto& e = store.entries()[id];
+        std::printf("Version:      %u (%s, depth %u)\n", id,
+            e.kind == StoreKind::Snapshot ? "snapshot" : "delta", e.depth);
+        std::printf("Stored:       %llu of %llu bytes\n",
+            (unsigned long long)e.length, (unsigned long long)e.version_size);
+        std::printf("Time:         %.3fs\n",
+            std::chrono::duration<double>(t1 - t0).count());
+
+    } else if (sto_get->parsed()) {
+        auto store = DeltaStore::open(sto_get_pack);
+        auto t0 = std::chrono::steady_clock::now();
+        auto out = store.get(sto_get_id);
+        auto t1 = std::chrono::steady_clock::now();
+        write_file(sto_get_output, out);
+        std::printf("Version:      %u (%zu bytes, depth %u)\n", sto_get_id,
+            out.size(), store.entries()[sto_get_id].depth);
+        std::printf("Time:         %.3fs\n",
+            std::chrono::duration<double>(t1 - t0).count());
+
+    } else if (sto_prune->parsed()) {
+        auto store = DeltaStore::open(sto_prune_pack);
+        auto before = std::filesystem::file_size(sto_prune_pack);
+        store.prune(sto_keep);
+        auto after = std::filesystem::file_size(sto_prune_pack);
+        std::printf("Pack:         %llu -> %llu bytes\n",
+            (unsigned long long)before, (unsigned long long)after);
+
+    } else if (sto_list->parsed()) {
+        auto store = DeltaStore::open(sto_list_pack);
+        std::printf("%-6s %-9s %6s %12s %12s  %s\n",
+            "Id", "Kind", "Depth", "Size", "Stored", "CRC");
+        const auto& entries = store.entries();
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const auto& e = entries[i];
+            const char* kind = e.kind == StoreKind::Snapshot ? "snapshot"
+                             : e.kind == StoreKind::Delta ? "delta" : "pruned";
+            std::printf("%-6zu %-9s %6u %12llu %12llu  %s\n", i, kind, e.depth,
+                (unsigned long long)e.version_size, (unsigned long long)e.length,
+                hex_str(e.crc).c_str());
+        }
+
+    } else if (idx_build->parsed()) {
+        auto r_file = MappedFile::open_read(idx_build_ref);
+        DiffOptions opts;
+        opts.coarse_p = idx_coarse_len;
+        opts.max_table = parse_size_suffix(idx_max_table_str);
+        auto t0 = std::chrono::steady_clock::now();
+        auto index = build_ref_index(r_file.span(), opts);
+        auto t1 = std::chrono::steady_clock::now();
+        auto bytes = encode_ref_index(index);
+        write_file(idx_build_out, bytes);
+        std::printf("Reference:    %s (%zu bytes)\n", idx_build_ref.c_str(), r_file.size());
+        std::printf("Index:        %s (%zu bytes, %zu seeds, seed_len=%zu stride=%zu)\n",
+            idx_build_out.c_str(), bytes.size(), index.seeds.size(),
+            index.seed_len, index.stride);
+        std::printf("Time:         %.3fs\n",
+            std::chrono::duration<double>(t1 - t0).count());
+
+    } else if (idx_update->parsed()) {
+        auto old_index = decode_ref_index(read_file(idx_update_in));
+        auto delta_bytes = read_file(idx_update_delta);
+        auto [placed, ip, version_size, src_crc, dst_crc] = decode_delta(delta_bytes);
+        if (src_crc != old_index.ref_crc) {
+            std::fprintf(stderr,
+                "error: %s does not start from the indexed reference: expected %s, got %s\n",
+                idx_update_delta.c_str(), hex_str(old_index.ref_crc).c_str(),
+                hex_str(src_crc).c_str());
+            return 1;
+        }
+        auto r_file = MappedFile::open_read(idx_update_ref);
+        if (r_file.size() != version_size) {
+            std::fprintf(stderr, "error: %s is %zu bytes, delta produces %zu\n",
+                idx_update_ref.c_str(), r_file.size(), version_size);
+            return 1;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        auto index = update_ref_index(old_index, placed, r_file.span(), dst_crc);
+        auto t1 = std::chrono::steady_clock::now();
+        auto bytes = encode_ref_index(index);
+        write_file(idx_update_out, bytes);
+        std::printf("Reference:    %s (%zu bytes)\n", idx_update_ref.c_str(), r_file.size());
+        std::printf("Index:        %s (%zu bytes, %zu seeds)\n",
+            idx_update_out.c_str(), bytes.size(), index.seeds.size());
+        std::printf("Time:         %.3fs\n",
+            std::chrono::duration<double>(t1 - t0).count());
+
     } else if (dec->parsed()) {
+        start_perf(dec_perf);
+        start_trace(dec_trace);
+        StatsReport report;
+        report.command = "decode";
+        PhaseTimer t_total, t_phase;
+        uint64_t trace_phase = trace_clock();
+        auto phase = [&](const char* name) {
+            report.phases.emplace_back(name, t_phase.elapsed());
+            trace_complete(name, "cli", trace_phase);
+            t_phase = PhaseTimer();
+            trace_phase = trace_clock();
+        };
+
         auto r_file = MappedFile::open_read(dec_ref);
         auto r = r_file.span();
         auto delta_bytes = read_file(dec_delta);
+        phase("mmap");
 
         auto [placed, is_ip, version_size, src_crc, dst_crc] = decode_delta(delta_bytes);
+        phase("decode");
 
         // Pre-check: verify reference file matches the embedded source CRC.
-        auto r_crc = crc64_xz(r.data(), r.size());
+        bool crc_hit = false;
+        auto r_crc = reference_crc(r_file, dec_crc_cache, &crc_hit);
+        phase("crc");
         if (r_crc != src_crc) {
             if (!dec_ignore_hash) {
                 std::fprintf(stderr,
@@ -285,9 +1438,11 @@ int main(int argc, char** argv) {
         }
         auto t1 = std::chrono::steady_clock::now();
         double elapsed = std::chrono::duration<double>(t1 - t0).count();
+        phase("apply");
 
         // Post-check: verify reconstructed output matches the embedded dest CRC.
         auto out_crc = crc64_xz(out_bytes.data(), out_bytes.size());
+        phase("verify");
         if (out_crc != dst_crc) {
             if (!dec_ignore_hash) {
                 std::fprintf(stderr, "output integrity check failed\n");
@@ -297,6 +1452,7 @@ int main(int argc, char** argv) {
         }
 
         write_file(dec_output, out_bytes);
+        phase("write");
 
         const char* fmt = is_ip ? "in-place" : "standard";
         std::printf("Format:       %s\n", fmt);
@@ -304,11 +1460,104 @@ int main(int argc, char** argv) {
         std::printf("Delta:        %s (%zu bytes)\n", dec_delta.c_str(), delta_bytes.size());
         std::printf("Output:       %s (%zu bytes)\n", dec_output.c_str(), version_size);
         if (!dec_ignore_hash) {
-            std::printf("Src CRC:      %s  OK\n", hex_str(src_crc).c_str());
+            std::printf("Src CRC:      %s  OK%s\n", hex_str(src_crc).c_str(),
+                crc_hit ? " (cached)" : "");
             std::printf("Dst CRC:      %s  OK\n", hex_str(dst_crc).c_str());
         }
         std::printf("Time:         %.3fs\n", elapsed);
 
+        auto summary = placed_summary(placed);
+        report.labels = {{"format", fmt}, {"reference", dec_ref},
+                         {"delta", dec_delta}, {"output", dec_output}};
+        report.counts = {{"r_size", r.size()}, {"delta_bytes", delta_bytes.size()},
+                         {"version_size", version_size},
+                         {"copies", summary.num_copies}, {"adds", summary.num_adds},
+                         {"copy_bytes", summary.copy_bytes}, {"add_bytes", summary.add_bytes},
+                         {"crc_cached", crc_hit}};
+        report.total = t_total.elapsed();
+        if (dec_perf) { print_phases(report); }
+        write_stats_json(dec_stats_json, report);
+        write_trace(dec_trace);
+
+    } else if (vfy->parsed()) {
+        std::vector<std::pair<std::string, std::string>> jobs; // (reference, delta)
+        for (const auto& d : vfy_deltas) { jobs.emplace_back(vfy_ref, d); }
+        if (!vfy_list.empty()) {
+            std::ifstream f(vfy_list);
+            if (!f) {
+                std::fprintf(stderr, "Error reading %s\n", vfy_list.c_str());
+                return 1;
+            }
+            std::string ref, d;
+            while (f >> ref >> d) { jobs.emplace_back(ref, d); }
+        }
+        if (jobs.empty() || (!vfy_deltas.empty() && vfy_ref.empty())) {
+            std::fprintf(stderr, "verify: give REFERENCE DELTA... and/or --list FILE\n");
+            return 1;
+        }
+
+        // Each distinct reference is mapped and hashed once.
+        std::vector<std::string> refs;
+        for (const auto& [ref, d] : jobs) { refs.push_back(ref); }
+        std::sort(refs.begin(), refs.end());
+        refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+        std::vector<MappedFile> ref_files;
+        std::vector<std::array<uint8_t, DELTA_CRC_SIZE>> ref_crcs(refs.size());
+        for (const auto& ref : refs) { ref_files.push_back(MappedFile::open_read(ref)); }
+        auto ref_of = [&](const std::string& ref) {
+            return static_cast<size_t>(
+                std::lower_bound(refs.begin(), refs.end(), ref) - refs.begin());
+        };
+
+        start_trace(vfy_trace);
+        auto t0 = std::chrono::steady_clock::now();
+        size_t n_threads = vfy_threads ? vfy_threads
+            : std::max<size_t>(1, std::thread::hardware_concurrency());
+        auto run = [&](auto&& body, size_t n) {
+            std::atomic<size_t> next{0};
+            std::vector<std::thread> pool;
+            for (size_t t = 0; t < std::min(n_threads, n); ++t) {
+                pool.emplace_back([&] {
+                    trace_thread_name("verify worker");
+                    for (size_t i; (i = next.fetch_add(1)) < n; ) { body(i); }
+                });
+            }
+            for (auto& th : pool) { th.join(); }
+        };
+        run([&](size_t i) {
+            auto r = ref_files[i].span();
+            ref_crcs[i] = crc64_xz(r.data(), r.size());
+        }, refs.size());
+        std::vector<VerifyResult> results(jobs.size());
+        run([&](size_t i) {
+            size_t k = ref_of(jobs[i].first);
+            std::error_code ec;
+            if (!std::filesystem::is_regular_file(jobs[i].second, ec)) {
+                results[i].error = "cannot open delta";
+                return;
+            }
+            auto d = MappedFile::open_read(jobs[i].second);
+            TraceSpan tr_job("verify job", "task", "job", i);
+            results[i] = verify_delta(ref_files[k].span(), d.span(), &ref_crcs[k]);
+        }, jobs.size());
+        auto t1 = std::chrono::steady_clock::now();
+
+        size_t failed = 0;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            if (results[i].ok) {
+                std::printf("OK    %s (%zu bytes%s)\n", jobs[i].second.c_str(),
+                    results[i].version_size, results[i].inplace ? ", in-place" : "");
+            } else {
+                ++failed;
+                std::printf("FAIL  %s: %s\n", jobs[i].second.c_str(),
+                    results[i].error.c_str());
+            }
+        }
+        std::printf("Verified %zu of %zu deltas in %.3fs\n", jobs.size() - failed,
+            jobs.size(), std::chrono::duration<double>(t1 - t0).count());
+        write_trace(vfy_trace);
+        return failed ? 1 : 0;
+
     } else if (inf->parsed()) {
         auto delta_bytes = read_file(info_delta);
         auto [placed, is_ip, version_size, src_crc, dst_crc] = decode_delta(delta_bytes);
@@ -329,15 +1578,34 @@ int main(int argc, char** argv) {
         CyclePolicy pol = CyclePolicy::Localmin;
         if (inp_policy_str == "constant") { pol = CyclePolicy::Constant; }
 
+        start_perf(inp_perf);
+        start_trace(inp_trace);
+        StatsReport report;
+        report.command = "inplace";
+        PhaseTimer t_total, t_phase;
+        uint64_t trace_phase = trace_clock();
+        auto phase = [&](const char* name) {
+            report.phases.emplace_back(name, t_phase.elapsed());
+            trace_complete(name, "cli", trace_phase);
+            t_phase = PhaseTimer();
+            trace_phase = trace_clock();
+        };
+
         auto r_file = MappedFile::open_read(inp_ref);
         auto r = r_file.span();
         auto delta_bytes = read_file(inp_delta_in);
+        phase("mmap");
 
         auto [placed, is_ip, version_size, src_crc, dst_crc] = decode_delta(delta_bytes);
+        phase("decode");
 
         if (is_ip) {
             write_file(inp_delta_out, delta_bytes);
+            phase("write");
             std::printf("Delta is already in-place format; copied unchanged.\n");
+            report.total = t_total.elapsed();
+            write_stats_json(inp_stats_json, report);
+            write_trace(inp_trace);
             return 0;
         }
 
@@ -346,9 +1614,12 @@ int main(int argc, char** argv) {
         auto ip_placed = make_inplace(r, commands, pol);
         auto t1 = std::chrono::steady_clock::now();
         double elapsed = std::chrono::duration<double>(t1 - t0).count();
+        phase("inplace");
 
         auto ip_delta = encode_delta(ip_placed, true, version_size, src_crc, dst_crc);
+        phase("encode");
         write_file(inp_delta_out, ip_delta);
+        phase("write");
 
         auto stats = placed_summary(ip_placed);
         std::printf("Reference:    %s (%zu bytes)\n", inp_ref.c_str(), r.size());
@@ -359,6 +1630,18 @@ int main(int argc, char** argv) {
         std::printf("Copy bytes:   %zu\n", stats.copy_bytes);
         std::printf("Add bytes:    %zu\n", stats.add_bytes);
         std::printf("Time:         %.3fs\n", elapsed);
+
+        report.labels = {{"policy", inp_policy_str}, {"reference", inp_ref},
+                         {"delta_in", inp_delta_in}, {"delta_out", inp_delta_out}};
+        report.counts = {{"r_size", r.size()}, {"version_size", version_size},
+                         {"delta_in_bytes", delta_bytes.size()},
+                         {"delta_out_bytes", ip_delta.size()},
+                         {"copies", stats.num_copies}, {"adds", stats.num_adds},
+                         {"copy_bytes", stats.copy_bytes}, {"add_bytes", stats.add_bytes}};
+        report.total = t_total.elapsed();
+        if (inp_perf) { print_phases(report); }
+        write_stats_json(inp_stats_json, report);
+        write_trace(inp_trace);
     }
 
     return 0;
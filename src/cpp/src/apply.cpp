@@ -1,4 +1,5 @@
 #include "delta/apply.h"
+#include "delta/trace.h"
 
 #include <algorithm>
 #include <cstring>
@@ -93,6 +94,7 @@ size_t apply_placed_to(
     const std::vector<PlacedCommand>& commands,
     std::span<uint8_t> out) {
 
+    TraceSpan tr_apply("apply", "phase", "commands", commands.size());
     size_t max_written = 0;
     for (const auto& cmd : commands) {
         if (auto* c = std::get_if<PlacedCopy>(&cmd)) {
@@ -145,6 +147,7 @@ std::vector<uint8_t> apply_delta_inplace(
     const std::vector<PlacedCommand>& commands,
     size_t version_size) {
 
+    TraceSpan tr_apply("apply inplace", "phase", "commands", commands.size());
     size_t buf_size = std::max(r.size(), version_size);
     std::vector<uint8_t> buf(buf_size, 0);
     std::memcpy(buf.data(), r.data(), r.size());
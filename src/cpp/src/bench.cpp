@@ -0,0 +1,379 @@
+#include "delta/bench.h"
+#include "delta/algorithm.h"
+#include "delta/apply.h"
+#include "delta/crc64.h"
+#include "delta/encoding.h"
+#include "delta/inplace.h"
+#include "delta/memory.h"
+#include "delta/stats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+// POSIX fork / pipe
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace delta {
+
+namespace {
+
+/// Time changes smaller than this are noise whatever the threshold.
+constexpr double BENCH_MIN_SECONDS = 0.005;
+
+constexpr const char* CSV_HEADER =
+    "pair,config,r_size,v_size,delta_bytes,ratio,runs,encode_median,encode_p95,"
+    "decode_median,mbps,peak_rss,table_peak,ok";
+
+std::vector<uint8_t> read_whole(const std::string& path) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    std::vector<uint8_t> buf(f ? static_cast<size_t>(f.tellg()) : 0);
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(buf.data()), static_cast<std::streamsize>(buf.size()));
+    if (!f) { throw DeltaError("bench: cannot read " + path); }
+    return buf;
+}
+
+/// Names are written unquoted, so commas cannot appear in them.
+std::string csv_field(std::string s) {
+    std::replace(s.begin(), s.end(), ',', '_');
+    std::replace(s.begin(), s.end(), '\n', '_');
+    return s;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+double percentile(std::vector<double> v, double p) {
+    if (v.empty()) { return 0; }
+    std::sort(v.begin(), v.end());
+    size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(v.size())));
+    return v[std::clamp<size_t>(rank, 1, v.size()) - 1];
+}
+
+void json_string(std::string& out, const std::string& s) {
+    out += '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; }
+        if (static_cast<unsigned char>(c) >= 0x20) { out += c; }
+    }
+    out += '"';
+}
+
+} // anonymous namespace
+
+Algorithm algorithm_from_name(const std::string& name) {
+    for (size_t i = 0; i < std::size(ALGORITHM_NAMES); ++i) {
+        if (name == ALGORITHM_NAMES[i]) { return static_cast<Algorithm>(i); }
+    }
+    throw DeltaError("unknown algorithm '" + name + "'");
+}
+
+std::string BenchConfig::name() const {
+    std::string s = ALGORITHM_NAMES[static_cast<size_t>(algo)];
+    if (splay) { s += "+splay"; }
+    if (inplace) {
+        s += policy == CyclePolicy::Constant ? "+inplace/constant" : "+inplace/localmin";
+    }
+    return s + " p" + std::to_string(seed_len) + " t" + std::to_string(max_table);
+}
+
+std::vector<BenchConfig> bench_matrix(const BenchAxes& axes) {
+    std::vector<BenchConfig> out;
+    for (auto algo : axes.algorithms) {
+        bool has_splay = algo == Algorithm::Greedy || algo == Algorithm::Onepass
+            || algo == Algorithm::Correcting;
+        for (bool splay : axes.splay) {
+            if (splay && !has_splay) { continue; }
+            for (bool inplace : axes.inplace) {
+                for (size_t pi = 0; pi < axes.policies.size(); ++pi) {
+                    if (!inplace && pi > 0) { continue; }
+                    for (size_t p : axes.seed_lens) {
+                        for (size_t t : axes.max_tables) {
+                            BenchConfig c;
+                            c.algo = algo;
+                            c.splay = splay;
+                            c.inplace = inplace;
+                            c.policy = inplace ? axes.policies[pi] : CyclePolicy::Localmin;
+                            c.seed_len = p;
+                            c.max_table = t;
+                            out.push_back(c);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return out;
+}
+
+std::vector<BenchPair> bench_corpus(const std::string& dir) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::vector<fs::path> files;
+    for (const auto& e : fs::directory_iterator(dir, ec)) {
+        if (e.is_regular_file()) { files.push_back(e.path()); }
+    }
+    if (ec) { throw DeltaError("bench: cannot list " + dir + ": " + ec.message()); }
+    std::sort(files.begin(), files.end());
+
+    std::vector<BenchPair> pairs;
+    for (const auto& f : files) {
+        if (f.extension() != ".ref") { continue; }
+        auto ver = fs::path(f).replace_extension(".ver");
+        if (fs::is_regular_file(ver, ec)) {
+            pairs.push_back({f.stem().string(), f.string(), ver.string()});
+        }
+    }
+    if (pairs.empty()) {
+        for (size_t i = 0; i + 1 < files.size(); ++i) {
+            pairs.push_back({files[i].filename().string() + ">" + files[i + 1].filename().string(),
+                             files[i].string(), files[i + 1].string()});
+        }
+    }
+    if (pairs.empty()) { throw DeltaError("bench: no file pairs in " + dir); }
+    return pairs;
+}
+
+BenchResult bench_run(std::span<const uint8_t> r, std::span<const uint8_t> v,
+                      const BenchConfig& config, size_t repeat) {
+    BenchResult res;
+    res.config = config.name();
+    res.r_size = r.size();
+    res.v_size = v.size();
+    auto src_crc = crc64_xz(r.data(), r.size());
+    auto dst_crc = crc64_xz(v.data(), v.size());
+
+    DiffOptions opts;
+    opts.p = config.seed_len;
+    opts.max_table = config.max_table;
+    opts.use_splay = config.splay;
+
+    MemoryWatch watch;
+    std::vector<double> enc_times, dec_times;
+    std::vector<uint8_t> delta_bytes, out;
+    for (size_t i = 0; i < std::max<size_t>(repeat, 1); ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        auto commands = diff(config.algo, r, v, opts);
+        auto placed = config.inplace ? make_inplace(r, commands, config.policy)
+                                     : place_commands(commands);
+        delta_bytes = encode_delta(placed, config.inplace, v.size(), src_crc, dst_crc);
+        enc_times.push_back(seconds_since(t0));
+
+        t0 = std::chrono::steady_clock::now();
+        auto [cmds, inplace, v_size, src, dst] = decode_delta(delta_bytes);
+        if (inplace) {
+            out = apply_delta_inplace(r, cmds, v_size);
+        } else {
+            out.assign(v_size, 0);
+            apply_placed_to(r, cmds, out);
+        }
+        dec_times.push_back(seconds_since(t0));
+    }
+
+    res.runs = enc_times.size();
+    res.delta_bytes = delta_bytes.size();
+    res.encode_median = percentile(enc_times, 0.5);
+    res.encode_p95 = percentile(enc_times, 0.95);
+    res.decode_median = percentile(dec_times, 0.5);
+    res.peak_rss = peak_rss_bytes();
+    res.table_peak = watch.peak();
+    res.ok = std::equal(out.begin(), out.end(), v.begin(), v.end());
+    return res;
+}
+
+BenchResult bench_run_isolated(const BenchPair& pair, const BenchConfig& config,
+                               size_t repeat) {
+    BenchResult failed;
+    failed.pair = pair.name;
+    failed.config = config.name();
+
+    int fds[2];
+    if (::pipe(fds) < 0) { return failed; }
+    std::fflush(nullptr);
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return failed;
+    }
+    if (pid == 0) {
+        // The child reports its result as one CSV file on the pipe.
+        ::close(fds[0]);
+        int status = 1;
+        try {
+            auto r = read_whole(pair.reference);
+            auto v = read_whole(pair.version);
+            auto res = bench_run(r, v, config, repeat);
+            res.pair = pair.name;
+            auto csv = bench_csv({res});
+            status = ::write(fds[1], csv.data(), csv.size())
+                == static_cast<ssize_t>(csv.size()) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "bench: %s: %s\n", failed.config.c_str(), e.what());
+        }
+        ::_exit(status);
+    }
+
+    ::close(fds[1]);
+    std::string csv;
+    char buf[4096];
+    for (ssize_t n; (n = ::read(fds[0], buf, sizeof(buf))) != 0; ) {
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0) { break; }
+        csv.append(buf, static_cast<size_t>(n));
+    }
+    ::close(fds[0]);
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) { return failed; }
+    try {
+        auto rows = parse_bench_csv(csv);
+        return rows.size() == 1 ? rows[0] : failed;
+    } catch (const DeltaError&) {
+        return failed;
+    }
+}
+
+std::string bench_csv(const std::vector<BenchResult>& results) {
+    std::string out = CSV_HEADER;
+    out += '\n';
+    char buf[512];
+    for (const auto& r : results) {
+        std::snprintf(buf, sizeof(buf),
+            ",%zu,%zu,%zu,%.6f,%zu,%.6f,%.6f,%.6f,%.3f,%zu,%zu,%d\n",
+            r.r_size, r.v_size, r.delta_bytes, r.ratio(), r.runs,
+            r.encode_median, r.encode_p95, r.decode_median, r.mbps(),
+            r.peak_rss, r.table_peak, r.ok ? 1 : 0);
+        out += csv_field(r.pair) + ',' + csv_field(r.config) + buf;
+    }
+    return out;
+}
+
+std::string bench_json(const std::vector<BenchResult>& results) {
+    std::string out = "{\"results\":[";
+    char buf[512];
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out += i ? ",\n{\"pair\":" : "\n{\"pair\":";
+        json_string(out, r.pair);
+        out += ",\"config\":";
+        json_string(out, r.config);
+        std::snprintf(buf, sizeof(buf),
+            ",\"r_size\":%zu,\"v_size\":%zu,\"delta_bytes\":%zu,\"ratio\":%.6f,"
+            "\"runs\":%zu,\"encode_median\":%.6f,\"encode_p95\":%.6f,"
+            "\"decode_median\":%.6f,\"mbps\":%.3f,\"peak_rss\":%zu,"
+            "\"table_peak\":%zu,\"ok\":%s}",
+            r.r_size, r.v_size, r.delta_bytes, r.ratio(), r.runs,
+            r.encode_median, r.encode_p95, r.decode_median, r.mbps(),
+            r.peak_rss, r.table_peak, r.ok ? "true" : "false");
+        out += buf;
+    }
+    out += "]}\n";
+    return out;
+}
+
+std::vector<BenchResult> parse_bench_csv(const std::string& csv) {
+    auto split = [](const std::string& line) {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        for (std::string f; std::getline(ss, f, ','); ) { fields.push_back(f); }
+        return fields;
+    };
+    std::stringstream in(csv);
+    std::string line;
+    if (!std::getline(in, line)) { throw DeltaError("bench: empty CSV"); }
+    std::map<std::string, size_t> col;
+    auto header = split(line);
+    for (size_t i = 0; i < header.size(); ++i) { col[header[i]] = i; }
+    for (const char* need : {"pair", "config", "v_size", "delta_bytes", "encode_median"}) {
+        if (!col.count(need)) {
+            throw DeltaError(std::string("bench: CSV lacks column '") + need + "'");
+        }
+    }
+
+    std::vector<BenchResult> out;
+    while (std::getline(in, line)) {
+        if (line.empty()) { continue; }
+        auto f = split(line);
+        if (f.size() != header.size()) { throw DeltaError("bench: ragged CSV row"); }
+        auto get = [&](const char* name) -> const std::string* {
+            auto it = col.find(name);
+            return it == col.end() ? nullptr : &f[it->second];
+        };
+        auto size = [&](const char* name) -> size_t {
+            auto* s = get(name);
+            return s ? std::strtoull(s->c_str(), nullptr, 10) : 0;
+        };
+        auto real = [&](const char* name) {
+            auto* s = get(name);
+            return s ? std::strtod(s->c_str(), nullptr) : 0.0;
+        };
+        BenchResult r;
+        r.pair = *get("pair");
+        r.config = *get("config");
+        r.r_size = size("r_size");
+        r.v_size = size("v_size");
+        r.delta_bytes = size("delta_bytes");
+        r.runs = size("runs");
+        r.encode_median = real("encode_median");
+        r.encode_p95 = real("encode_p95");
+        r.decode_median = real("decode_median");
+        r.peak_rss = size("peak_rss");
+        r.table_peak = size("table_peak");
+        r.ok = size("ok") != 0;
+        out.push_back(std::move(r));
+    }
+    return out;
+}
+
+std::vector<BenchChange> bench_compare(const std::vector<BenchResult>& baseline,
+                                       const std::vector<BenchResult>& current,
+                                       double time_threshold,
+                                       double size_threshold) {
+    std::map<std::pair<std::string, std::string>, const BenchResult*> base;
+    for (const auto& b : baseline) { base[{b.pair, b.config}] = &b; }
+
+    std::vector<BenchChange> changes;
+    for (const auto& c : current) {
+        auto it = base.find({c.pair, c.config});
+        if (it == base.end()) { continue; }
+        const auto& b = *it->second;
+        auto check = [&](const char* metric, double before, double after,
+                         double threshold, double min_abs) {
+            if (std::fabs(after - before) <= min_abs) { return; }
+            if (after > before * (1 + threshold)) {
+                changes.push_back({c.pair, c.config, metric, before, after, true});
+            } else if (after < before * (1 - threshold)) {
+                changes.push_back({c.pair, c.config, metric, before, after, false});
+            }
+        };
+        if (b.ok != c.ok) {
+            changes.push_back({c.pair, c.config, "ok", double(b.ok), double(c.ok), !c.ok});
+        }
+        check("encode_median", b.encode_median, c.encode_median,
+              time_threshold, BENCH_MIN_SECONDS);
+        check("decode_median", b.decode_median, c.decode_median,
+              time_threshold, BENCH_MIN_SECONDS);
+        check("peak_rss", double(b.peak_rss), double(c.peak_rss), time_threshold, 0);
+        check("delta_bytes", double(b.delta_bytes), double(c.delta_bytes),
+              size_threshold, 0);
+        base.erase(it);
+    }
+    // Configurations the current run no longer covers.
+    for (const auto& [key, b] : base) {
+        changes.push_back({key.first, key.second, "missing", 1, 0, true});
+    }
+    return changes;
+}
+
+} // namespace delta
@@ -0,0 +1,145 @@
+#include "delta/algorithm.h"
+#include "delta/postpass.h"
+#include "delta/stats.h"
+#include "delta/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace delta {
+
+std::vector<BestCandidate> best_candidates(const DiffOptions& opts,
+                                           size_t r_size) {
+    auto with_p = [&](size_t p) {
+        DiffOptions o = opts;
+        o.p = p;
+        return o;
+    };
+    auto label = [](const char* name, size_t p) {
+        return std::string(name) + " p=" + std::to_string(p);
+    };
+
+    // Fast and robust first, so an early finisher sets a tight bound:
+    // hierarchical copes with moved blocks, which onepass cannot follow.
+    size_t p = opts.p;
+    std::vector<BestCandidate> c;
+    c.push_back({Algorithm::Hierarchical, opts, label("hierarchical", p)});
+    c.push_back({Algorithm::Correcting, opts, label("correcting", p)});
+    c.push_back({Algorithm::Onepass, opts, label("onepass", p)});
+    if (p / 2 >= 4) {
+        c.push_back({Algorithm::Correcting, with_p(p / 2),
+                     label("correcting", p / 2)});
+    }
+    c.push_back({Algorithm::Correcting, with_p(2 * p),
+                 label("correcting", 2 * p)});
+    if (r_size <= BEST_GREEDY_MAX) {
+        c.push_back({Algorithm::Greedy, opts, label("greedy", p)});
+    }
+    return c;
+}
+
+BestResult diff_best(
+    std::span<const uint8_t> r,
+    std::span<const uint8_t> v,
+    const std::vector<BestCandidate>& candidates,
+    const DiffOptions& opts) {
+
+    if (candidates.empty()) {
+        throw DeltaError("best: no candidates");
+    }
+
+    PhaseTimer t_race;
+    TraceSpan tr_race("best race");
+    std::atomic<size_t> bound{std::numeric_limits<size_t>::max()};
+    std::mutex mu;
+    BestResult best{{}, candidates.size(), {}};
+    best.costs.assign(candidates.size(), std::nullopt);
+    std::exception_ptr error;
+
+    // Candidates are claimed from a shared counter, like rematch's gaps.
+    size_t n_threads = opts.threads > 0
+        ? opts.threads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    n_threads = std::min(n_threads, candidates.size());
+
+    auto run = [&](size_t i) {
+        const auto& cand = candidates[i];
+        if (cand.algo == Algorithm::Best) {
+            throw DeltaError("best: a candidate cannot itself be 'best'");
+        }
+        DiffOptions o = cand.opts;
+        o.verbose = false;
+        o.stats = nullptr;
+        o.trim = false;
+        o.rematch = false;
+        o.optimize = false;
+        o.deadline = opts.deadline;
+        o.time_budget = opts.time_budget;
+        o.size_bound = &bound;
+        // Candidates run side by side, so each gets a share of the budget.
+        o.memory_limit = opts.memory_limit / n_threads;
+
+        TraceSpan tr_task(tracing_enabled() ? trace_intern(cand.label) : "",
+                          "task", "candidate", i);
+        std::vector<Command> cmds;
+        try {
+            cmds = diff(cand.algo, r, v, o);
+        } catch (const DiffCancelled&) {
+            return;
+        }
+        size_t cost = encoded_cost(cmds);
+
+        std::lock_guard lock(mu);
+        best.costs[i] = cost;
+        bool wins = best.winner == candidates.size()
+            || cost < *best.costs[best.winner]
+            || (cost == *best.costs[best.winner] && i < best.winner);
+        if (wins) {
+            best.commands = std::move(cmds);
+            best.winner = i;
+            bound.store(cost, std::memory_order_relaxed);
+        }
+    };
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        if (n_threads > 1) { trace_thread_name("best worker"); }
+        for (size_t i = next++; i < candidates.size(); i = next++) {
+            try {
+                run(i);
+            } catch (...) {
+                std::lock_guard lock(mu);
+                if (!error) { error = std::current_exception(); }
+            }
+        }
+    };
+
+    if (n_threads == 1) {
+        worker();
+    } else {
+        std::vector<std::thread> pool;
+        pool.reserve(n_threads);
+        for (size_t t = 0; t < n_threads; ++t) { pool.emplace_back(worker); }
+        for (auto& th : pool) { th.join(); }
+    }
+    if (error) { std::rethrow_exception(error); }
+
+    if (opts.stats) {
+        auto& st = *opts.stats;
+        st.algorithm = "best";
+        st.scan = t_race.elapsed();
+        st.best_threads = n_threads;
+        st.winner = best.winner;
+        st.candidates.clear();
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            st.candidates.push_back({candidates[i].label, best.costs[i]});
+        }
+    }
+    return best;
+}
+
+} // namespace delta
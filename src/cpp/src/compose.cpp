@@ -0,0 +1,122 @@
+#include "delta/compose.h"
+
+#include <algorithm>
+#include <string>
+
+namespace delta {
+
+namespace {
+
+/// One command of A->B seen as the B interval [dst, dst + len).
+struct Piece {
+    size_t dst;
+    size_t len;
+    const PlacedCommand* cmd;
+};
+
+size_t placed_dst(const PlacedCommand& cmd) {
+    if (auto* c = std::get_if<PlacedCopy>(&cmd)) { return c->dst; }
+    return std::get<PlacedAdd>(cmd).dst;
+}
+
+size_t placed_len(const PlacedCommand& cmd) {
+    if (auto* c = std::get_if<PlacedCopy>(&cmd)) { return c->length; }
+    return std::get<PlacedAdd>(cmd).data.size();
+}
+
+} // anonymous namespace
+
+std::vector<PlacedCommand> compose_deltas(
+    const std::vector<PlacedCommand>& ab,
+    size_t b_size,
+    const std::vector<PlacedCommand>& bc) {
+
+    // B's command map, sorted by destination; it must tile [0, |B|).
+    std::vector<Piece> map;
+    map.reserve(ab.size());
+    for (const auto& cmd : ab) {
+        if (placed_len(cmd) > 0) {
+            map.push_back({placed_dst(cmd), placed_len(cmd), &cmd});
+        }
+    }
+    std::sort(map.begin(), map.end(),
+              [](const Piece& a, const Piece& b) { return a.dst < b.dst; });
+    size_t covered = 0;
+    for (const auto& p : map) {
+        if (p.dst != covered) {
+            throw DeltaError("compose: first delta does not cover its version "
+                             "at offset " + std::to_string(covered));
+        }
+        covered += p.len;
+    }
+    if (covered != b_size) {
+        throw DeltaError("compose: first delta writes " + std::to_string(covered)
+                         + " bytes, expected " + std::to_string(b_size));
+    }
+
+    std::vector<const PlacedCommand*> order;
+    order.reserve(bc.size());
+    for (const auto& cmd : bc) { order.push_back(&cmd); }
+    std::stable_sort(order.begin(), order.end(),
+        [](const PlacedCommand* a, const PlacedCommand* b) {
+            return placed_dst(*a) < placed_dst(*b);
+        });
+
+    std::vector<PlacedCommand> out;
+    out.reserve(bc.size());
+    auto emit_copy = [&](size_t src, size_t dst, size_t len) {
+        if (!out.empty()) {
+            if (auto* c = std::get_if<PlacedCopy>(&out.back());
+                c && c->src + c->length == src && c->dst + c->length == dst) {
+                c->length += len;
+                return;
+            }
+        }
+        out.emplace_back(PlacedCopy{src, dst, len});
+    };
+    auto emit_add = [&](size_t dst, const uint8_t* data, size_t len) {
+        if (!out.empty()) {
+            if (auto* a = std::get_if<PlacedAdd>(&out.back());
+                a && a->dst + a->data.size() == dst) {
+                a->data.insert(a->data.end(), data, data + len);
+                return;
+            }
+        }
+        out.emplace_back(PlacedAdd{dst, std::vector<uint8_t>(data, data + len)});
+    };
+
+    for (const auto* cmd : order) {
+        if (auto* a = std::get_if<PlacedAdd>(cmd)) {
+            emit_add(a->dst, a->data.data(), a->data.size());
+            continue;
+        }
+        const auto& c = std::get<PlacedCopy>(*cmd);
+        if (c.length == 0) { continue; }
+        if (c.src > b_size || c.length > b_size - c.src) {
+            throw DeltaError("compose: second delta reads past the end of "
+                             "its reference");
+        }
+        // First piece containing c.src, then walk forward.
+        auto it = std::upper_bound(map.begin(), map.end(), c.src,
+            [](size_t pos, const Piece& p) { return pos < p.dst; });
+        size_t i = static_cast<size_t>(it - map.begin()) - 1;
+        size_t pos = c.src, dst = c.dst, left = c.length;
+        while (left > 0) {
+            const auto& p = map[i];
+            size_t off = pos - p.dst;
+            size_t n = std::min(p.len - off, left);
+            if (auto* pc = std::get_if<PlacedCopy>(p.cmd)) {
+                emit_copy(pc->src + off, dst, n);
+            } else {
+                emit_add(dst, std::get<PlacedAdd>(*p.cmd).data.data() + off, n);
+            }
+            pos += n;
+            dst += n;
+            left -= n;
+            ++i;
+        }
+    }
+    return out;
+}
+
+} // namespace delta
@@ -1,9 +1,15 @@
 #include "delta/algorithm.h"
+#include "delta/deadline.h"
+#include "delta/race.h"
 #include "delta/hash.h"
+#include "delta/memory.h"
+#include "delta/postpass.h"
 #include "delta/splay.h"
+#include "delta/stats.h"
+#include "delta/trace.h"
 
 #include <algorithm>
-#include <cstdio>
+#include <chrono>
 #include <cstring>
 #include <deque>
 #include <optional>
@@ -18,6 +24,10 @@ struct BufEntry {
     bool dummy;
 };
 
+/// Checkpoint thinning limit under a time budget: the checkpoint modulus
+/// grows from m to at most m * MAX_THIN.
+static constexpr uint64_t MAX_THIN = 64;
+
 /// Correcting 1.5-Pass algorithm (Section 7, Figure 8) with
 /// fingerprint-based checkpointing (Section 8).
 std::vector<Command> diff_correcting(
@@ -28,7 +38,6 @@ std::vector<Command> diff_correcting(
     auto p = opts.p;
     auto q = opts.q;
     size_t buf_cap = opts.buf_cap;
-    bool verbose = opts.verbose;
     bool use_splay = opts.use_splay;
 
     std::vector<Command> commands;
@@ -36,9 +45,15 @@ std::vector<Command> diff_correcting(
 
     // ── Checkpointing parameters (Section 8.1, pp. 347-348) ─────────
     size_t num_seeds = (r.size() >= p) ? (r.size() - p + 1) : 0;
-    size_t max_table = opts.max_table;
+    using HSlot = std::optional<std::pair<uint64_t, size_t>>;
+    // Under a deadline, no more than the build can reach (deadline.h);
+    // checkpoints thin to match, as they would mid-build.
+    Deadline dl(opts);
+    size_t max_table = std::min(table_slots(opts, sizeof(HSlot)),
+                                std::max<size_t>(dl.share(0.5).reach() / p * 2, 1));
     // Auto-size: 2x factor for correcting's |F|=2L convention.
-    // Capped at max_table to prevent runaway allocation on huge inputs.
+    // Capped at max_table (and memory_limit) to prevent runaway
+    // allocation on huge inputs.
     size_t cap = (num_seeds > 0)
         ? next_prime(std::min(max_table, std::max(q, 2 * num_seeds / p)))
         : next_prime(std::min(q, max_table)); // |C|
@@ -55,37 +70,74 @@ std::vector<Command> diff_correcting(
         k = fp_k % f_size % m;
     }
 
-    if (verbose) {
-        uint64_t expected = (m > 0) ? static_cast<uint64_t>(num_seeds) / m : 0;
-        uint64_t occ_est = (cap > 0) ? expected * 100 / static_cast<uint64_t>(cap) : 0;
-        std::fprintf(stderr,
-            "correcting: %s, |C|=%zu |F|=%llu m=%llu k=%llu\n"
-            "  checkpoint gap=%llu bytes, expected fill ~%llu (~%llu%% table occupancy)\n"
-            "  table memory ~%zu MB\n",
-            use_splay ? "splay tree" : "hash table",
-            cap, (unsigned long long)f_size, (unsigned long long)m,
-            (unsigned long long)k, (unsigned long long)m,
-            (unsigned long long)expected, (unsigned long long)occ_est,
-            cap * 24 / 1048576);
-    }
+    // ── Time budget (deadline.h) ────────────────────────────────────
+    // The build may use half the remaining budget and the scan 90% of
+    // what is left after it; the rest is reserved for a onepass tail.
+    // A phase projected to overrun at the rate measured since the last
+    // adjustment doubles the checkpoint modulus mt, until a doubling no
+    // longer speeds it up (hashing every position is a fixed cost).
+    // Seeds passing f % mt == k also pass every coarser test and keep
+    // their f / m table slot, so thinning mid-phase is safe.
+    CostMeter meter(opts);
+    uint64_t mt = m;
+    size_t build_thin = 1, build_stop = num_seeds, scan_thin = 1;
+    bool onepass_tail = false;
+
+    auto adj_time = Deadline::Clock::now();
+    size_t adj_done = 0;
+    double adj_rate = 0; // seconds per position before the last doubling
+    bool thin_pays = true;
+    auto start_phase = [&]() {
+        adj_time = Deadline::Clock::now();
+        adj_done = 0;
+        adj_rate = 0;
+        thin_pays = true;
+    };
+    auto maybe_thin = [&](const Deadline& phase, size_t done, size_t total,
+                          size_t& thin) {
+        if (!thin_pays || mt >= m * MAX_THIN || done <= adj_done) { return; }
+        auto now = Deadline::Clock::now();
+        double rate = std::chrono::duration<double>(now - adj_time).count()
+            / static_cast<double>(done - adj_done);
+        if (adj_rate > 0) {
+            if (rate > 0.9 * adj_rate) { thin_pays = false; return; }
+            adj_rate = 0;
+        }
+        if (rate * static_cast<double>(total - done) > phase.remaining()) {
+            adj_rate = rate;
+            adj_time = now;
+            adj_done = done;
+            mt *= 2;
+            thin *= 2;
+        }
+    };
 
-    // Debug counters
-    size_t dbg_build_passed = 0, dbg_build_stored = 0, dbg_build_skipped_collision = 0;
-    size_t dbg_scan_checkpoints = 0, dbg_scan_match = 0;
-    size_t dbg_scan_fp_mismatch = 0, dbg_scan_byte_mismatch = 0;
+    StatCounter n_build_passed = 0, n_build_stored = 0, n_build_collisions = 0;
+    StatCounter n_scan_checkpoints = 0, n_scan_match = 0;
+    StatCounter n_scan_fp_mismatch = 0, n_scan_byte_mismatch = 0;
 
     // Step (1): Build lookup structure for R (first-found policy)
-    using HSlot = std::optional<std::pair<uint64_t, size_t>>;
-    std::vector<HSlot> h_r_ht;
+    TrackedVector<HSlot> h_r_ht;
     SplayTree<std::pair<uint64_t, size_t>> h_r_sp; // (full_fp, offset)
 
     if (!use_splay) {
         h_r_ht.resize(cap);
     }
 
+    Deadline build_dl = dl.share(0.5);
+    start_phase();
+    PhaseTimer t_build;
+    TraceSpan tr_build("build");
+    Histogram gaps, extension;
+    size_t last_passed = SIZE_MAX;
+
     std::optional<RollingHash> rh_build;
     if (num_seeds > 0) { rh_build.emplace(r, 0, p); }
     for (size_t a = 0; a < num_seeds; ++a) {
+        if (dl.enabled() && a > 0 && a % DEADLINE_CHECK_INTERVAL == 0) {
+            if (build_dl.expired()) { build_stop = a; break; }
+            maybe_thin(build_dl, a, num_seeds, build_thin);
+        }
         uint64_t fp;
         if (a == 0) {
             fp = rh_build->value();
@@ -94,43 +146,35 @@ std::vector<Command> diff_correcting(
             fp = rh_build->value();
         }
         uint64_t f = fp % f_size;
-        if (f % m != k) { continue; } // not a checkpoint seed
-        ++dbg_build_passed;
+        if (f % mt != k) { continue; } // not a checkpoint seed
+        ++n_build_passed;
+        if (last_passed != SIZE_MAX) { gaps.record(a - last_passed); }
+        last_passed = a;
 
         if (use_splay) {
             // insert_or_get implements first-found policy
             auto& val = h_r_sp.insert_or_get(fp, std::make_pair(fp, a));
             if (val.second == a) {
-                ++dbg_build_stored;
+                ++n_build_stored;
             } else {
-                ++dbg_build_skipped_collision;
+                ++n_build_collisions;
             }
         } else {
             size_t i = static_cast<size_t>(f / m);
             if (i >= cap) { continue; } // safety
             if (!h_r_ht[i].has_value()) {
                 h_r_ht[i] = std::make_pair(fp, a); // first-found (Section 7 Step 1)
-                ++dbg_build_stored;
+                ++n_build_stored;
             } else {
-                ++dbg_build_skipped_collision;
+                ++n_build_collisions;
             }
         }
     }
 
-    if (verbose) {
-        double passed_pct = (num_seeds > 0)
-            ? static_cast<double>(dbg_build_passed) / num_seeds * 100.0 : 0.0;
-        size_t stored_count = use_splay ? h_r_sp.size() : dbg_build_stored;
-        double occ_pct = (cap > 0)
-            ? static_cast<double>(stored_count) / cap * 100.0 : 0.0;
-        std::fprintf(stderr,
-            "  build: %zu seeds, %zu passed checkpoint (%.2f%%), "
-            "%zu stored, %zu collisions\n"
-            "  build: table occupancy %zu/%zu (%.1f%%)\n",
-            num_seeds, dbg_build_passed, passed_pct,
-            dbg_build_stored, dbg_build_skipped_collision,
-            stored_count, cap, occ_pct);
-    }
+    PhaseTime build_time = t_build.elapsed();
+    tr_build.end();
+    PhaseTimer t_scan;
+    TraceSpan tr_scan("scan");
 
     // Lookup helper: returns (full_fp, offset) pair if found, nullopt otherwise.
     auto lookup_r = [&](uint64_t fp_v, uint64_t f_v)
@@ -168,10 +212,27 @@ std::vector<Command> diff_correcting(
     size_t rh_v_pos = 0;
     if (v.size() >= p) { rh_v_scan.emplace(v, 0, p); rh_v_pos = 0; }
 
+    Deadline scan_dl = dl.share(0.9);
+    start_phase();
+    size_t next_check = DEADLINE_CHECK_INTERVAL;
+    size_t last_r_end = 0; // end of the latest copy's source
+
     for (;;) {
         // Step (3): check for end of V
         if (v_c + p > v.size()) { break; }
 
+        if ((dl.enabled() || meter.enabled()) && v_c >= next_check) {
+            next_check = v_c + DEADLINE_CHECK_INTERVAL;
+            meter.check(commands);
+            // Out of time, or past the part of R the build indexed with
+            // a full interval of V unmatched: hand over to onepass.
+            bool off_index = build_stop < num_seeds
+                && last_r_end + DEADLINE_CHECK_INTERVAL >= build_stop
+                && v_c - v_s >= DEADLINE_CHECK_INTERVAL;
+            if (scan_dl.expired() || off_index) { onepass_tail = true; break; }
+            maybe_thin(scan_dl, v_c, v.size(), scan_thin);
+        }
+
         // Step (4): generate footprint at v_c, apply checkpoint test.
         uint64_t fp_v;
         if (v_c == rh_v_pos) {
@@ -186,13 +247,13 @@ std::vector<Command> diff_correcting(
             fp_v = rh_v_scan->value();
         }
         uint64_t f_v = fp_v % f_size;
-        if (f_v % m != k) {
+        if (f_v % mt != k) {
             ++v_c;
             continue; // not a checkpoint — skip
         }
 
         // Checkpoint passed — look up R.
-        ++dbg_scan_checkpoints;
+        ++n_scan_checkpoints;
 
         auto entry = lookup_r(fp_v, f_v);
         size_t r_offset;
@@ -202,14 +263,14 @@ std::vector<Command> diff_correcting(
             if (stored_fp == fp_v) {
                 // Full fingerprint matches — verify bytes.
                 if (std::memcmp(&r[offset], &v[v_c], p) != 0) {
-                    ++dbg_scan_byte_mismatch;
+                    ++n_scan_byte_mismatch;
                     ++v_c;
                     continue;
                 }
-                ++dbg_scan_match;
+                ++n_scan_match;
                 r_offset = offset;
             } else {
-                ++dbg_scan_fp_mismatch;
+                ++n_scan_fp_mismatch;
                 ++v_c;
                 continue;
             }
@@ -235,6 +296,7 @@ std::vector<Command> diff_correcting(
         size_t r_m = r_offset - bwd;
         size_t ml = bwd + fwd;
         size_t match_end = v_m + ml;
+        extension.record(ml - p);
 
         // Step (6): encode with correction
         if (v_s <= v_m) {
@@ -260,6 +322,7 @@ std::vector<Command> diff_correcting(
                 CopyCmd{r_m, ml},
                 false});
             v_s = match_end;
+            last_r_end = r_m + ml;
         } else {
             // (6b) match extends backward into encoded prefix —
             // tail correction (Section 5.1, p. 339)
@@ -315,34 +378,77 @@ std::vector<Command> diff_correcting(
                     false});
             }
             v_s = match_end;
+            last_r_end = r_m + ml;
         }
 
         // Step (7): advance past matched region
         v_c = match_end;
     }
 
-    // Step (8): flush buffer and trailing add
+    // Step (8): flush buffer and trailing add.  Out of scan budget, the
+    // rest of V is handed to onepass, which needs no index build, with R
+    // starting where the last copy's source ended.
     flush_buf();
+    size_t tail_start = v_s, tail_r = 0;
+    if (onepass_tail && v_s < v.size()) {
+        for (auto it = commands.rbegin(); it != commands.rend(); ++it) {
+            if (auto* c = std::get_if<CopyCmd>(&*it)) {
+                tail_r = c->offset + c->length;
+                break;
+            }
+        }
+        DiffOptions tail_opts = opts;
+        tail_opts.stats = nullptr;
+        tail_opts.verbose = false;
+        dl.apply(tail_opts);
+        auto tail_cmds = diff_onepass(r.subspan(tail_r), v.subspan(v_s),
+                                      tail_opts);
+        for (auto& cmd : tail_cmds) {
+            if (auto* c = std::get_if<CopyCmd>(&cmd)) { c->offset += tail_r; }
+            commands.push_back(std::move(cmd));
+        }
+        v_s = v.size();
+    }
     if (v_s < v.size()) {
         commands.emplace_back(AddCmd{
             std::vector<uint8_t>(v.begin() + v_s, v.end())});
     }
 
-    if (verbose) {
-        size_t v_seeds = (v.size() >= p) ? (v.size() - p + 1) : 0;
-        double cp_pct = (v_seeds > 0)
-            ? static_cast<double>(dbg_scan_checkpoints) / v_seeds * 100.0 : 0.0;
-        double hit_pct = (dbg_scan_checkpoints > 0)
-            ? static_cast<double>(dbg_scan_match) / dbg_scan_checkpoints * 100.0 : 0.0;
-        std::fprintf(stderr,
-            "  scan: %zu V positions, %zu checkpoints (%.3f%%), %zu matches\n"
-            "  scan: hit rate %.1f%% (of checkpoints), "
-            "fp collisions %zu, byte mismatches %zu\n",
-            v_seeds, dbg_scan_checkpoints, cp_pct, dbg_scan_match,
-            hit_pct, dbg_scan_fp_mismatch, dbg_scan_byte_mismatch);
-        print_command_stats(commands);
+    DiffStats verbose_stats;
+    DiffStats* stats = opts.stats ? opts.stats : opts.verbose ? &verbose_stats : nullptr;
+    if (stats) {
+        auto& st = *stats;
+        st.algorithm = "correcting";
+        st.table_kind = use_splay ? "splay tree" : "hash table";
+        st.table_capacity = cap;
+        st.table_entries = use_splay ? h_r_sp.size() : size_t(n_build_stored);
+        st.f_size = f_size;
+        st.checkpoint_m = m;
+        st.checkpoint_k = k;
+        st.build_seeds = num_seeds;
+        st.build_passed = n_build_passed;
+        st.build_stored = n_build_stored;
+        st.build_collisions = n_build_collisions;
+        st.scan_positions = (v.size() >= p) ? (v.size() - p + 1) : 0;
+        st.scan_lookups = n_scan_checkpoints;
+        st.scan_matches = n_scan_match;
+        st.scan_fp_mismatch = n_scan_fp_mismatch;
+        st.scan_byte_mismatch = n_scan_byte_mismatch;
+        st.budget = dl.enabled();
+        st.build_thin = build_thin;
+        st.build_indexed = build_stop;
+        st.scan_thin = scan_thin;
+        if (onepass_tail) {
+            st.tail_v = tail_start;
+            st.tail_r = tail_r;
+        }
+        st.checkpoint_gaps = gaps;
+        st.match_extension = extension;
+        st.build = build_time;
+        st.scan = t_scan.elapsed();
     }
 
+    if (opts.verbose) { print_command_stats(commands, stats); }
     return commands;
 }
 
@@ -351,47 +457,105 @@ std::vector<Command> diff(
     Algorithm algo,
     std::span<const uint8_t> r,
     std::span<const uint8_t> v,
-    const DiffOptions& opts) {
+    const DiffOptions& in_opts) {
+
+    // A time budget becomes an absolute deadline shared by the algorithm
+    // and the post-passes.
+    DiffOptions opts = in_opts;
+    Deadline dl(opts);
+    dl.apply(opts);
+    TraceSpan tr_diff("diff");
+
+    // Verbose output is rendered from the same stats a caller can ask for,
+    // once, after the post-passes.
+    DiffStats local_stats;
+    if (opts.verbose && !opts.stats) { opts.stats = &local_stats; }
+    bool verbose = opts.verbose;
+    opts.verbose = false;
+    DiffStats* stats = opts.stats;
+    if (stats) { *stats = DiffStats{}; }
+
+    // Common prefix/suffix trim: emit them as copies and difference only
+    // the middles, shifting the middle's copy offsets back into R.
+    size_t prefix = 0, suffix = 0;
+    if (opts.trim) {
+        size_t limit = std::min(r.size(), v.size());
+        while (prefix < limit && r[prefix] == v[prefix]) { ++prefix; }
+        while (suffix < limit - prefix
+               && r[r.size() - 1 - suffix] == v[v.size() - 1 - suffix]) {
+            ++suffix;
+        }
+    }
+    auto r_mid = r.subspan(prefix, r.size() - prefix - suffix);
+    auto v_mid = v.subspan(prefix, v.size() - prefix - suffix);
+    // A persisted coarse index describes all of R, not its middle.
+    if (r_mid.size() != r.size()) { opts.ref_index = nullptr; }
+    if (stats) {
+        stats->trim_prefix = prefix;
+        stats->trim_suffix = suffix;
+        stats->r_size = r_mid.size();
+        stats->v_size = v_mid.size();
+        stats->seed_len = opts.p;
+        stats->memory_limit = opts.memory_limit;
+    }
 
+    PhaseTimer t_algo;
+    std::vector<Command> middle;
     switch (algo) {
     case Algorithm::Greedy:
-        return diff_greedy(r, v, opts);
+        middle = diff_greedy(r_mid, v_mid, opts);
+        break;
     case Algorithm::Onepass:
-        return diff_onepass(r, v, opts);
+        middle = diff_onepass(r_mid, v_mid, opts);
+        break;
     case Algorithm::Correcting:
-        return diff_correcting(r, v, opts);
+        middle = diff_correcting(r_mid, v_mid, opts);
+        break;
+    case Algorithm::Hierarchical:
+        middle = diff_hierarchical(r_mid, v_mid, opts);
+        break;
+    case Algorithm::Best:
+        middle = diff_best(r_mid, v_mid,
+                           best_candidates(opts, r_mid.size()), opts).commands;
+        break;
     }
-    __builtin_unreachable();
-}
+    if (stats) { stats->diff_time = t_algo.elapsed(); }
 
-/// Shared verbose stats: result summary + copy length distribution.
-void print_command_stats(const std::vector<Command>& commands) {
-    std::vector<size_t> copy_lens;
-    size_t total_copy = 0, total_add = 0, num_copies = 0, num_adds = 0;
-    for (const auto& cmd : commands) {
-        if (auto* c = std::get_if<CopyCmd>(&cmd)) {
-            total_copy += c->length; ++num_copies;
-            copy_lens.push_back(c->length);
-        } else if (auto* a = std::get_if<AddCmd>(&cmd)) {
-            total_add += a->data.size(); ++num_adds;
+    std::vector<Command> commands;
+    if (prefix == 0 && suffix == 0) {
+        commands = std::move(middle);
+    } else {
+        commands.reserve(middle.size() + 2);
+        if (prefix > 0) { commands.emplace_back(CopyCmd{0, prefix}); }
+        for (auto& cmd : middle) {
+            if (auto* c = std::get_if<CopyCmd>(&cmd)) { c->offset += prefix; }
+            commands.push_back(std::move(cmd));
         }
+        if (suffix > 0) {
+            commands.emplace_back(CopyCmd{r.size() - suffix, suffix});
+        }
+    }
+
+    // Optional post-passes (postpass.h).
+    if (opts.rematch && !dl.expired()) {
+        commands = rematch_adds(r, std::move(commands), opts);
     }
-    size_t total_out = total_copy + total_add;
-    double copy_pct = total_out > 0
-        ? static_cast<double>(total_copy) / total_out * 100.0 : 0.0;
-    std::fprintf(stderr,
-        "  result: %zu copies (%zu bytes), %zu adds (%zu bytes)\n"
-        "  result: copy coverage %.1f%%, output %zu bytes\n",
-        num_copies, total_copy, num_adds, total_add, copy_pct, total_out);
-    if (!copy_lens.empty()) {
-        std::sort(copy_lens.begin(), copy_lens.end());
-        double mean = static_cast<double>(total_copy) / copy_lens.size();
-        size_t median = copy_lens[copy_lens.size() / 2];
-        std::fprintf(stderr,
-            "  copies: %zu regions, min=%zu max=%zu mean=%.1f median=%zu bytes\n",
-            copy_lens.size(), copy_lens.front(), copy_lens.back(),
-            mean, median);
+    if (opts.optimize && !dl.expired()) {
+        PhaseTimer t_opt;
+        if (stats) {
+            stats->optimized = true;
+            stats->optimize_commands_before = commands.size();
+            stats->optimize_cost_before = encoded_cost(commands);
+        }
+        commands = optimize_commands(r, std::move(commands));
+        if (stats) {
+            stats->optimize_cost_after = encoded_cost(commands);
+            stats->optimize = t_opt.elapsed();
+        }
     }
+    if (stats) { record_result(*stats, commands); }
+    if (verbose) { print_diff_stats(*stats); }
+    return commands;
 }
 
 } // namespace delta
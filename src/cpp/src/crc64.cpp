@@ -1,4 +1,5 @@
 #include "delta/crc64.h"
+#include "delta/trace.h"
 
 #include <bit>
 #include <cstdint>
@@ -7,34 +8,58 @@ namespace delta {
 
 namespace {
 
-// Build the 256-entry CRC-64/XZ lookup table at first call.
+// Build the 256-entry CRC-64/XZ lookup table at first call (thread-safe
+// static initialization; CRCs run on worker threads).
 // Reflected poly: 0xC96C5795D7870F42 (normal form: 0x42F0E1EBA9EA3693).
 const uint64_t* crc_table() {
-    static uint64_t table[256] = {};
-    static bool initialised = false;
-    if (!initialised) {
+    static const std::array<uint64_t, 256> table = [] {
+        std::array<uint64_t, 256> t{};
         const uint64_t poly = 0xC96C5795D7870F42ULL;
         for (int i = 0; i < 256; ++i) {
             uint64_t crc = static_cast<uint64_t>(i);
             for (int j = 0; j < 8; ++j) {
                 crc = (crc & 1) ? (crc >> 1) ^ poly : (crc >> 1);
             }
-            table[i] = crc;
+            t[i] = crc;
         }
-        initialised = true;
+        return t;
+    }();
+    return table.data();
+}
+
+// GF(2) 64x64 matrix helpers for crc64_xz_combine (zlib's crc32_combine
+// scheme): mat[n] is the image of bit n.
+uint64_t gf2_times(const uint64_t* mat, uint64_t vec) {
+    uint64_t sum = 0;
+    for (; vec; vec >>= 1, ++mat) {
+        if (vec & 1) { sum ^= *mat; }
     }
-    return table;
+    return sum;
+}
+
+void gf2_square(uint64_t* square, const uint64_t* mat) {
+    for (int n = 0; n < 64; ++n) { square[n] = gf2_times(mat, mat[n]); }
+}
+
+uint64_t load_be(const std::array<uint8_t, DELTA_CRC_SIZE>& b) {
+    uint64_t v = 0;
+    for (uint8_t x : b) { v = (v << 8) | x; }
+    return v;
 }
 
 } // anonymous namespace
 
-std::array<uint8_t, DELTA_CRC_SIZE> crc64_xz(const uint8_t* data, size_t len) {
+void Crc64Xz::update(const uint8_t* data, size_t len) {
     const uint64_t* t = crc_table();
-    uint64_t crc = 0xFFFFFFFFFFFFFFFFULL;
+    uint64_t crc = state_;
     for (size_t i = 0; i < len; ++i) {
         crc = t[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
     }
-    uint64_t val = crc ^ 0xFFFFFFFFFFFFFFFFULL;
+    state_ = crc;
+}
+
+std::array<uint8_t, DELTA_CRC_SIZE> Crc64Xz::digest() const {
+    uint64_t val = state_ ^ 0xFFFFFFFFFFFFFFFFULL;
 
     // Store big-endian
     std::array<uint8_t, DELTA_CRC_SIZE> out;
@@ -44,4 +69,43 @@ std::array<uint8_t, DELTA_CRC_SIZE> crc64_xz(const uint8_t* data, size_t len) {
     return out;
 }
 
+std::array<uint8_t, DELTA_CRC_SIZE> crc64_xz(const uint8_t* data, size_t len) {
+    TraceSpan tr_crc("crc64", "phase", "bytes", len);
+    Crc64Xz crc;
+    crc.update(data, len);
+    return crc.digest();
+}
+
+std::array<uint8_t, DELTA_CRC_SIZE> crc64_xz_combine(
+    const std::array<uint8_t, DELTA_CRC_SIZE>& crc_a,
+    const std::array<uint8_t, DELTA_CRC_SIZE>& crc_b,
+    uint64_t len_b) {
+    uint64_t crc1 = load_be(crc_a);
+    if (len_b > 0) {
+        // Apply len_b zero bytes to crc1 by repeated squaring of the
+        // one-zero-bit operator; the init/xorout terms cancel.
+        uint64_t odd[64], even[64];
+        odd[0] = 0xC96C5795D7870F42ULL;
+        uint64_t row = 1;
+        for (int n = 1; n < 64; ++n) { odd[n] = row; row <<= 1; }
+        gf2_square(even, odd); // 2 zero bits
+        gf2_square(odd, even); // 4 zero bits
+        do {
+            gf2_square(even, odd);
+            if (len_b & 1) { crc1 = gf2_times(even, crc1); }
+            len_b >>= 1;
+            if (!len_b) { break; }
+            gf2_square(odd, even);
+            if (len_b & 1) { crc1 = gf2_times(odd, crc1); }
+            len_b >>= 1;
+        } while (len_b);
+    }
+    uint64_t val = crc1 ^ load_be(crc_b);
+    std::array<uint8_t, DELTA_CRC_SIZE> out;
+    for (size_t i = 0; i < DELTA_CRC_SIZE; ++i) {
+        out[i] = static_cast<uint8_t>((val >> (56 - 8 * i)) & 0xFF);
+    }
+    return out;
+}
+
 } // namespace delta
@@ -0,0 +1,218 @@
+#include "delta/crc_cache.h"
+#include "delta/crc64.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <utility>
+#include <vector>
+
+// POSIX open / fstat / pread
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace delta {
+
+namespace {
+
+constexpr size_t RECORD_SIZE = 5 * 8 + DELTA_CRC_SIZE;
+
+void write_be(std::vector<uint8_t>& out, uint64_t val, size_t n) {
+    for (size_t i = n; i-- > 0;) {
+        out.push_back(static_cast<uint8_t>(val >> (8 * i)));
+    }
+}
+
+uint64_t read_be(const uint8_t* p, size_t n) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < n; ++i) { val = (val << 8) | p[i]; }
+    return val;
+}
+
+using Crc = std::array<uint8_t, DELTA_CRC_SIZE>;
+
+void put_record(std::vector<uint8_t>& out, const FileIdentity& id, const Crc& crc) {
+    write_be(out, id.dev, 8);
+    write_be(out, id.ino, 8);
+    write_be(out, id.size, 8);
+    write_be(out, id.mtime_ns, 8);
+    write_be(out, id.ctime_ns, 8);
+    out.insert(out.end(), crc.begin(), crc.end());
+}
+
+using Record = std::pair<FileIdentity, Crc>;
+
+/// The whole records in data, oldest first.
+std::vector<Record> parse_records(const uint8_t* data, size_t size) {
+    std::vector<Record> out;
+    for (size_t pos = 0; pos + RECORD_SIZE <= size; pos += RECORD_SIZE) {
+        const uint8_t* p = data + pos;
+        FileIdentity id{read_be(p, 8), read_be(p + 8, 8), read_be(p + 16, 8),
+                        read_be(p + 24, 8), read_be(p + 32, 8)};
+        Crc crc;
+        std::memcpy(crc.data(), p + 40, DELTA_CRC_SIZE);
+        out.emplace_back(id, crc);
+    }
+    return out;
+}
+
+/// Every record in the cache file, oldest first; empty if unreadable.
+std::vector<Record> read_records(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    std::vector<uint8_t> data{std::istreambuf_iterator<char>(f), {}};
+    if (data.size() < sizeof(CRC_CACHE_MAGIC)
+        || std::memcmp(data.data(), CRC_CACHE_MAGIC, sizeof(CRC_CACHE_MAGIC)) != 0) {
+        return {};
+    }
+    return parse_records(data.data() + sizeof(CRC_CACHE_MAGIC),
+                         data.size() - sizeof(CRC_CACHE_MAGIC));
+}
+
+uint64_t to_ns(const timespec& ts) {
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL
+         + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+FileIdentity identity_of(const struct stat& st) {
+    return FileIdentity{static_cast<uint64_t>(st.st_dev),
+                        static_cast<uint64_t>(st.st_ino),
+                        static_cast<uint64_t>(st.st_size),
+                        to_ns(st.st_mtim), to_ns(st.st_ctim)};
+}
+
+} // anonymous namespace
+
+std::optional<FileIdentity> file_identity(const std::string& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) < 0) { return std::nullopt; }
+    return identity_of(st);
+}
+
+std::optional<FileIdentity> file_identity(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) < 0) { return std::nullopt; }
+    return identity_of(st);
+}
+
+std::string CrcCache::default_path() {
+    if (const char* p = std::getenv("DELTA_CRC_CACHE"); p && *p) { return p; }
+    if (const char* p = std::getenv("XDG_CACHE_HOME"); p && *p) {
+        return std::string(p) + "/delta/crc64";
+    }
+    if (const char* p = std::getenv("HOME"); p && *p) {
+        return std::string(p) + "/.cache/delta/crc64";
+    }
+    return ".delta-crc64";
+}
+
+void CrcCache::refresh() const {
+    int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    auto file = fd >= 0 ? file_identity(fd) : std::nullopt;
+    bool same = file && loaded_id_ && file->dev == loaded_id_->dev
+             && file->ino == loaded_id_->ino && file->size >= loaded_end_;
+    if (!same) {
+        // First load, or the file was compacted (renamed over) or removed.
+        entries_.clear();
+        loaded_id_ = file;
+        loaded_end_ = 0;
+    }
+    if (file && file->size > loaded_end_) {
+        std::vector<uint8_t> data(file->size - loaded_end_);
+        ssize_t n = ::pread(fd, data.data(), data.size(), static_cast<off_t>(loaded_end_));
+        size_t got = n > 0 ? static_cast<size_t>(n) : 0;
+        size_t skip = 0;
+        if (loaded_end_ == 0) {
+            if (got < sizeof(CRC_CACHE_MAGIC)
+                || std::memcmp(data.data(), CRC_CACHE_MAGIC, sizeof(CRC_CACHE_MAGIC)) != 0) {
+                got = 0; // not a cache file (yet); read as empty
+            } else {
+                skip = sizeof(CRC_CACHE_MAGIC);
+            }
+        }
+        if (got > skip) {
+            // A record still being appended is left for the next refresh.
+            size_t whole = (got - skip) / RECORD_SIZE * RECORD_SIZE;
+            for (auto& rec : parse_records(data.data() + skip, whole)) {
+                entries_[{rec.first.dev, rec.first.ino}] = rec;
+            }
+            loaded_end_ += skip + whole;
+        }
+    }
+    if (fd >= 0) { ::close(fd); }
+}
+
+std::optional<Crc> CrcCache::lookup(const FileIdentity& id) const {
+    std::lock_guard lock(mu_);
+    refresh();
+    auto it = entries_.find({id.dev, id.ino});
+    if (it != entries_.end() && it->second.first == id) { return it->second.second; }
+    return std::nullopt;
+}
+
+void CrcCache::store(const FileIdentity& id, const Crc& crc) const {
+    std::error_code ec;
+    auto dir = std::filesystem::path(path_).parent_path();
+    if (!dir.empty()) { std::filesystem::create_directories(dir, ec); }
+
+    auto size = std::filesystem::file_size(path_, ec);
+    bool fresh = ec || size < sizeof(CRC_CACHE_MAGIC);
+    if (!fresh && (size - sizeof(CRC_CACHE_MAGIC)) / RECORD_SIZE >= CRC_CACHE_MAX_RECORDS) {
+        // Compact: keep the newest record per (dev, ino), this one
+        // included, and of those only the CRC_CACHE_LOW_WATER most
+        // recently stored, so the file shrinks even when every record
+        // is for a different file.
+        auto records = read_records(path_);
+        records.emplace_back(id, crc);
+        std::set<std::pair<uint64_t, uint64_t>> seen;
+        std::vector<Record> keep;
+        for (auto it = records.rbegin();
+             it != records.rend() && keep.size() < CRC_CACHE_LOW_WATER; ++it) {
+            if (seen.insert({it->first.dev, it->first.ino}).second) { keep.push_back(*it); }
+        }
+        std::vector<uint8_t> out(CRC_CACHE_MAGIC, CRC_CACHE_MAGIC + sizeof(CRC_CACHE_MAGIC));
+        for (auto it = keep.rbegin(); it != keep.rend(); ++it) {
+            put_record(out, it->first, it->second);
+        }
+        auto tmp = path_ + ".tmp";
+        std::ofstream(tmp, std::ios::binary | std::ios::trunc)
+            .write(reinterpret_cast<const char*>(out.data()),
+                   static_cast<std::streamsize>(out.size()));
+        std::filesystem::rename(tmp, path_, ec);
+        return;
+    }
+
+    // One small append per store; concurrent writers append whole records.
+    std::vector<uint8_t> out;
+    if (fresh) { out.assign(CRC_CACHE_MAGIC, CRC_CACHE_MAGIC + sizeof(CRC_CACHE_MAGIC)); }
+    put_record(out, id, crc);
+    std::ofstream(path_, std::ios::binary | (fresh ? std::ios::trunc : std::ios::app))
+        .write(reinterpret_cast<const char*>(out.data()),
+               static_cast<std::streamsize>(out.size()));
+}
+
+Crc cached_file_crc(const CrcCache& cache, int fd,
+                    std::span<const uint8_t> data, bool* hit) {
+    auto before = file_identity(fd);
+    if (before && before->size == data.size()) {
+        if (auto crc = cache.lookup(*before)) {
+            if (hit) { *hit = true; }
+            return *crc;
+        }
+    }
+    if (hit) { *hit = false; }
+    auto crc = crc64_xz(data.data(), data.size());
+    auto now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    if (before && before->size == data.size() && file_identity(fd) == before
+        && before->ctime_ns + CRC_CACHE_SETTLE_NS <= now) {
+        cache.store(*before, crc);
+    }
+    return crc;
+}
+
+} // namespace delta
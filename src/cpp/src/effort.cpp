@@ -0,0 +1,70 @@
+#include "delta/algorithm.h"
+#include "delta/hash.h"
+
+#include <algorithm>
+#include <string>
+
+namespace delta {
+
+/// Effort levels, cheapest first.  Level 1 trims the common prefix and
+/// suffix and runs only hierarchical's coarse pass, indexing every 4th
+/// 1 KB block of R; 2-4 use the full hierarchical coarse/fine scan; 5-9 run correcting, ending with a table large enough
+/// that every seed passes the checkpoint filter (m = 1) plus gap
+/// re-matching.
+EffortPreset effort_preset(int level, size_t r_size) {
+    if (level < MIN_EFFORT || level > MAX_EFFORT) {
+        throw DeltaError("effort level must be in 1.." +
+                         std::to_string(MAX_EFFORT) + ", got " +
+                         std::to_string(level));
+    }
+
+    DiffOptions o;
+    switch (level) {
+    case 1:
+        o.trim = true;
+        o.coarse_p = 4 * COARSE_SEED_LEN;
+        o.coarse_thin = 4;
+        o.fine_pass = false;
+        return {Algorithm::Hierarchical, o, "trim + hierarchical coarse only, 1 KB seeds"};
+    case 2:
+        o.trim = true;
+        return {Algorithm::Hierarchical, o, "trim + hierarchical"};
+    case 3:
+        o.trim = true;
+        o.optimize = true;
+        return {Algorithm::Hierarchical, o, "trim + hierarchical + optimize"};
+    case 4:
+        o.trim = true;
+        o.rematch = true;
+        o.optimize = true;
+        return {Algorithm::Hierarchical, o,
+                "trim + hierarchical + rematch + optimize"};
+    case 5:
+        o.max_table = TABLE_SIZE;
+        o.optimize = true;
+        return {Algorithm::Correcting, o, "correcting, table <= 2^20 + optimize"};
+    case 6:
+        o.optimize = true;
+        return {Algorithm::Correcting, o, "correcting + optimize"};
+    case 7:
+        o.rematch = true;
+        o.optimize = true;
+        return {Algorithm::Correcting, o, "correcting + rematch + optimize"};
+    default: {
+        // Full table: |C| >= |F| = 2 * num_seeds, so m = 1 and every R
+        // seed is a checkpoint (bounded by the usual MAX_TABLE_SIZE).
+        size_t num_seeds = (r_size >= o.p) ? (r_size - o.p + 1) : 0;
+        o.q = std::min(MAX_TABLE_SIZE,
+                       std::max(TABLE_SIZE, next_prime(2 * num_seeds)));
+        o.optimize = true;
+        if (level == 8) {
+            return {Algorithm::Correcting, o, "correcting full table + optimize"};
+        }
+        o.rematch = true;
+        return {Algorithm::Correcting, o,
+                "correcting full table + rematch + optimize"};
+    }
+    }
+}
+
+} // namespace delta
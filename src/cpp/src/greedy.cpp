@@ -1,9 +1,13 @@
 #include "delta/algorithm.h"
+#include "delta/deadline.h"
+#include "delta/race.h"
 #include "delta/hash.h"
+#include "delta/memory.h"
 #include "delta/splay.h"
+#include "delta/stats.h"
+#include "delta/trace.h"
 
 #include <algorithm>
-#include <cstdio>
 #include <cstring>
 #include <numeric>
 #include <optional>
@@ -12,6 +16,24 @@
 
 namespace delta {
 
+namespace {
+
+/// Heap per indexed seed of R (map node, bucket and offset list), as
+/// measured with the tracking allocator on distinct seeds.
+constexpr size_t GREEDY_SEED_BYTES = 60;
+
+/// The index's footprint for memory.h, charged once after the build:
+/// routing every node and offset list through TrackingAllocator would
+/// put the counters' atomics on the build loop.
+size_t greedy_table_bytes(const std::unordered_map<uint64_t, std::vector<size_t>>& h,
+                          size_t offsets) {
+    using Node = std::pair<const uint64_t, std::vector<size_t>>;
+    return h.size() * (sizeof(Node) + sizeof(void*)) + h.bucket_count() * sizeof(void*)
+        + offsets * sizeof(size_t);
+}
+
+} // anonymous namespace
+
 /// Greedy algorithm (Section 3.1, Figure 2).
 std::vector<Command> diff_greedy(
     std::span<const uint8_t> r,
@@ -19,40 +41,62 @@ std::vector<Command> diff_greedy(
     const DiffOptions& opts) {
 
     auto p = opts.p;
-    bool verbose = opts.verbose;
     bool use_splay = opts.use_splay;
 
     std::vector<Command> commands;
     if (v.empty()) { return commands; }
 
+    // Under a time budget or memory limit, an unfinished R index is still
+    // valid (later seeds are simply not found); an unfinished scan ends
+    // in an add.
+    Deadline dl(opts);
+    CostMeter meter(opts);
+    size_t indexed = 0, steps = 0, expired_at = v.size();
+    StatCounter n_positions = 0, n_lookups = 0, n_matches = 0;
+    Histogram extension, probes;
+    PhaseTimer t_build;
+    TraceSpan tr_build("build");
+
     // Step (1): Build lookup structure for R keyed by full fingerprint.
-    // Hash table (default) or splay tree (--splay).
+    // Hash table (default) or splay tree (--splay).  Under a memory limit,
+    // every thin-th seed is indexed, spread over all of R as correcting's
+    // checkpoints are.
     SplayTree<std::vector<size_t>> splay_r;
     std::unordered_map<uint64_t, std::vector<size_t>> h_r;
+    MemoryCharge charge;
+    size_t thin = 1, stored = 0;
 
     if (r.size() >= p) {
-        RollingHash rh(r, 0, p);
-        if (use_splay) {
-            splay_r.insert_or_get(rh.value(), {}).push_back(0);
-        } else {
-            h_r[rh.value()].push_back(0);
+        size_t num_seeds = r.size() - p + 1;
+        if (opts.memory_limit > 0) {
+            size_t budget = std::max<size_t>(opts.memory_limit / GREEDY_SEED_BYTES, 1);
+            thin = (num_seeds + budget - 1) / budget;
         }
-        for (size_t a = 1; a <= r.size() - p; ++a) {
-            rh.roll(r[a - 1], r[a + p - 1]);
+        RollingHash rh(r, 0, p);
+        for (size_t a = 0; a < num_seeds; ++a) {
+            if (a > 0) {
+                if (dl.enabled() && a % DEADLINE_CHECK_INTERVAL == 0
+                    && dl.expired()) {
+                    break;
+                }
+                rh.roll(r[a - 1], r[a + p - 1]);
+            }
+            indexed = a + 1;
+            if (a % thin != 0) { continue; }
+            ++stored;
             if (use_splay) {
                 splay_r.insert_or_get(rh.value(), {}).push_back(a);
             } else {
                 h_r[rh.value()].push_back(a);
             }
         }
+        charge.set(use_splay ? stored * sizeof(size_t) : greedy_table_bytes(h_r, stored));
     }
 
-    if (verbose) {
-        std::fprintf(stderr,
-            "greedy: %s, |R|=%zu, |V|=%zu, seed_len=%zu\n",
-            use_splay ? "splay tree" : "hash table",
-            r.size(), v.size(), p);
-    }
+    PhaseTime build_time = t_build.elapsed();
+    tr_build.end();
+    PhaseTimer t_scan;
+    TraceSpan tr_scan("scan");
 
     // Step (2): initialize scan pointers
     size_t v_c = 0;
@@ -66,6 +110,16 @@ std::vector<Command> diff_greedy(
     for (;;) {
         // Step (3): check for end of V
         if (v_c + p > v.size()) { break; }
+        ++n_positions;
+
+        // Each greedy step may verify many candidates: check often.
+        if (++steps % 256 == 0) {
+            meter.check(commands);
+            if (dl.expired()) {
+                expired_at = v_c;
+                break;
+            }
+        }
 
         uint64_t fp_v;
         if (v_c == rh_v_pos) {
@@ -93,8 +147,10 @@ std::vector<Command> diff_greedy(
         }
 
         if (offsets) {
+            probes.record(offsets->size());
             for (size_t r_cand : *offsets) {
                 // Verify the seed actually matches
+                ++n_lookups;
                 if (std::memcmp(&r[r_cand], &v[v_c], p) != 0) { continue; }
                 size_t ml = p;
                 while (v_c + ml < v.size() && r_cand + ml < r.size()
@@ -113,6 +169,9 @@ std::vector<Command> diff_greedy(
             continue;
         }
 
+        ++n_matches;
+        extension.record(best_len - p);
+
         // Step (6): encode
         if (v_s < v_c) {
             commands.emplace_back(AddCmd{
@@ -131,10 +190,36 @@ std::vector<Command> diff_greedy(
             std::vector<uint8_t>(v.begin() + v_s, v.end())});
     }
 
-    if (verbose) {
-        print_command_stats(commands);
+    // Called directly with opts.verbose: fill local stats to print.
+    DiffStats verbose_stats;
+    DiffStats* stats = opts.stats ? opts.stats : opts.verbose ? &verbose_stats : nullptr;
+    if (stats) {
+        auto& st = *stats;
+        st.algorithm = "greedy";
+        st.table_kind = use_splay ? "splay tree" : "hash table";
+        st.table_entries = use_splay ? splay_r.size() : h_r.size();
+        st.build_seeds = indexed;
+        st.build_stored = stored;
+        st.scan_positions = n_positions;
+        st.scan_lookups = n_lookups;
+        st.scan_matches = n_matches;
+        st.budget = dl.enabled() || opts.memory_limit > 0;
+        st.build_thin = thin;
+        st.build_indexed = indexed;
+        if (expired_at < v.size()) { st.scan_stopped_at = expired_at; }
+        st.match_extension = extension;
+        st.probe_lengths = probes;
+        if (!use_splay) {
+            st.bucket_occupancy = Histogram();
+            for (const auto& [fp, offs] : h_r) {
+                st.bucket_occupancy.record(offs.size());
+            }
+        }
+        st.build = build_time;
+        st.scan = t_scan.elapsed();
     }
 
+    if (opts.verbose) { print_command_stats(commands, stats); }
     return commands;
 }
 
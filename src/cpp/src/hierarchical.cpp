@@ -0,0 +1,286 @@
+#include "delta/algorithm.h"
+#include "delta/deadline.h"
+#include "delta/hash.h"
+#include "delta/postpass.h"
+#include "delta/race.h"
+#include "delta/ref_index.h"
+#include "delta/seed_index.h"
+#include "delta/stats.h"
+#include "delta/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace delta {
+
+/// Under a time budget the coarse stride grows to at most this multiple.
+static constexpr size_t MAX_THIN = 64;
+
+/// Hierarchical two-resolution algorithm.
+std::vector<Command> diff_hierarchical(
+    std::span<const uint8_t> r,
+    std::span<const uint8_t> v,
+    const DiffOptions& opts) {
+
+    auto p = opts.p;
+    size_t cp = std::max(opts.coarse_p, p);
+
+    std::vector<Command> commands;
+    if (v.empty()) { return commands; }
+
+    // ── Coarse pass: sparse index of aligned long seeds in R ────────
+    // Any common substring of length >= cp + stride - 1 contains an
+    // aligned R seed, so long copies are always found.  The stride grows
+    // in multiples of cp only if max_table cannot hold every block.  A
+    // persisted index (ref_index.h) keeps that property without
+    // alignment and saves hashing R.
+    const RefIndex* pre = opts.ref_index;
+    if (pre && (pre->seed_len != cp || pre->ref_size != r.size())) {
+        throw DeltaError("reference index does not match the reference "
+                         "(seed length or size differs)");
+    }
+    size_t stride = pre ? pre->stride : coarse_stride(r.size(), opts);
+
+    // ── Time budget (deadline.h) ────────────────────────────────────
+    // As in correcting: the build may use half the remaining budget and
+    // the scan 90% of what is left after it, the rest going to a onepass
+    // tail and the fine pass.  A build projected to overrun at the rate
+    // measured since the last adjustment doubles the stride from the next
+    // aligned block on (up to MAX_THIN times), until a doubling no longer
+    // speeds it up (page faults on R cost the same at any stride).  Out
+    // of time, it stops indexing.
+    Deadline dl(opts);
+    size_t build_thin = 1, build_stop = r.size();
+
+    PhaseTimer t_build;
+    TraceSpan tr_build("build");
+    Deadline build_dl = dl.share(0.5);
+    SeedIndex coarse;
+    if (pre) {
+        coarse.reset(pre->seeds.size());
+        for (size_t i = 0; i < pre->seeds.size(); ++i) {
+            const auto& s = pre->seeds[i];
+            if (dl.enabled() && i > 0 && i % DEADLINE_CHECK_INTERVAL == 0
+                && build_dl.expired()) {
+                build_stop = s.offset;
+                break;
+            }
+            coarse.insert(s.fp, s.offset);
+        }
+    } else {
+        coarse.reset(r.size() / stride);
+        auto adj_time = Deadline::Clock::now();
+        size_t adj_a = 0;
+        double adj_rate = 0; // seconds per R byte before the last doubling
+        bool thin_pays = true;
+        // Each insert hashes cp bytes; poll every DEADLINE_CHECK_INTERVAL
+        // bytes hashed, not inserts, or one interval would span 16 MB of R.
+        size_t check_every = std::max<size_t>(DEADLINE_CHECK_INTERVAL / cp, 1);
+        size_t inserts = 0;
+        for (size_t a = 0; a + cp <= r.size(); a += stride) {
+            if (dl.enabled() && inserts > 0 && inserts % check_every == 0) {
+                if (build_dl.expired()) { build_stop = a; break; }
+                auto now = Deadline::Clock::now();
+                double rate = std::chrono::duration<double>(now - adj_time).count()
+                    / static_cast<double>(a - adj_a);
+                if (adj_rate > 0) {
+                    if (rate > 0.9 * adj_rate) { thin_pays = false; }
+                    adj_rate = 0;
+                }
+                if (thin_pays && build_thin < MAX_THIN
+                    && rate * static_cast<double>(r.size() - a) > build_dl.remaining()) {
+                    adj_rate = rate;
+                    adj_time = now;
+                    stride *= 2;
+                    build_thin *= 2;
+                    a = (a + stride - 1) / stride * stride; // keep seeds aligned
+                    adj_a = a;
+                    if (a + cp > r.size()) { break; }
+                }
+            }
+            coarse.insert(fingerprint(r, a, cp), a);
+            ++inserts;
+        }
+    }
+
+    PhaseTime build_time = t_build.elapsed();
+    tr_build.end();
+    PhaseTimer t_scan;
+    TraceSpan tr_scan("scan");
+
+    Deadline scan_dl = dl.share(0.9);
+    size_t next_check = DEADLINE_CHECK_INTERVAL;
+    size_t stopped_at = SIZE_MAX;
+    size_t last_r_end = 0; // end of the latest copy's source
+    bool onepass_tail = false;
+    StatCounter n_positions = 0, n_lookups = 0, n_matches = 0, n_byte_mismatch = 0;
+    Histogram extension;
+
+    // Best-of-N race (race.h): copies are final, but the fine pass may
+    // still replace an add it will search, so such adds count only at
+    // the least their replacement can cost.
+    CostMeter meter(opts);
+    auto meter_cmd = [&](const Command& cmd) {
+        if (!meter.enabled()) { return; }
+        auto* a = std::get_if<AddCmd>(&cmd);
+        bool searched = a && opts.fine_pass && a->data.size() >= p && r.size() >= p;
+        meter.add(searched ? CostMeter::rematch_floor(a->data.size())
+                           : CostMeter::command_cost(cmd));
+    };
+
+    std::vector<Command> coarse_cmds;
+    size_t v_c = 0, v_s = 0;
+    std::optional<RollingHash> rh_v;
+    size_t rh_v_pos = 0;
+    if (v.size() >= cp && coarse.size() > 0) { rh_v.emplace(v, 0, cp); }
+
+    while (rh_v && v_c + cp <= v.size()) {
+        // Out of time budget: the rest of V becomes the trailing add.
+        if ((dl.enabled() || meter.enabled()) && v_c >= next_check) {
+            next_check = v_c + DEADLINE_CHECK_INTERVAL;
+            meter.check();
+            // Out of time, or past the part of R the build indexed with
+            // a full interval of V unmatched: hand over to onepass.
+            bool off_index = build_stop < r.size()
+                && last_r_end + DEADLINE_CHECK_INTERVAL >= build_stop
+                && v_c - v_s >= DEADLINE_CHECK_INTERVAL;
+            if (scan_dl.expired() || off_index) {
+                stopped_at = v_c;
+                onepass_tail = true;
+                break;
+            }
+        }
+        uint64_t fp_v;
+        if (v_c == rh_v_pos) {
+            fp_v = rh_v->value();
+        } else if (v_c == rh_v_pos + 1) {
+            rh_v->roll(v[v_c - 1], v[v_c + cp - 1]);
+            rh_v_pos = v_c;
+            fp_v = rh_v->value();
+        } else {
+            rh_v.emplace(v, v_c, cp);
+            rh_v_pos = v_c;
+            fp_v = rh_v->value();
+        }
+
+        ++n_positions;
+        ++n_lookups; // every position probes; hits are matches + byte mismatches
+        auto cand = coarse.find(fp_v);
+        if (!cand) {
+            ++v_c;
+            continue;
+        }
+        if (std::memcmp(&r[*cand], &v[v_c], cp) != 0) {
+            ++n_byte_mismatch;
+            ++v_c;
+            continue;
+        }
+        ++n_matches;
+        size_t r_off = *cand;
+
+        // Extend forwards, and backwards no further than the last copy.
+        size_t fwd = cp;
+        while (v_c + fwd < v.size() && r_off + fwd < r.size()
+               && v[v_c + fwd] == r[r_off + fwd]) {
+            ++fwd;
+        }
+        size_t bwd = 0;
+        while (v_c > v_s + bwd && r_off > bwd
+               && v[v_c - bwd - 1] == r[r_off - bwd - 1]) {
+            ++bwd;
+        }
+
+        size_t v_m = v_c - bwd;
+        size_t ml = bwd + fwd;
+        extension.record(ml - cp);
+        if (v_s < v_m) {
+            meter_cmd(coarse_cmds.emplace_back(AddCmd{
+                std::vector<uint8_t>(v.begin() + v_s, v.begin() + v_m)}));
+        }
+        meter_cmd(coarse_cmds.emplace_back(CopyCmd{r_off - bwd, ml}));
+        v_s = v_c = v_m + ml;
+        last_r_end = r_off + fwd;
+    }
+    // Out of scan budget, the rest of V goes to onepass, which needs no
+    // index build, with R starting where the last copy's source ended.
+    size_t tail_start = v_s, tail_r = 0;
+    if (onepass_tail && v_s < v.size()) {
+        for (auto it = coarse_cmds.rbegin(); it != coarse_cmds.rend(); ++it) {
+            if (auto* c = std::get_if<CopyCmd>(&*it)) {
+                tail_r = c->offset + c->length;
+                break;
+            }
+        }
+        DiffOptions tail_opts = opts;
+        tail_opts.stats = nullptr;
+        tail_opts.verbose = false;
+        tail_opts.size_bound = nullptr; // its adds are metered as above
+        dl.apply(tail_opts);
+        auto tail_cmds = diff_onepass(r.subspan(tail_r), v.subspan(v_s), tail_opts);
+        for (auto& cmd : tail_cmds) {
+            if (auto* c = std::get_if<CopyCmd>(&cmd)) { c->offset += tail_r; }
+            meter_cmd(coarse_cmds.emplace_back(std::move(cmd)));
+        }
+        v_s = v.size();
+    }
+    if (v_s < v.size()) {
+        meter_cmd(coarse_cmds.emplace_back(AddCmd{
+            std::vector<uint8_t>(v.begin() + v_s, v.end())}));
+    }
+    meter.check();
+
+    DiffStats verbose_stats;
+    DiffStats* stats = opts.stats ? opts.stats : opts.verbose ? &verbose_stats : nullptr;
+    if (stats) {
+        auto& st = *stats;
+        st.algorithm = "hierarchical";
+        st.table_kind = "seed index";
+        st.table_capacity = coarse.capacity();
+        st.table_entries = coarse.size();
+        st.coarse_len = cp;
+        st.coarse_stride = stride;
+        st.index_loaded = pre != nullptr;
+        st.coarse_copies = std::count_if(coarse_cmds.begin(), coarse_cmds.end(),
+            [](const Command& c) { return std::holds_alternative<CopyCmd>(c); });
+        st.build_seeds = coarse.size();
+        st.scan_positions = n_positions;
+        st.scan_lookups = n_lookups;
+        st.scan_matches = n_matches;
+        st.scan_byte_mismatch = n_byte_mismatch;
+        st.scan_stopped_at = stopped_at;
+        st.budget = dl.enabled();
+        st.build_thin = build_thin;
+        st.build_indexed = build_stop;
+        if (onepass_tail) {
+            st.tail_v = tail_start;
+            st.tail_r = tail_r;
+        }
+        st.match_extension = extension;
+        st.probe_lengths = Histogram();
+        coarse.for_each_probe_length([&](size_t n) { st.probe_lengths.record(n); });
+        st.build = build_time;
+        st.scan = t_scan.elapsed();
+    }
+
+    // ── Fine pass: re-match each gap against its R neighbourhood ────
+    // Every gap of at least one fine seed is searched (rematch_adds).
+    if (!opts.fine_pass) {
+        if (opts.verbose) { print_command_stats(coarse_cmds, stats); }
+        return coarse_cmds;
+    }
+    DiffOptions fine = opts;
+    fine.stats = stats;
+    fine.verbose = false;
+    dl.apply(fine);
+    fine.rematch_p = p;
+    fine.rematch_min = p;
+    commands = rematch_adds(r, std::move(coarse_cmds), fine);
+    if (opts.verbose) { print_command_stats(commands, stats); }
+
+    return commands;
+}
+
+} // namespace delta
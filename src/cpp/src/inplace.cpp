@@ -1,4 +1,6 @@
 #include "delta/inplace.h"
+#include "delta/memory.h"
+#include "delta/trace.h"
 
 #include <algorithm>
 #include <functional>
@@ -7,6 +9,10 @@
 
 namespace delta {
 
+/// CRWI digraph adjacency lists.  The outer vector is charged to
+/// MEM_GRAPH as it is allocated; the many small edge lists once built.
+using AdjList = TrackedVector<std::vector<size_t>, MEM_GRAPH>;
+
 /// Compute SCCs using iterative Tarjan's algorithm.
 ///
 /// Returns SCCs in reverse topological order (sinks first); caller reverses
@@ -15,7 +21,7 @@ namespace delta {
 /// R.E. Tarjan, "Depth-first search and linear graph algorithms,"
 /// SIAM J. Comput., 1(2):146-160, June 1972.
 static std::vector<std::vector<size_t>> tarjan_scc(
-    const std::vector<std::vector<size_t>>& adj, size_t n) {
+    const AdjList& adj, size_t n) {
 
     std::vector<size_t> index(n, SIZE_MAX); // SIZE_MAX = unvisited
     std::vector<size_t> lowlink(n, 0);
@@ -88,7 +94,7 @@ static std::vector<std::vector<size_t>> tarjan_scc(
 /// On cycle found: resets path (color=1) vertices to 0; color=2 intact.
 /// On false (acyclic): color=2 persists (scc_id filter isolates SCCs).
 static bool find_cycle_in_scc(
-    const std::vector<std::vector<size_t>>& adj,
+    const AdjList& adj,
     const std::vector<size_t>& scc,
     size_t sid,
     const std::vector<size_t>& scc_id,
@@ -151,6 +157,7 @@ std::vector<PlacedCommand> make_inplace(
     CyclePolicy policy) {
 
     if (commands.empty()) { return {}; }
+    TraceSpan tr_inplace("make_inplace", "phase", "commands", commands.size());
 
     // Step 1: compute write offsets for each command
     // copy_info: (index, src, dst, length)
@@ -181,7 +188,7 @@ std::vector<PlacedCommand> make_inplace(
     }
 
     // Step 2: build CRWI digraph
-    std::vector<std::vector<size_t>> adj(n);
+    AdjList adj(n);
 
     // O(n log n + E) sweep-line: sort writes by start, then for each read
     // interval binary-search into the sorted writes to find overlaps.
@@ -218,6 +225,11 @@ std::vector<PlacedCommand> make_inplace(
         }
     }
 
+    MemoryCharge edges(MEM_GRAPH);
+    size_t edge_slots = 0;
+    for (const auto& a : adj) { edge_slots += a.capacity(); }
+    edges.set(edge_slots * sizeof(size_t));
+
     // Step 3: Kahn topological sort with Tarjan-scoped cycle breaking.
     //
     // Global Kahn preserves the cascade effect (converting a victim decrements
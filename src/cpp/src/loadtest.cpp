@@ -0,0 +1,339 @@
+#include "delta/loadtest.h"
+#include "delta/apply.h"
+#include "delta/crc64.h"
+#include "delta/encoding.h"
+#include "delta/stats.h"
+#include "delta/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <thread>
+
+// POSIX mmap / fadvise / rusage
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace delta {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Crc = std::array<uint8_t, DELTA_CRC_SIZE>;
+
+constexpr const char* CSV_HEADER =
+    "concurrency,rate,cache,reuse_buffers,requests,errors,wall,throughput,mbps,"
+    "mean,p50,p99,p999,max,read,parse,alloc,apply,verify,minor_faults,"
+    "major_faults,voluntary_switches,involuntary_switches,peak_rss";
+
+double seconds(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double>(b - a).count();
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) { return 0; }
+    size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+class FileDescriptor {
+public:
+    explicit FileDescriptor(const std::string& path) : fd_(::open(path.c_str(), O_RDONLY)) {
+        if (fd_ < 0) { throw DeltaError("loadtest: cannot open " + path); }
+    }
+    ~FileDescriptor() { ::close(fd_); }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd_; }
+    size_t size() const {
+        struct stat st{};
+        if (::fstat(fd_, &st) < 0) { throw DeltaError("loadtest: cannot stat file"); }
+        return static_cast<size_t>(st.st_size);
+    }
+
+private:
+    int fd_;
+};
+
+/// A read-only mapping of a whole file, as `delta decode` maps R.
+class Mapping {
+public:
+    explicit Mapping(const std::string& path) {
+        FileDescriptor fd(path);
+        size_ = fd.size();
+        if (size_ == 0) { return; }
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+        if (p == MAP_FAILED) { throw DeltaError("loadtest: cannot map " + path); }
+        data_ = static_cast<const uint8_t*>(p);
+    }
+    ~Mapping() {
+        if (data_) { ::munmap(const_cast<uint8_t*>(data_), size_); }
+    }
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    std::span<const uint8_t> span() const { return {data_, size_}; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+std::vector<uint8_t> read_whole(const std::string& path) {
+    FileDescriptor fd(path);
+    std::vector<uint8_t> buf(fd.size());
+    size_t done = 0;
+    while (done < buf.size()) {
+        ssize_t n = ::read(fd.get(), buf.data() + done, buf.size() - done);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { throw DeltaError("loadtest: cannot read " + path); }
+        done += static_cast<size_t>(n);
+    }
+    return buf;
+}
+
+/// Drop the file's clean, unmapped pages from the page cache.  Advisory:
+/// pages another request has mapped stay resident.
+void evict(const std::string& path) {
+    FileDescriptor fd(path);
+    ::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_DONTNEED);
+}
+
+struct Loaded {
+    std::vector<uint8_t> reference;   // LoadCache::Memory only
+    std::vector<uint8_t> delta;       // LoadCache::Memory only
+    Crc crc{};                        // of the reference, as serve() caches it
+};
+
+struct Worker {
+    std::vector<double> latencies;
+    std::array<double, LOAD_PHASES> phases{};
+    size_t requests = 0;
+    size_t errors = 0;
+    size_t output_bytes = 0;
+    std::string first_error;
+};
+
+rusage usage() {
+    rusage ru{};
+    ::getrusage(RUSAGE_SELF, &ru);
+    return ru;
+}
+
+} // anonymous namespace
+
+LoadCache load_cache_from_name(const std::string& name) {
+    for (size_t i = 0; i < std::size(LOAD_CACHE_NAMES); ++i) {
+        if (name == LOAD_CACHE_NAMES[i]) { return static_cast<LoadCache>(i); }
+    }
+    throw DeltaError("unknown cache state '" + name + "'");
+}
+
+std::vector<LoadPair> load_corpus(const std::string& dir) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::vector<fs::path> files;
+    for (const auto& e : fs::directory_iterator(dir, ec)) {
+        if (e.is_regular_file() && e.path().extension() == ".ref") {
+            files.push_back(e.path());
+        }
+    }
+    if (ec) { throw DeltaError("loadtest: cannot list " + dir + ": " + ec.message()); }
+    std::sort(files.begin(), files.end());
+
+    std::vector<LoadPair> pairs;
+    for (const auto& f : files) {
+        auto delta = fs::path(f).replace_extension(".delta");
+        if (fs::is_regular_file(delta, ec)) {
+            pairs.push_back({f.stem().string(), f.string(), delta.string()});
+        }
+    }
+    if (pairs.empty()) { throw DeltaError("loadtest: no NAME.ref/NAME.delta pairs in " + dir); }
+    return pairs;
+}
+
+LoadResult load_run(const std::vector<LoadPair>& corpus, const LoadOptions& opts) {
+    if (corpus.empty()) { throw DeltaError("loadtest: empty corpus"); }
+    if (opts.requests == 0 && opts.duration <= 0) {
+        throw DeltaError("loadtest: need a request count or a duration");
+    }
+
+    // Setup: CRC every reference, and read or warm every file.
+    std::vector<Loaded> loaded(corpus.size());
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        auto r = read_whole(corpus[i].reference);
+        auto d = read_whole(corpus[i].delta);
+        loaded[i].crc = crc64_xz(r.data(), r.size());
+        if (opts.cache == LoadCache::Memory) {
+            loaded[i].reference = std::move(r);
+            loaded[i].delta = std::move(d);
+        }
+    }
+
+    const size_t limit = opts.requests ? opts.requests : SIZE_MAX;
+    const size_t n_workers = std::max<size_t>(opts.concurrency, 1);
+    std::vector<Worker> workers(n_workers);
+    std::atomic<size_t> next{0};
+    std::atomic<bool> stop{false};
+
+    auto request = [&](Worker& w, const LoadPair& pair, const Loaded& in,
+                       std::vector<uint8_t>& buf) {
+        auto lap = Clock::now();
+        auto phase = [&](LoadPhase p) {
+            auto now = Clock::now();
+            w.phases[p] += seconds(lap, now);
+            lap = now;
+        };
+
+        std::optional<Mapping> map;
+        std::vector<uint8_t> delta_bytes;
+        std::span<const uint8_t> r = in.reference, d = in.delta;
+        if (opts.cache != LoadCache::Memory) {
+            map.emplace(pair.reference);
+            r = map->span();
+            delta_bytes = read_whole(pair.delta);
+            d = delta_bytes;
+        }
+        phase(LOAD_READ);
+
+        auto [placed, inplace, version_size, src_crc, dst_crc] = decode_delta(d);
+        if (src_crc != in.crc) { throw DeltaError("source file does not match delta"); }
+        phase(LOAD_PARSE);
+
+        std::vector<uint8_t> fresh;
+        auto& out = opts.reuse_buffers ? buf : fresh;
+        size_t out_size = inplace ? std::max(r.size(), version_size) : version_size;
+        if (opts.reuse_buffers) {
+            out.resize(out_size);
+        } else {
+            out.assign(out_size, 0);
+        }
+        phase(LOAD_ALLOC);
+
+        if (inplace) {
+            if (!r.empty()) { std::memcpy(out.data(), r.data(), r.size()); }
+            apply_placed_inplace_to(placed, out);
+        } else {
+            apply_placed_to(r, placed, out);
+        }
+        phase(LOAD_APPLY);
+
+        if (crc64_xz(out.data(), version_size) != dst_crc) {
+            throw DeltaError("output integrity check failed");
+        }
+        phase(LOAD_VERIFY);
+        return version_size;
+    };
+
+    auto start = Clock::now();
+    auto body = [&](size_t id) {
+        trace_thread_name("loadtest worker");
+        Worker& w = workers[id];
+        std::vector<uint8_t> buf;
+        while (!stop.load(std::memory_order_relaxed)) {
+            const size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= limit) { break; }
+            const size_t k = i % corpus.size();
+            if (opts.cache == LoadCache::Cold) {
+                try {
+                    evict(corpus[k].reference);
+                    evict(corpus[k].delta);
+                } catch (const DeltaError&) {
+                    // The request itself reports the unreadable file.
+                }
+            }
+            auto due = opts.rate > 0
+                ? start + std::chrono::duration_cast<Clock::duration>(
+                      std::chrono::duration<double>(static_cast<double>(i) / opts.rate))
+                : Clock::now();
+            if (opts.duration > 0 && seconds(start, due) >= opts.duration) {
+                stop.store(true, std::memory_order_relaxed);
+                break;
+            }
+            std::this_thread::sleep_until(due);
+            ++w.requests;
+            try {
+                w.output_bytes += request(w, corpus[k], loaded[k], buf);
+                w.latencies.push_back(seconds(due, Clock::now()));
+            } catch (const std::exception& e) {
+                if (w.errors++ == 0) { w.first_error = corpus[k].name + ": " + e.what(); }
+            }
+        }
+    };
+
+    auto ru0 = usage();
+    if (n_workers == 1) {
+        body(0);
+    } else {
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < n_workers; ++t) { pool.emplace_back(body, t); }
+        for (auto& t : pool) { t.join(); }
+    }
+    auto end = Clock::now();
+    auto ru1 = usage();
+
+    LoadResult res;
+    res.concurrency = n_workers;
+    res.rate = opts.rate;
+    res.cache = LOAD_CACHE_NAMES[static_cast<size_t>(opts.cache)];
+    res.reuse_buffers = opts.reuse_buffers;
+    res.wall = seconds(start, end);
+    std::vector<double> all;
+    for (auto& w : workers) {
+        res.requests += w.requests;
+        res.errors += w.errors;
+        res.output_bytes += w.output_bytes;
+        if (res.first_error.empty()) { res.first_error = w.first_error; }
+        for (size_t p = 0; p < LOAD_PHASES; ++p) { res.phase_seconds[p] += w.phases[p]; }
+        all.insert(all.end(), w.latencies.begin(), w.latencies.end());
+    }
+    std::sort(all.begin(), all.end());
+    if (!all.empty()) {
+        double sum = 0;
+        for (double x : all) { sum += x; }
+        res.mean = sum / static_cast<double>(all.size());
+        res.max = all.back();
+    }
+    res.p50 = percentile(all, 0.50);
+    res.p99 = percentile(all, 0.99);
+    res.p999 = percentile(all, 0.999);
+    res.minor_faults = static_cast<size_t>(ru1.ru_minflt - ru0.ru_minflt);
+    res.major_faults = static_cast<size_t>(ru1.ru_majflt - ru0.ru_majflt);
+    res.voluntary_switches = static_cast<size_t>(ru1.ru_nvcsw - ru0.ru_nvcsw);
+    res.involuntary_switches = static_cast<size_t>(ru1.ru_nivcsw - ru0.ru_nivcsw);
+    res.peak_rss = peak_rss_bytes();
+    return res;
+}
+
+std::string load_csv(const std::vector<LoadResult>& results) {
+    std::string out = CSV_HEADER;
+    out += '\n';
+    char buf[768];
+    for (const auto& r : results) {
+        std::snprintf(buf, sizeof(buf),
+            "%zu,%.3f,%s,%d,%zu,%zu,%.6f,%.3f,%.3f,%.6f,%.6f,%.6f,%.6f,%.6f,"
+            "%.6f,%.6f,%.6f,%.6f,%.6f,%zu,%zu,%zu,%zu,%zu\n",
+            r.concurrency, r.rate, r.cache.c_str(), r.reuse_buffers ? 1 : 0,
+            r.requests, r.errors, r.wall, r.throughput(), r.mbps(),
+            r.mean, r.p50, r.p99, r.p999, r.max,
+            r.phase_seconds[LOAD_READ], r.phase_seconds[LOAD_PARSE],
+            r.phase_seconds[LOAD_ALLOC], r.phase_seconds[LOAD_APPLY],
+            r.phase_seconds[LOAD_VERIFY], r.minor_faults, r.major_faults,
+            r.voluntary_switches, r.involuntary_switches, r.peak_rss);
+        out += buf;
+    }
+    return out;
+}
+
+} // namespace delta
@@ -0,0 +1,128 @@
+#include "delta/memory.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace delta {
+
+namespace {
+
+constexpr int MAX_WATCHES = 64;
+
+struct Counters {
+    std::array<std::atomic<size_t>, MEM_CATEGORY_COUNT> current{}, peak{};
+    std::atomic<size_t> total{0}, total_peak{0};
+    std::atomic<uint64_t> watching{0};                 // bit i: watch i is live
+    std::array<std::atomic<size_t>, MAX_WATCHES> watch_peak{};
+};
+
+Counters& counters() {
+    static Counters c;
+    return c;
+}
+
+void raise(std::atomic<size_t>& peak, size_t v) {
+    size_t cur = peak.load(std::memory_order_relaxed);
+    while (v > cur && !peak.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+}
+
+} // anonymous namespace
+
+void memory_charge(MemCategory category, size_t bytes) {
+    auto& c = counters();
+    size_t cat = c.current[category].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    raise(c.peak[category], cat);
+    size_t total = c.total.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    raise(c.total_peak, total);
+    for (uint64_t w = c.watching.load(std::memory_order_acquire); w; w &= w - 1) {
+        raise(c.watch_peak[std::countr_zero(w)], total);
+    }
+}
+
+void memory_release(MemCategory category, size_t bytes) {
+    auto& c = counters();
+    c.current[category].fetch_sub(bytes, std::memory_order_relaxed);
+    c.total.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+MemoryUsage memory_usage() {
+    auto& c = counters();
+    MemoryUsage u;
+    for (size_t i = 0; i < MEM_CATEGORY_COUNT; ++i) {
+        u.current[i] = c.current[i].load(std::memory_order_relaxed);
+        u.peak[i] = c.peak[i].load(std::memory_order_relaxed);
+    }
+    u.total_current = c.total.load(std::memory_order_relaxed);
+    u.total_peak = c.total_peak.load(std::memory_order_relaxed);
+    return u;
+}
+
+MemoryWatch::MemoryWatch() {
+    auto& c = counters();
+    uint64_t w = c.watching.load(std::memory_order_relaxed);
+    while (~w != 0) {
+        int slot = std::countr_zero(~w);
+        if (c.watching.compare_exchange_weak(w, w | (uint64_t{1} << slot),
+                                             std::memory_order_acq_rel)) {
+            c.watch_peak[slot].store(c.total.load(std::memory_order_relaxed),
+                                     std::memory_order_relaxed);
+            slot_ = slot;
+            return;
+        }
+    }
+}
+
+MemoryWatch::~MemoryWatch() { release(); }
+
+void MemoryWatch::release() {
+    if (slot_ >= 0) {
+        counters().watching.fetch_and(~(uint64_t{1} << slot_), std::memory_order_release);
+        slot_ = -1;
+    }
+}
+
+MemoryWatch& MemoryWatch::operator=(MemoryWatch&& o) noexcept {
+    if (this != &o) {
+        release();
+        slot_ = o.slot_;
+        o.slot_ = -1;
+    }
+    return *this;
+}
+
+size_t MemoryWatch::peak() const {
+    if (slot_ < 0) { return 0; }
+    auto& c = counters();
+    // Covers a watch that has seen no allocation since it started.
+    return std::max(c.watch_peak[slot_].load(std::memory_order_relaxed),
+                    c.total.load(std::memory_order_relaxed));
+}
+
+void MemoryCharge::set(size_t bytes) {
+    if (bytes > bytes_) {
+        memory_charge(category_, bytes - bytes_);
+    } else if (bytes < bytes_) {
+        memory_release(category_, bytes_ - bytes);
+    }
+    bytes_ = bytes;
+}
+
+MemoryCharge& MemoryCharge::operator=(MemoryCharge&& o) noexcept {
+    if (this != &o) {
+        set(0);
+        category_ = o.category_;
+        bytes_ = o.bytes_;
+        o.bytes_ = 0;
+    }
+    return *this;
+}
+
+size_t table_slots(const DiffOptions& opts, size_t slot_bytes) {
+    size_t slots = opts.max_table;
+    if (opts.memory_limit > 0) {
+        slots = std::min(slots, opts.memory_limit / std::max<size_t>(slot_bytes, 1));
+    }
+    return std::max<size_t>(slots, 1);
+}
+
+} // namespace delta
@@ -1,9 +1,13 @@
 #include "delta/algorithm.h"
+#include "delta/deadline.h"
+#include "delta/race.h"
 #include "delta/hash.h"
+#include "delta/memory.h"
 #include "delta/splay.h"
+#include "delta/stats.h"
+#include "delta/trace.h"
 
 #include <algorithm>
-#include <cstdio>
 #include <cstring>
 #include <optional>
 #include <tuple>
@@ -19,43 +23,46 @@ std::vector<Command> diff_onepass(
 
     auto p = opts.p;
     auto q = opts.q;
-    bool verbose = opts.verbose;
     bool use_splay = opts.use_splay;
 
     std::vector<Command> commands;
     if (v.empty()) { return commands; }
 
-    // Auto-size hash table: one slot per p-byte chunk of R (floor = q).
-    size_t num_seeds = (r.size() >= p) ? (r.size() - p + 1) : 0;
-    q = next_prime(std::max(q, num_seeds / p));
-
-    if (verbose) {
-        std::fprintf(stderr,
-            "onepass: %s, q=%zu, |R|=%zu, |V|=%zu, seed_len=%zu\n",
-            use_splay ? "splay tree" : "hash table",
-            q, r.size(), v.size(), p);
-    }
-
     // Step (1): lookup structures with version-based logical flushing.
     // Each entry stores (offset, version).
     using SlotVal = std::pair<size_t, uint64_t>; // (offset, version)
 
     // Hash table path
     using Slot = std::optional<std::tuple<uint64_t, size_t, uint64_t>>;
-    std::vector<Slot> h_v_ht, h_r_ht;
+    TrackedVector<Slot> h_v_ht, h_r_ht;
 
     // Splay tree path
     SplayTree<SlotVal> h_v_sp, h_r_sp;
 
+    // Auto-size hash tables: one slot per p-byte chunk of R (floor = q),
+    // capped at max_table (and memory_limit, shared by the two tables).
+    size_t num_seeds = (r.size() >= p) ? (r.size() - p + 1) : 0;
+    // Under a deadline, no more than the scan can reach (deadline.h).
+    Deadline dl(opts);
+    size_t max_table = std::min(table_slots(opts, 2 * sizeof(Slot)),
+                                std::max<size_t>(dl.reach() / p, 1));
+    q = next_prime(std::min(max_table, std::max(q, num_seeds / p)));
+
+    PhaseTimer t_scan;
+    TraceSpan tr_scan("scan");
+
     if (!use_splay) {
         h_v_ht.resize(q);
         h_r_ht.resize(q);
     }
 
     uint64_t ver = 0;
+    CostMeter meter(opts);
+    bool expired = false;
+    size_t next_check = DEADLINE_CHECK_INTERVAL;
 
-    // Debug counters
-    size_t dbg_positions = 0, dbg_lookups = 0, dbg_matches = 0;
+    StatCounter n_positions = 0, n_lookups = 0, n_matches = 0;
+    Histogram extension;
 
     // Lookup/store lambdas that dispatch to either data structure.
     auto hget = [&](bool is_v_table, uint64_t fp) -> std::optional<size_t> {
@@ -106,7 +113,16 @@ std::vector<Command> diff_onepass(
         bool can_v = (v_c + p <= v.size());
         bool can_r = (r_c + p <= r.size());
         if (!can_v && !can_r) { break; }
-        ++dbg_positions;
+        ++n_positions;
+        // Out of time budget: the rest of V becomes the trailing add.
+        if (v_c >= next_check) {
+            next_check = v_c + DEADLINE_CHECK_INTERVAL;
+            meter.check(commands);
+            if (dl.expired()) {
+                expired = true;
+                break;
+            }
+        }
 
         std::optional<uint64_t> fp_v, fp_r;
         if (can_v && rh_v) {
@@ -144,7 +160,7 @@ std::vector<Command> diff_onepass(
 
         if (fp_r) {
             if (auto v_cand = hget(true, *fp_r)) {
-                ++dbg_lookups;
+                ++n_lookups;
                 if (std::memcmp(&r[r_c], &v[*v_cand], p) == 0) {
                     r_m = r_c;
                     v_m = *v_cand;
@@ -155,7 +171,7 @@ std::vector<Command> diff_onepass(
 
         if (!match_found && fp_v) {
             if (auto r_cand = hget(false, *fp_v)) {
-                ++dbg_lookups;
+                ++n_lookups;
                 if (std::memcmp(&v[v_c], &r[*r_cand], p) == 0) {
                     v_m = v_c;
                     r_m = *r_cand;
@@ -169,7 +185,7 @@ std::vector<Command> diff_onepass(
             ++r_c;
             continue;
         }
-        ++dbg_matches;
+        ++n_matches;
 
         // Step (5): extend match forward
         size_t ml = 0;
@@ -177,7 +193,7 @@ std::vector<Command> diff_onepass(
                && v[v_m + ml] == r[r_m + ml]) {
             ++ml;
         }
-
+        extension.record(ml - p);
 
         // Step (6): encode
         if (v_s < v_m) {
@@ -199,16 +215,22 @@ std::vector<Command> diff_onepass(
             std::vector<uint8_t>(v.begin() + v_s, v.end())});
     }
 
-    if (verbose) {
-        double hit_pct = dbg_lookups > 0
-            ? static_cast<double>(dbg_matches) / dbg_lookups * 100.0 : 0.0;
-        std::fprintf(stderr,
-            "  scan: %zu positions, %zu lookups, %zu matches (flushes)\n"
-            "  scan: hit rate %.1f%% (of lookups)\n",
-            dbg_positions, dbg_lookups, dbg_matches, hit_pct);
-        print_command_stats(commands);
+    DiffStats verbose_stats;
+    DiffStats* stats = opts.stats ? opts.stats : opts.verbose ? &verbose_stats : nullptr;
+    if (stats) {
+        auto& st = *stats;
+        st.algorithm = "onepass";
+        st.table_kind = use_splay ? "splay tree" : "hash table";
+        st.table_capacity = q;
+        st.scan_positions = n_positions;
+        st.scan_lookups = n_lookups;
+        st.scan_matches = n_matches;
+        if (expired) { st.scan_stopped_at = v_c; }
+        st.match_extension = extension;
+        st.scan = t_scan.elapsed();
     }
 
+    if (opts.verbose) { print_command_stats(commands, stats); }
     return commands;
 }
 
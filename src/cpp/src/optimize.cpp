@@ -0,0 +1,92 @@
+#include "delta/postpass.h"
+#include "delta/trace.h"
+
+#include <utility>
+#include <vector>
+
+namespace delta {
+
+namespace {
+
+/// Append cmd to out, merging it into the previous command when the two
+/// are R-contiguous copies or both ADDs.
+void push_merged(std::vector<Command>& out, Command cmd) {
+    if (!out.empty()) {
+        if (auto* c = std::get_if<CopyCmd>(&cmd)) {
+            auto* prev = std::get_if<CopyCmd>(&out.back());
+            if (prev && prev->offset + prev->length == c->offset) {
+                prev->length += c->length;
+                return;
+            }
+        } else {
+            auto& a = std::get<AddCmd>(cmd);
+            if (auto* prev = std::get_if<AddCmd>(&out.back())) {
+                prev->data.insert(prev->data.end(), a.data.begin(), a.data.end());
+                return;
+            }
+        }
+    }
+    out.push_back(std::move(cmd));
+}
+
+} // anonymous namespace
+
+size_t encoded_cost(const std::vector<Command>& commands, const CostModel& cost) {
+    size_t total = 0;
+    for (const auto& cmd : commands) {
+        if (std::holds_alternative<CopyCmd>(cmd)) {
+            total += cost.copy_cost;
+        } else {
+            total += cost.add_cost + std::get<AddCmd>(cmd).data.size();
+        }
+    }
+    return total;
+}
+
+std::vector<Command> optimize_commands(
+    std::span<const uint8_t> r,
+    std::vector<Command> commands,
+    const CostModel& cost) {
+
+    TraceSpan tr_optimize("optimize");
+    // Pass 1: merge R-contiguous copies and adjacent ADDs.
+    std::vector<Command> out;
+    out.reserve(commands.size());
+    for (auto& cmd : commands) { push_merged(out, std::move(cmd)); }
+
+    // Pass 2: turn copies into literals where that is no more expensive.
+    // As a literal, a copy of length L costs L plus one ADD header, less
+    // one header for each neighbouring ADD it joins.  Absorbing can make a
+    // later copy's neighbour an ADD, so repeat until nothing changes.
+    for (bool changed = true; changed;) {
+        changed = false;
+        commands = std::move(out);
+        out.clear();
+        for (size_t i = 0; i < commands.size(); ++i) {
+            auto* c = std::get_if<CopyCmd>(&commands[i]);
+            if (!c) {
+                push_merged(out, std::move(commands[i]));
+                continue;
+            }
+            bool prev_add = !out.empty()
+                && std::holds_alternative<AddCmd>(out.back());
+            bool next_add = i + 1 < commands.size()
+                && std::holds_alternative<AddCmd>(commands[i + 1]);
+            size_t joined = (prev_add ? 1 : 0) + (next_add ? 1 : 0);
+            size_t as_literal = c->length + cost.add_cost;
+            size_t saved = joined * cost.add_cost;
+            size_t literal_cost = as_literal > saved ? as_literal - saved : 0;
+            if (literal_cost < cost.copy_cost
+                || (literal_cost == cost.copy_cost && joined > 0)) {
+                push_merged(out, AddCmd{std::vector<uint8_t>(
+                    r.begin() + c->offset, r.begin() + c->offset + c->length)});
+                changed = true;
+            } else {
+                push_merged(out, std::move(commands[i]));
+            }
+        }
+    }
+    return out;
+}
+
+} // namespace delta
@@ -0,0 +1,158 @@
+#include "delta/perf.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace delta {
+
+namespace {
+
+struct EventSpec {
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+constexpr EventSpec EVENT_SPECS[PERF_EVENT_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL,
+        PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB,
+        PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+/// Process-wide counter set; opened once, never closed.
+struct Counters {
+    std::once_flag once;
+    int fd[PERF_EVENT_COUNT];
+    std::atomic<size_t> opened{0};
+    std::string error;
+};
+
+Counters& counters() {
+    static Counters c;
+    return c;
+}
+
+/// Events opened into the group led by PERF_CYCLES, if that opened.
+constexpr bool grouped(size_t e) { return e == PERF_INSTRUCTIONS; }
+
+int open_event(size_t e, int group_fd) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = EVENT_SPECS[e].type;
+    attr.config = EVENT_SPECS[e].config;
+    attr.exclude_kernel = 1; // allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group_fd,
+                                      PERF_FLAG_FD_CLOEXEC));
+}
+
+void open_counters(Counters& c) {
+    size_t opened = 0;
+    for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+        c.fd[e] = -1;
+        if (grouped(e) && c.fd[PERF_CYCLES] >= 0) {
+            c.fd[e] = open_event(e, c.fd[PERF_CYCLES]);
+        }
+        if (c.fd[e] < 0) { c.fd[e] = open_event(e, -1); } // ungrouped fallback
+        if (c.fd[e] >= 0) {
+            ++opened;
+        } else if (c.error.empty()) {
+            c.error = std::string(PERF_EVENT_NAMES[e]) + ": " + std::strerror(errno);
+        }
+    }
+    c.opened = opened; // publishes fd[] to read_perf_counters()
+}
+
+} // anonymous namespace
+
+PerfCounts& PerfCounts::operator+=(const PerfCounts& o) {
+    for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) { value[e] += o.value[e]; }
+    mask |= o.mask;
+    return *this;
+}
+
+PerfCounts operator-(const PerfCounts& later, const PerfCounts& earlier) {
+    PerfCounts d;
+    d.mask = later.mask & earlier.mask;
+    for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+        if (!((d.mask >> e) & 1)) { continue; }
+        // Raw counts and times only grow; guard anyway so a bad pair
+        // reads as zero rather than wrapping.
+        auto diff = [](uint64_t a, uint64_t b) { return a > b ? a - b : 0; };
+        uint64_t v = diff(later.value[e], earlier.value[e]);
+        uint64_t enabled = diff(later.enabled[e], earlier.enabled[e]);
+        uint64_t running = diff(later.running[e], earlier.running[e]);
+        if (running > 0 && running < enabled) {
+            v = static_cast<uint64_t>(static_cast<double>(v) * enabled / running);
+        }
+        d.value[e] = v;
+    }
+    return d;
+}
+
+size_t enable_perf_counters(std::string* error) {
+    auto& c = counters();
+    std::call_once(c.once, open_counters, c);
+    if (error) { *error = c.error; }
+    return c.opened;
+}
+
+bool perf_counters_enabled() {
+    return counters().opened > 0;
+}
+
+PerfCounts read_perf_counters() {
+    PerfCounts out;
+    auto& c = counters();
+    if (c.opened == 0) { return out; }
+    for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+        if (c.fd[e] < 0) { continue; }
+        uint64_t buf[3]; // value, time enabled, time running
+        if (::read(c.fd[e], buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf))) {
+            continue;
+        }
+        out.value[e] = buf[0];
+        out.enabled[e] = buf[1];
+        out.running[e] = buf[2];
+        out.mask |= 1u << e;
+    }
+    return out;
+}
+
+std::string format_perf_counts(const PerfCounts& counts) {
+    std::string out;
+    char buf[64];
+    for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+        if (!counts.has(static_cast<PerfEvent>(e))) { continue; }
+        std::snprintf(buf, sizeof(buf), "%s%s=%llu", out.empty() ? "" : " ",
+            PERF_EVENT_NAMES[e], static_cast<unsigned long long>(counts.value[e]));
+        out += buf;
+    }
+    if (counts.has(PERF_CYCLES) && counts.has(PERF_INSTRUCTIONS)
+        && counts.value[PERF_CYCLES] > 0) {
+        std::snprintf(buf, sizeof(buf), " IPC=%.2f",
+            static_cast<double>(counts.value[PERF_INSTRUCTIONS])
+                / counts.value[PERF_CYCLES]);
+        out += buf;
+    }
+    return out;
+}
+
+} // namespace delta
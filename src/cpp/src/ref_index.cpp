@@ -0,0 +1,146 @@
+#include "delta/ref_index.h"
+#include "delta/crc64.h"
+#include "delta/hash.h"
+#include "delta/seed_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace delta {
+
+namespace {
+
+void write_be(std::vector<uint8_t>& out, uint64_t val, size_t n) {
+    for (size_t i = n; i-- > 0;) {
+        out.push_back(static_cast<uint8_t>(val >> (8 * i)));
+    }
+}
+
+uint64_t read_be(const uint8_t* p, size_t n) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < n; ++i) { val = (val << 8) | p[i]; }
+    return val;
+}
+
+constexpr size_t HEADER = sizeof(REF_INDEX_MAGIC) + 4 + 8 + 8 + DELTA_CRC_SIZE + 8;
+
+} // anonymous namespace
+
+size_t coarse_stride(size_t r_size, const DiffOptions& opts) {
+    size_t cp = std::max(opts.coarse_p, opts.p);
+    size_t n_blocks = r_size / cp;
+    // n entries take at most 4n slots (half full, rounded up to 2^k).
+    size_t fit = std::max<size_t>(table_slots(opts, 2 * SeedIndex::slot_bytes()) / 2, 1);
+    return cp * std::max<size_t>((n_blocks + fit - 1) / fit, std::max<size_t>(opts.coarse_thin, 1));
+}
+
+RefIndex build_ref_index(std::span<const uint8_t> r, const DiffOptions& opts) {
+    RefIndex index;
+    index.seed_len = std::max(opts.coarse_p, opts.p);
+    index.stride = coarse_stride(r.size(), opts);
+    index.ref_size = r.size();
+    index.ref_crc = crc64_xz(r.data(), r.size());
+    index.seeds.reserve(r.size() / index.stride + 1);
+    for (size_t a = 0; a + index.seed_len <= r.size(); a += index.stride) {
+        index.seeds.push_back({a, fingerprint(r, a, index.seed_len)});
+    }
+    return index;
+}
+
+RefIndex update_ref_index(
+    const RefIndex& index,
+    const std::vector<PlacedCommand>& delta,
+    std::span<const uint8_t> r_new,
+    const std::array<uint8_t, DELTA_CRC_SIZE>& new_crc) {
+
+    size_t p = index.seed_len;
+    size_t stride = index.stride;
+    if (p == 0 || stride == 0) { throw DeltaError("reference index: bad parameters"); }
+
+    std::vector<PlacedCopy> copies;
+    for (const auto& cmd : delta) {
+        if (const auto* c = std::get_if<PlacedCopy>(&cmd)) {
+            if (c->src + c->length > index.ref_size || c->dst + c->length > r_new.size()) {
+                throw DeltaError("reference index: delta does not match the indexed reference");
+            }
+            copies.push_back(*c);
+        }
+    }
+    std::sort(copies.begin(), copies.end(),
+              [](const PlacedCopy& a, const PlacedCopy& b) { return a.dst < b.dst; });
+
+    RefIndex out;
+    out.seed_len = p;
+    out.stride = stride;
+    out.ref_size = r_new.size();
+    out.ref_crc = new_crc;
+    out.seeds.reserve(index.seeds.size());
+
+    // `limit` is the latest start the next seed may have; gaps the
+    // relocated seeds leave open are filled by hashing r_new there.
+    size_t limit = stride - 1;
+    auto fill_before = [&](size_t end) {
+        while (limit < end && limit + p <= r_new.size()) {
+            out.seeds.push_back({limit, fingerprint(r_new, limit, p)});
+            limit += stride;
+        }
+    };
+    for (const auto& c : copies) {
+        auto it = std::lower_bound(index.seeds.begin(), index.seeds.end(), c.src,
+            [](const RefSeed& s, size_t off) { return s.offset < off; });
+        for (; it != index.seeds.end() && it->offset + p <= c.src + c.length; ++it) {
+            size_t at = it->offset - c.src + c.dst;
+            fill_before(at);
+            out.seeds.push_back({at, it->fp});
+            limit = at + stride;
+        }
+    }
+    fill_before(r_new.size());
+    return out;
+}
+
+std::vector<uint8_t> encode_ref_index(const RefIndex& index) {
+    std::vector<uint8_t> out(REF_INDEX_MAGIC, REF_INDEX_MAGIC + sizeof(REF_INDEX_MAGIC));
+    out.reserve(HEADER + 16 * index.seeds.size());
+    write_be(out, index.seed_len, 4);
+    write_be(out, index.stride, 8);
+    write_be(out, index.ref_size, 8);
+    out.insert(out.end(), index.ref_crc.begin(), index.ref_crc.end());
+    write_be(out, index.seeds.size(), 8);
+    for (const auto& s : index.seeds) {
+        write_be(out, s.offset, 8);
+        write_be(out, s.fp, 8);
+    }
+    return out;
+}
+
+RefIndex decode_ref_index(std::span<const uint8_t> data) {
+    if (data.size() < HEADER
+        || std::memcmp(data.data(), REF_INDEX_MAGIC, sizeof(REF_INDEX_MAGIC)) != 0) {
+        throw DeltaError("not a reference index file");
+    }
+    const uint8_t* p = data.data() + sizeof(REF_INDEX_MAGIC);
+    RefIndex index;
+    index.seed_len = read_be(p, 4);
+    index.stride = read_be(p + 4, 8);
+    index.ref_size = read_be(p + 12, 8);
+    std::memcpy(index.ref_crc.data(), p + 20, DELTA_CRC_SIZE);
+    uint64_t count = read_be(p + 20 + DELTA_CRC_SIZE, 8);
+    if (index.seed_len == 0 || index.stride == 0
+        || count > (data.size() - HEADER) / 16
+        || data.size() != HEADER + 16 * count) {
+        throw DeltaError("corrupt reference index file");
+    }
+    index.seeds.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* e = data.data() + HEADER + 16 * i;
+        index.seeds[i] = {read_be(e, 8), read_be(e + 8, 8)};
+        if (index.seeds[i].offset + index.seed_len > index.ref_size
+            || (i > 0 && index.seeds[i].offset <= index.seeds[i - 1].offset)) {
+            throw DeltaError("corrupt reference index file");
+        }
+    }
+    return index;
+}
+
+} // namespace delta
@@ -0,0 +1,274 @@
+#include "delta/postpass.h"
+#include "delta/algorithm.h"
+#include "delta/deadline.h"
+#include "delta/hash.h"
+#include "delta/memory.h"
+#include "delta/race.h"
+#include "delta/seed_index.h"
+#include "delta/stats.h"
+#include "delta/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace delta {
+
+namespace {
+
+/// One ADD to re-match, with the R anchors of its neighbouring copies.
+struct Gap {
+    size_t cmd;        // index into the command stream
+    size_t prev_end;   // end of the preceding copy's source (or 0)
+    size_t next_start; // start of the following copy's source (or |R|)
+};
+
+/// Re-match one gap: index the R neighbourhood of its anchors, then scan
+/// the literal bytes with p-byte seeds, extending matches in both
+/// directions within the gap.  Returns the replacement commands.
+/// The neighbourhood reaches at most max_reach bytes from each anchor,
+/// so the index stays bounded however large the gap; the whole gap is
+/// still scanned against it.
+std::vector<Command> rematch_gap(
+    std::span<const uint8_t> r,
+    std::span<const uint8_t> g,
+    const Gap& gap,
+    size_t p,
+    size_t max_reach,
+    SeedIndex& local,
+    size_t& copies_found) {
+
+    // The gap before a copy most likely came from just before that
+    // copy's source in R, and the gap after a copy from just after it.
+    size_t slack = std::min(LOCAL_SLACK, max_reach);
+    size_t reach = std::min(g.size() + LOCAL_SLACK, max_reach);
+    std::pair<size_t, size_t> win[2] = {
+        {gap.prev_end > slack ? gap.prev_end - slack : 0,
+         std::min(r.size(), gap.prev_end + reach)},
+        {gap.next_start > reach ? gap.next_start - reach : 0,
+         std::min(r.size(), gap.next_start + slack)},
+    };
+    if (win[1].first < win[0].first) { std::swap(win[0], win[1]); }
+    size_t n_win = 2;
+    if (win[1].first <= win[0].second) {
+        win[0].second = std::max(win[0].second, win[1].second);
+        n_win = 1;
+    }
+
+    size_t n_seeds = 0;
+    for (size_t w = 0; w < n_win; ++w) {
+        n_seeds += win[w].second - win[w].first;
+    }
+    local.reset(n_seeds);
+    for (size_t w = 0; w < n_win; ++w) {
+        auto [lo, hi] = win[w];
+        if (hi - lo < p) { continue; }
+        RollingHash rh(r, lo, p);
+        local.insert(rh.value(), lo);
+        for (size_t a = lo + 1; a + p <= hi; ++a) {
+            rh.roll(r[a - 1], r[a + p - 1]);
+            local.insert(rh.value(), a);
+        }
+    }
+
+    // A copy shorter than its own encoding never pays for itself.
+    const size_t min_copy = std::max(p, 1 + DELTA_COPY_PAYLOAD);
+
+    std::vector<Command> out;
+    size_t c = 0, s = 0;
+    RollingHash rh(g, 0, p);
+    size_t rh_pos = 0;
+    while (c + p <= g.size()) {
+        if (c == rh_pos + 1) {
+            rh.roll(g[c - 1], g[c + p - 1]);
+            rh_pos = c;
+        } else if (c != rh_pos) {
+            rh = RollingHash(g, c, p);
+            rh_pos = c;
+        }
+        auto cand = local.find(rh.value());
+        if (!cand || std::memcmp(&r[*cand], &g[c], p) != 0) {
+            ++c;
+            continue;
+        }
+        size_t r_off = *cand;
+        size_t fwd = p;
+        while (c + fwd < g.size() && r_off + fwd < r.size()
+               && g[c + fwd] == r[r_off + fwd]) {
+            ++fwd;
+        }
+        size_t bwd = 0;
+        while (c > s + bwd && r_off > bwd
+               && g[c - bwd - 1] == r[r_off - bwd - 1]) {
+            ++bwd;
+        }
+        if (bwd + fwd < min_copy) {
+            ++c;
+            continue;
+        }
+        size_t m = c - bwd;
+        if (s < m) {
+            out.emplace_back(AddCmd{
+                std::vector<uint8_t>(g.begin() + s, g.begin() + m)});
+        }
+        out.emplace_back(CopyCmd{r_off - bwd, bwd + fwd});
+        ++copies_found;
+        s = c = m + bwd + fwd;
+    }
+    if (s < g.size()) {
+        out.emplace_back(AddCmd{std::vector<uint8_t>(g.begin() + s, g.end())});
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+std::vector<Command> rematch_adds(
+    std::span<const uint8_t> r,
+    std::vector<Command> commands,
+    const DiffOptions& opts) {
+
+    size_t p = std::max<size_t>(opts.rematch_p, 1);
+    size_t min_add = std::max(opts.rematch_min, p);
+    PhaseTimer t_rematch;
+    TraceSpan tr_rematch("rematch");
+
+    // Collect gaps and their anchors.  Missing neighbours anchor at the
+    // ends of R.
+    std::vector<Gap> gaps;
+    size_t gap_bytes = 0;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        auto* add = std::get_if<AddCmd>(&commands[i]);
+        if (!add || add->data.size() < min_add) { continue; }
+        Gap gap{i, 0, r.size()};
+        if (i > 0) {
+            if (auto* c = std::get_if<CopyCmd>(&commands[i - 1])) {
+                gap.prev_end = c->offset + c->length;
+            }
+        }
+        if (i + 1 < commands.size()) {
+            if (auto* c = std::get_if<CopyCmd>(&commands[i + 1])) {
+                gap.next_start = c->offset;
+            }
+        }
+        gaps.push_back(gap);
+        gap_bytes += add->data.size();
+    }
+    if (gaps.empty() || r.size() < p) { return commands; }
+
+    // Best-of-N race (race.h): meter every command but the gaps, each gap
+    // at the least its replacement can cost, then top that up as gaps are
+    // re-matched, so a losing run stops before splicing anything.
+    CostMeter meter(opts);
+    if (meter.enabled()) {
+        size_t g = 0;
+        for (size_t i = 0; i < commands.size(); ++i) {
+            if (g < gaps.size() && gaps[g].cmd == i) {
+                meter.add(CostMeter::rematch_floor(std::get<AddCmd>(commands[i]).data.size()));
+                ++g;
+            } else {
+                meter.add(CostMeter::command_cost(commands[i]));
+            }
+        }
+        meter.check();
+    }
+
+    // Gaps are independent: workers claim them from a shared counter.
+    // Under a time budget they stop claiming once it expires; unclaimed
+    // gaps keep their original add.
+    Deadline dl(opts);
+    size_t n_threads = opts.threads > 0
+        ? opts.threads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    n_threads = std::min(n_threads, gaps.size());
+
+    // Each worker's local index covers at most two windows of
+    // slack + reach seeds, at up to four slots per seed; under a memory
+    // limit the workers share it.
+    size_t max_reach = REMATCH_MAX_REACH;
+    if (opts.memory_limit > 0) {
+        DiffOptions share = opts;
+        share.memory_limit = opts.memory_limit / n_threads;
+        max_reach = std::min(max_reach, table_slots(share, 4 * SeedIndex::slot_bytes()) / 4);
+    }
+
+    std::vector<std::vector<Command>> results(gaps.size());
+    std::vector<char> done(gaps.size(), 0);
+    std::vector<size_t> copies_found(n_threads, 0);
+    std::atomic<size_t> next{0};
+    std::atomic<bool> cancelled{false};
+    std::exception_ptr cancel;
+
+    auto worker = [&](size_t t) {
+        if (n_threads > 1) { trace_thread_name("rematch worker"); }
+        TraceSpan tr_task("rematch gaps", "task", "worker", t);
+        SeedIndex local;
+        size_t copies = 0;
+        for (size_t g = next++; g < gaps.size(); g = next++) {
+            if (dl.expired() || cancelled.load(std::memory_order_relaxed)) { break; }
+            const auto& add = std::get<AddCmd>(commands[gaps[g].cmd]);
+            results[g] = rematch_gap(r, add.data, gaps[g], p, max_reach, local, copies);
+            done[g] = 1;
+            if (meter.enabled()) {
+                size_t cost = 0;
+                for (const auto& cmd : results[g]) { cost += CostMeter::command_cost(cmd); }
+                meter.add(cost - CostMeter::rematch_floor(add.data.size()));
+                try {
+                    meter.check();
+                } catch (const DiffCancelled&) {
+                    // First to see it reports it; the other workers stop.
+                    if (!cancelled.exchange(true)) { cancel = std::current_exception(); }
+                    break;
+                }
+            }
+        }
+        copies_found[t] = copies;
+    };
+
+    if (n_threads == 1) {
+        worker(0);
+    } else {
+        std::vector<std::thread> pool;
+        pool.reserve(n_threads);
+        for (size_t t = 0; t < n_threads; ++t) { pool.emplace_back(worker, t); }
+        for (auto& th : pool) { th.join(); }
+    }
+    if (cancel) { std::rethrow_exception(cancel); }
+
+    // Splice the replacements back in stream order.
+    std::vector<Command> out;
+    out.reserve(commands.size() + gaps.size());
+    size_t g = 0;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (g < gaps.size() && gaps[g].cmd == i && done[g]) {
+            for (auto& cmd : results[g]) { out.push_back(std::move(cmd)); }
+            ++g;
+        } else if (g < gaps.size() && gaps[g].cmd == i) {
+            out.push_back(std::move(commands[i]));
+            ++g;
+        } else {
+            out.push_back(std::move(commands[i]));
+        }
+    }
+
+    // Accumulated: hierarchical's fine pass and diff()'s rematch share
+    // one DiffStats.
+    if (opts.stats) {
+        auto& st = *opts.stats;
+        st.rematch_gaps += gaps.size();
+        st.rematch_gap_bytes += gap_bytes;
+        st.rematch_searched += static_cast<size_t>(std::count(done.begin(), done.end(), 1));
+        for (size_t n : copies_found) { st.rematch_copies += n; }
+        st.rematch_threads = n_threads;
+        st.rematch_min_add = min_add;
+        st.rematch_seed_len = p;
+        st.rematch += t_rematch.elapsed();
+    }
+
+    return out;
+}
+
+} // namespace delta
@@ -0,0 +1,68 @@
+#include "delta/postpass.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace delta {
+
+std::vector<Command> reverse_commands(
+    std::span<const uint8_t> r,
+    const std::vector<Command>& forward) {
+
+    // Each forward copy V[v_off, +len) = R[r_off, +len) is equally a copy
+    // of R's range from V.  Collect them as (r_off, v_off, len).
+    struct Span { size_t r_off, v_off, len; };
+    std::vector<Span> spans;
+    size_t v_pos = 0;
+    for (const auto& cmd : forward) {
+        if (const auto* c = std::get_if<CopyCmd>(&cmd)) {
+            if (c->length > 0) { spans.push_back({c->offset, v_pos, c->length}); }
+            v_pos += c->length;
+        } else {
+            v_pos += std::get<AddCmd>(cmd).data.size();
+        }
+    }
+
+    // Several V ranges may copy the same R bytes.  Sweep R in order and
+    // cover each byte once: at each point take, of the spans starting
+    // there or earlier, the one that reaches furthest, so overlapping
+    // spans cost as few copies as possible.  R bytes no forward copy
+    // used become ADDs.
+    std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+        return a.r_off != b.r_off ? a.r_off < b.r_off : a.len > b.len;
+    });
+    std::vector<Command> out;
+    size_t r_pos = 0;
+    auto add_until = [&](size_t end) {
+        if (r_pos < end) {
+            out.emplace_back(AddCmd{
+                std::vector<uint8_t>(r.begin() + r_pos, r.begin() + end)});
+            r_pos = end;
+        }
+    };
+    auto end_of = [](const Span& s) { return s.r_off + s.len; };
+    size_t i = 0;
+    while (i < spans.size()) {
+        const Span* best = nullptr;
+        for (; i < spans.size() && spans[i].r_off <= r_pos; ++i) {
+            if (!best || end_of(spans[i]) > end_of(*best)) { best = &spans[i]; }
+        }
+        if (!best || end_of(*best) <= r_pos) {
+            // Nothing covers r_pos; the next span starts beyond it.
+            if (i < spans.size()) { add_until(spans[i].r_off); }
+            continue;
+        }
+        size_t skip = r_pos - best->r_off;
+        auto* prev = out.empty() ? nullptr : std::get_if<CopyCmd>(&out.back());
+        if (prev && prev->offset + prev->length == best->v_off + skip) {
+            prev->length += best->len - skip;
+        } else {
+            out.emplace_back(CopyCmd{best->v_off + skip, best->len - skip});
+        }
+        r_pos = end_of(*best);
+    }
+    add_until(r.size());
+    return out;
+}
+
+} // namespace delta
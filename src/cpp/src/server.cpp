@@ -0,0 +1,449 @@
+#include "delta/server.h"
+#include "delta/algorithm.h"
+#include "delta/apply.h"
+#include "delta/crc64.h"
+#include "delta/encoding.h"
+#include "delta/inplace.h"
+#include "delta/ref_index.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+// POSIX sockets and mmap
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace delta {
+
+namespace {
+
+void write_be(std::vector<uint8_t>& out, uint64_t val, size_t n) {
+    for (size_t i = n; i-- > 0;) {
+        out.push_back(static_cast<uint8_t>(val >> (8 * i)));
+    }
+}
+
+uint64_t read_be(const uint8_t* p, size_t n) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < n; ++i) { val = (val << 8) | p[i]; }
+    return val;
+}
+
+void put_string(std::vector<uint8_t>& out, const std::string& s) {
+    write_be(out, s.size(), 4);
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+std::string take_string(std::span<const uint8_t> data, size_t& pos) {
+    if (data.size() - pos < 4) { throw DeltaError("server: truncated message"); }
+    size_t len = read_be(data.data() + pos, 4);
+    pos += 4;
+    if (data.size() - pos < len) { throw DeltaError("server: truncated message"); }
+    std::string s(data.begin() + pos, data.begin() + pos + len);
+    pos += len;
+    return s;
+}
+
+std::string errno_str(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+// ── framing ─────────────────────────────────────────────────────────────
+
+bool write_all(int fd, const uint8_t* p, size_t n) {
+    while (n > 0) {
+        ssize_t w = ::send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+
+bool read_all(int fd, uint8_t* p, size_t n) {
+    while (n > 0) {
+        ssize_t r = ::recv(fd, p, n, 0);
+        if (r == 0) { return false; }
+        if (r < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        p += r;
+        n -= static_cast<size_t>(r);
+    }
+    return true;
+}
+
+bool send_frame(int fd, const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> len;
+    write_be(len, payload.size(), 4);
+    return write_all(fd, len.data(), len.size())
+        && write_all(fd, payload.data(), payload.size());
+}
+
+/// nullopt on EOF, I/O error or an oversized frame.
+std::optional<std::vector<uint8_t>> recv_frame(int fd) {
+    uint8_t len[4];
+    if (!read_all(fd, len, sizeof(len))) { return std::nullopt; }
+    size_t n = read_be(len, 4);
+    if (n > SERVER_MAX_FRAME) { return std::nullopt; }
+    std::vector<uint8_t> payload(n);
+    if (!read_all(fd, payload.data(), n)) { return std::nullopt; }
+    return payload;
+}
+
+sockaddr_un make_addr(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw DeltaError("server: socket path too long: " + path);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+// ── reference cache ─────────────────────────────────────────────────────
+
+/// A read-only mapping of a reference with its CRC; the coarse seed
+/// index is built on first use.
+class CachedRef {
+public:
+    CachedRef(const std::string& path, const struct stat& st)
+        : size_(static_cast<size_t>(st.st_size)), mtime_(st.st_mtim) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) { throw DeltaError(errno_str("cannot open " + path)); }
+        if (size_ > 0) {
+            void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd_);
+                throw DeltaError(errno_str("cannot mmap " + path));
+            }
+            data_ = static_cast<const uint8_t*>(p);
+        }
+        crc_ = crc64_xz(data_, size_);
+    }
+
+    ~CachedRef() {
+        if (data_) { ::munmap(const_cast<uint8_t*>(data_), size_); }
+        if (fd_ >= 0) { ::close(fd_); }
+    }
+
+    CachedRef(const CachedRef&) = delete;
+    CachedRef& operator=(const CachedRef&) = delete;
+
+    std::span<const uint8_t> span() const { return {data_, size_}; }
+    const std::array<uint8_t, DELTA_CRC_SIZE>& crc() const { return crc_; }
+
+    bool matches(const struct stat& st) const {
+        return static_cast<size_t>(st.st_size) == size_
+            && st.st_mtim.tv_sec == mtime_.tv_sec
+            && st.st_mtim.tv_nsec == mtime_.tv_nsec;
+    }
+
+    /// Mapping plus the index it will hold, charged against the budget.
+    size_t charge() const {
+        return size_ + size_ / coarse_stride(size_, DiffOptions{}) * sizeof(RefSeed);
+    }
+
+    const RefIndex& index() {
+        std::call_once(index_once_, [&] { index_ = build_ref_index(span()); });
+        return index_;
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_;
+    timespec mtime_;
+    int fd_ = -1;
+    std::array<uint8_t, DELTA_CRC_SIZE> crc_{};
+    std::once_flag index_once_;
+    RefIndex index_;
+};
+
+/// LRU of CachedRefs within a byte budget.  Entries are shared, so an
+/// evicted reference stays mapped until its last request finishes.
+class RefCache {
+public:
+    explicit RefCache(size_t budget) : budget_(budget) {}
+
+    std::shared_ptr<CachedRef> get(const std::string& path, bool& hit) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) < 0) {
+            throw DeltaError(errno_str("cannot stat " + path));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            auto it = map_.find(path);
+            if (it != map_.end() && it->second->second->matches(st)) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                hit = true;
+                return it->second->second;
+            }
+        }
+
+        // Map and CRC outside the lock; a racing load of the same path
+        // simply replaces the other.
+        hit = false;
+        auto ref = std::make_shared<CachedRef>(path, st);
+        std::lock_guard<std::mutex> lock(mu_);
+        if (auto it = map_.find(path); it != map_.end()) {
+            bytes_ -= it->second->second->charge();
+            lru_.erase(it->second);
+            map_.erase(it);
+        }
+        lru_.emplace_front(path, ref);
+        map_[path] = lru_.begin();
+        bytes_ += ref->charge();
+        while (bytes_ > budget_ && lru_.size() > 1) {
+            bytes_ -= lru_.back().second->charge();
+            map_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+        return ref;
+    }
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<CachedRef>>;
+    size_t budget_;
+    size_t bytes_ = 0;
+    std::mutex mu_;
+    std::list<Entry> lru_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> map_;
+};
+
+// ── request handling ────────────────────────────────────────────────────
+
+std::vector<uint8_t> read_whole(const std::string& path) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    std::vector<uint8_t> buf(f ? static_cast<size_t>(f.tellg()) : 0);
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(buf.data()), static_cast<std::streamsize>(buf.size()));
+    if (!f) { throw DeltaError("cannot read " + path); }
+    return buf;
+}
+
+void write_whole(const std::string& path, std::span<const uint8_t> data) {
+    std::ofstream f(path, std::ios::binary);
+    f.write(reinterpret_cast<const char*>(data.data()),
+            static_cast<std::streamsize>(data.size()));
+    if (!f) { throw DeltaError("cannot write " + path); }
+}
+
+std::optional<Algorithm> parse_algorithm(const std::string& s) {
+    if (s == "greedy") { return Algorithm::Greedy; }
+    if (s == "onepass") { return Algorithm::Onepass; }
+    if (s == "correcting") { return Algorithm::Correcting; }
+    if (s == "hierarchical") { return Algorithm::Hierarchical; }
+    if (s == "best") { return Algorithm::Best; }
+    return std::nullopt;
+}
+
+ServerReply handle(const ServerRequest& req, RefCache& cache) {
+    auto t0 = std::chrono::steady_clock::now();
+    bool hit = false;
+    auto ref = cache.get(req.reference, hit);
+    auto r = ref->span();
+    char line[512];
+    std::string msg;
+
+    if (req.op == ServerOp::Encode) {
+        auto algo = parse_algorithm(req.algorithm);
+        if (!algo) { return {false, "unknown algorithm: " + req.algorithm}; }
+        auto v = read_whole(req.input);
+        DiffOptions opts;
+        if (*algo == Algorithm::Hierarchical) { opts.ref_index = &ref->index(); }
+        auto commands = diff(*algo, r, v, opts);
+        auto placed = req.inplace
+            ? make_inplace(r, commands, CyclePolicy::Localmin)
+            : place_commands(commands);
+        auto bytes = encode_delta(placed, req.inplace, v.size(), ref->crc(),
+                                  crc64_xz(v.data(), v.size()));
+        write_whole(req.output, bytes);
+        std::snprintf(line, sizeof(line), "Delta:        %s (%zu bytes)\n",
+            req.output.c_str(), bytes.size());
+        msg += line;
+    } else {
+        auto bytes = read_whole(req.input);
+        auto [placed, ip, version_size, src_crc, dst_crc] = decode_delta(bytes);
+        if (src_crc != ref->crc()) {
+            return {false, "source file does not match delta"};
+        }
+        std::vector<uint8_t> out;
+        if (ip) {
+            out = apply_delta_inplace(r, placed, version_size);
+        } else {
+            out.assign(version_size, 0);
+            apply_placed_to(r, placed, out);
+        }
+        if (crc64_xz(out.data(), out.size()) != dst_crc) {
+            return {false, "output integrity check failed"};
+        }
+        write_whole(req.output, out);
+        std::snprintf(line, sizeof(line), "Output:       %s (%zu bytes)\n",
+            req.output.c_str(), out.size());
+        msg += line;
+    }
+
+    std::snprintf(line, sizeof(line),
+        "Reference:    %s (%zu bytes, %s)\nTime:         %.3fs\n",
+        req.reference.c_str(), r.size(), hit ? "cached" : "loaded",
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+    msg += line;
+    return {true, msg};
+}
+
+} // anonymous namespace
+
+std::vector<uint8_t> encode_server_request(const ServerRequest& req) {
+    std::vector<uint8_t> out;
+    out.push_back(static_cast<uint8_t>(req.op));
+    out.push_back(req.inplace ? 1 : 0);
+    put_string(out, req.algorithm);
+    put_string(out, req.reference);
+    put_string(out, req.input);
+    put_string(out, req.output);
+    return out;
+}
+
+ServerRequest decode_server_request(std::span<const uint8_t> data) {
+    if (data.size() < 2 || data[0] < static_cast<uint8_t>(ServerOp::Encode)
+        || data[0] > static_cast<uint8_t>(ServerOp::Shutdown)) {
+        throw DeltaError("server: malformed request");
+    }
+    ServerRequest req;
+    req.op = static_cast<ServerOp>(data[0]);
+    req.inplace = (data[1] & 1) != 0;
+    size_t pos = 2;
+    req.algorithm = take_string(data, pos);
+    req.reference = take_string(data, pos);
+    req.input = take_string(data, pos);
+    req.output = take_string(data, pos);
+    return req;
+}
+
+std::vector<uint8_t> encode_server_reply(const ServerReply& reply) {
+    std::vector<uint8_t> out;
+    out.push_back(reply.ok ? 0 : 1);
+    put_string(out, reply.message);
+    return out;
+}
+
+ServerReply decode_server_reply(std::span<const uint8_t> data) {
+    if (data.empty()) { throw DeltaError("server: malformed reply"); }
+    size_t pos = 1;
+    return {data[0] == 0, take_string(data, pos)};
+}
+
+void serve(const std::string& socket_path, const ServerOptions& opts) {
+    auto addr = make_addr(socket_path);
+    int lfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) { throw DeltaError(errno_str("server: socket")); }
+    ::unlink(socket_path.c_str());
+    // The server reads and writes any path a client names, with its own
+    // privileges: only its owner may connect.  No connection is accepted
+    // before listen(), so the mode is in place before the first one.
+    if (::bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+        || ::chmod(socket_path.c_str(), 0600) < 0
+        || ::listen(lfd, SOMAXCONN) < 0) {
+        auto err = errno_str("server: cannot listen on " + socket_path);
+        ::close(lfd);
+        throw DeltaError(err);
+    }
+    if (opts.verbose) {
+        std::fprintf(stderr, "serve: listening on %s, cache %zu MB\n",
+            socket_path.c_str(), opts.cache_bytes >> 20);
+    }
+
+    RefCache cache(opts.cache_bytes);
+    std::atomic<bool> stopping{false};
+    std::mutex active_mu;
+    std::condition_variable active_cv;
+    std::unordered_set<int> clients;   // open connections, under active_mu
+
+    auto client = [&](int fd) {
+        while (auto frame = recv_frame(fd)) {
+            ServerReply reply;
+            try {
+                auto req = decode_server_request(*frame);
+                if (req.op == ServerOp::Shutdown) {
+                    stopping = true;
+                    ::shutdown(lfd, SHUT_RDWR); // wakes accept()
+                    reply = {true, "shutting down\n"};
+                } else {
+                    reply = handle(req, cache);
+                }
+            } catch (const std::exception& e) {
+                reply = {false, e.what()};
+            }
+            if (opts.verbose) {
+                std::fprintf(stderr, "serve: %s", reply.ok
+                    ? reply.message.c_str() : ("error: " + reply.message + "\n").c_str());
+            }
+            if (!send_frame(fd, encode_server_reply(reply))) { break; }
+        }
+        std::lock_guard<std::mutex> lock(active_mu);
+        clients.erase(fd);
+        ::close(fd);
+        active_cv.notify_all();
+    };
+
+    while (!stopping) {
+        int fd = ::accept(lfd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) { continue; }
+            break; // shut down, or the socket failed
+        }
+        {
+            std::lock_guard<std::mutex> lock(active_mu);
+            clients.insert(fd);
+        }
+        std::thread(client, fd).detach();
+    }
+
+    // Let in-flight requests finish before the cache goes away.  A client
+    // that keeps its connection open would hold its thread in recv()
+    // forever: end reading on every connection, so each thread sends its
+    // current reply, sees end-of-file and exits.
+    std::unique_lock<std::mutex> lock(active_mu);
+    for (int fd : clients) { ::shutdown(fd, SHUT_RD); }
+    active_cv.wait(lock, [&] { return clients.empty(); });
+    ::close(lfd);
+    ::unlink(socket_path.c_str());
+}
+
+ServerReply server_call(const std::string& socket_path, const ServerRequest& req) {
+    auto addr = make_addr(socket_path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) { throw DeltaError(errno_str("server: socket")); }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        auto err = errno_str("cannot connect to server at " + socket_path);
+        ::close(fd);
+        throw DeltaError(err);
+    }
+    std::optional<std::vector<uint8_t>> frame;
+    if (send_frame(fd, encode_server_request(req))) { frame = recv_frame(fd); }
+    ::close(fd);
+    if (!frame) { throw DeltaError("server at " + socket_path + " closed the connection"); }
+    return decode_server_reply(*frame);
+}
+
+} // namespace delta
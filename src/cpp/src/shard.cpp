@@ -0,0 +1,177 @@
+#include "delta/shard.h"
+#include "delta/apply.h"
+#include "delta/crc64.h"
+#include "delta/encoding.h"
+#include "delta/postpass.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace delta {
+
+namespace {
+
+constexpr size_t HEADER = sizeof(SHARD_MAGIC) + 4 + 4 + 8 + 8;
+
+void write_be(std::vector<uint8_t>& out, uint64_t val, size_t n) {
+    for (size_t i = n; i-- > 0;) {
+        out.push_back(static_cast<uint8_t>(val >> (8 * i)));
+    }
+}
+
+uint64_t read_be(const uint8_t* p, size_t n) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < n; ++i) { val = (val << 8) | p[i]; }
+    return val;
+}
+
+size_t dst_of(const PlacedCommand& cmd) {
+    if (const auto* c = std::get_if<PlacedCopy>(&cmd)) { return c->dst; }
+    return std::get<PlacedAdd>(cmd).dst;
+}
+
+/// Re-match the commands around one seam: from the last copy before
+/// index `seam` to the first copy at or after it.
+std::vector<PlacedCommand> seam_pass(
+    const std::vector<PlacedCommand>& merged, size_t lo, size_t hi,
+    std::span<const uint8_t> reference, const DiffOptions& opts) {
+    std::vector<PlacedCommand> window(merged.begin() + lo, merged.begin() + hi);
+    size_t base = dst_of(window.front());
+    auto cmds = rematch_adds(reference, unplace_commands(window), opts);
+    cmds = optimize_commands(reference, std::move(cmds));
+    auto placed = place_commands(cmds);
+    for (auto& cmd : placed) {
+        if (auto* c = std::get_if<PlacedCopy>(&cmd)) {
+            c->dst += base;
+        } else {
+            std::get<PlacedAdd>(cmd).dst += base;
+        }
+    }
+    return placed;
+}
+
+} // anonymous namespace
+
+std::pair<size_t, size_t> shard_range(size_t v_size, size_t i, size_t n) {
+    auto at = [&](size_t k) {
+        return static_cast<size_t>(static_cast<unsigned __int128>(v_size) * k / n);
+    };
+    return {at(i), at(i + 1)};
+}
+
+std::vector<uint8_t> encode_shard(const DeltaShard& shard) {
+    std::vector<uint8_t> out(SHARD_MAGIC, SHARD_MAGIC + sizeof(SHARD_MAGIC));
+    out.reserve(HEADER + shard.delta.size());
+    write_be(out, shard.index, 4);
+    write_be(out, shard.count, 4);
+    write_be(out, shard.v_offset, 8);
+    write_be(out, shard.v_total, 8);
+    out.insert(out.end(), shard.delta.begin(), shard.delta.end());
+    return out;
+}
+
+bool is_shard(std::span<const uint8_t> data) {
+    return data.size() >= sizeof(SHARD_MAGIC)
+        && std::memcmp(data.data(), SHARD_MAGIC, sizeof(SHARD_MAGIC)) == 0;
+}
+
+DeltaShard decode_shard(std::span<const uint8_t> data) {
+    if (!is_shard(data) || data.size() < HEADER) {
+        throw DeltaError("not a shard file");
+    }
+    const uint8_t* p = data.data() + sizeof(SHARD_MAGIC);
+    DeltaShard s;
+    s.index = static_cast<uint32_t>(read_be(p, 4));
+    s.count = static_cast<uint32_t>(read_be(p + 4, 4));
+    s.v_offset = read_be(p + 8, 8);
+    s.v_total = read_be(p + 16, 8);
+    if (s.count == 0 || s.index >= s.count || s.v_offset > s.v_total) {
+        throw DeltaError("corrupt shard file");
+    }
+    s.delta.assign(data.begin() + HEADER, data.end());
+    return s;
+}
+
+std::vector<uint8_t> merge_shards(
+    std::vector<DeltaShard> shards,
+    std::span<const uint8_t> reference,
+    const DiffOptions& opts) {
+
+    if (shards.empty()) { throw DeltaError("merge: no shards"); }
+    std::sort(shards.begin(), shards.end(),
+              [](const DeltaShard& a, const DeltaShard& b) { return a.index < b.index; });
+    uint32_t n = shards.front().count;
+    uint64_t total = shards.front().v_total;
+    if (shards.size() != n) {
+        throw DeltaError("merge: have " + std::to_string(shards.size())
+                         + " shards of " + std::to_string(n));
+    }
+
+    std::vector<PlacedCommand> merged;
+    std::vector<size_t> seams; // index in merged where each later shard starts
+    std::array<uint8_t, DELTA_CRC_SIZE> src{}, dst{};
+    uint64_t pos = 0;
+    for (uint32_t k = 0; k < n; ++k) {
+        const auto& s = shards[k];
+        if (s.index != k || s.count != n || s.v_total != total) {
+            throw DeltaError("merge: shard " + std::to_string(s.index)
+                             + " does not belong to this set");
+        }
+        if (s.v_offset != pos) {
+            throw DeltaError("merge: shard " + std::to_string(k)
+                             + " does not start where shard "
+                             + std::to_string(k - 1) + " ends");
+        }
+        auto [cmds, ip, size, src_crc, dst_crc] = decode_delta(s.delta);
+        if (ip) {
+            throw DeltaError("merge: shard " + std::to_string(k) + " is an in-place delta");
+        }
+        if (k > 0 && src_crc != src) {
+            throw DeltaError("merge: shards were encoded against different references");
+        }
+        src = src_crc;
+        dst = (k == 0) ? dst_crc : crc64_xz_combine(dst, dst_crc, size);
+        std::sort(cmds.begin(), cmds.end(),
+                  [](const PlacedCommand& a, const PlacedCommand& b) {
+                      return dst_of(a) < dst_of(b);
+                  });
+        if (k > 0) { seams.push_back(merged.size()); }
+        for (auto& cmd : cmds) {
+            if (auto* c = std::get_if<PlacedCopy>(&cmd)) {
+                c->dst += pos;
+            } else {
+                std::get<PlacedAdd>(cmd).dst += pos;
+            }
+            merged.push_back(std::move(cmd));
+        }
+        pos += size;
+    }
+    if (pos != total) { throw DeltaError("merge: shards do not cover the version"); }
+
+    if (!reference.empty()) {
+        // Windows from the last copy before each seam to the first copy
+        // after it; rewritten back to front so indices stay valid.
+        std::vector<std::pair<size_t, size_t>> windows;
+        for (size_t seam : seams) {
+            size_t lo = seam, hi = seam;
+            while (lo > 0 && !std::holds_alternative<PlacedCopy>(merged[lo - 1])) { --lo; }
+            if (lo > 0) { --lo; }
+            while (hi < merged.size() && !std::holds_alternative<PlacedCopy>(merged[hi])) { ++hi; }
+            if (hi < merged.size()) { ++hi; }
+            if (!windows.empty() && lo < windows.back().second) {
+                windows.back().second = hi;
+            } else if (lo < hi) {
+                windows.emplace_back(lo, hi);
+            }
+        }
+        for (auto it = windows.rbegin(); it != windows.rend(); ++it) {
+            auto fresh = seam_pass(merged, it->first, it->second, reference, opts);
+            merged.erase(merged.begin() + it->first, merged.begin() + it->second);
+            merged.insert(merged.begin() + it->first, fresh.begin(), fresh.end());
+        }
+    }
+    return encode_delta(merged, false, total, src, dst);
+}
+
+} // namespace delta
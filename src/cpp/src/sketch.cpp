@@ -0,0 +1,156 @@
+#include "delta/sketch.h"
+#include "delta/hash.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <set>
+#include <string>
+
+namespace delta {
+
+namespace {
+
+/// splitmix64 finalizer: a bijection that spreads fingerprint bits so
+/// the smallest values are a uniform sample.
+inline uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void write_be(std::vector<uint8_t>& out, uint64_t val, size_t n) {
+    for (size_t i = n; i-- > 0;) {
+        out.push_back(static_cast<uint8_t>(val >> (8 * i)));
+    }
+}
+
+uint64_t read_be(const uint8_t* p, size_t n) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < n; ++i) { val = (val << 8) | p[i]; }
+    return val;
+}
+
+} // anonymous namespace
+
+Sketch make_sketch(std::span<const uint8_t> data, size_t p, size_t k) {
+    if (p == 0 || k == 0) {
+        throw DeltaError("sketch: seed length and size must be >= 1");
+    }
+    Sketch s;
+    s.file_size = data.size();
+    s.seed_len = p;
+    s.k = k;
+    if (data.size() < p) { return s; }
+
+    // Bottom-k as an ordered set; most seeds fail the threshold test.
+    std::set<uint64_t> bottom;
+    uint64_t threshold = UINT64_MAX;
+    auto offer = [&](uint64_t fp) {
+        uint64_t h = mix(fp);
+        if (h >= threshold && bottom.size() == k) { return; }
+        if (!bottom.insert(h).second) { return; }
+        if (bottom.size() > k) { bottom.erase(std::prev(bottom.end())); }
+        if (bottom.size() == k) { threshold = *bottom.rbegin(); }
+    };
+
+    RollingHash rh(data, 0, p);
+    offer(rh.value());
+    for (size_t a = 1; a + p <= data.size(); ++a) {
+        rh.roll(data[a - 1], data[a + p - 1]);
+        offer(rh.value());
+    }
+    s.mins.assign(bottom.begin(), bottom.end());
+    return s;
+}
+
+double sketch_distinct(const Sketch& s) {
+    if (s.mins.size() < s.k) { return static_cast<double>(s.mins.size()); }
+    // k-th smallest of n uniform values in [0, 2^64) is ~ k / n * 2^64.
+    double kth = static_cast<double>(s.mins.back()) / 18446744073709551616.0;
+    return kth > 0 ? static_cast<double>(s.k - 1) / kth
+                   : static_cast<double>(s.k);
+}
+
+double sketch_jaccard(const Sketch& a, const Sketch& b) {
+    if (a.seed_len != b.seed_len) {
+        throw DeltaError("sketch: seed lengths differ ("
+            + std::to_string(a.seed_len) + " vs "
+            + std::to_string(b.seed_len) + ")");
+    }
+    // The smallest kk values of the union are a uniform sample of it;
+    // count how many of them both sets contain.
+    size_t kk = std::min(a.k, b.k);
+    size_t i = 0, j = 0, taken = 0, both = 0;
+    while (taken < kk && (i < a.mins.size() || j < b.mins.size())) {
+        if (j == b.mins.size()
+            || (i < a.mins.size() && a.mins[i] < b.mins[j])) {
+            ++i;
+        } else if (i == a.mins.size() || b.mins[j] < a.mins[i]) {
+            ++j;
+        } else {
+            ++i;
+            ++j;
+            ++both;
+        }
+        ++taken;
+    }
+    return taken > 0 ? static_cast<double>(both) / taken : 0.0;
+}
+
+double sketch_containment(const Sketch& v, const Sketch& r) {
+    double nv = sketch_distinct(v);
+    if (nv == 0) { return 0.0; }
+    // |V n R| = J |V u R| and |V u R| = (|V| + |R|) / (1 + J).
+    double j = sketch_jaccard(v, r);
+    double inter = j * (nv + sketch_distinct(r)) / (1 + j);
+    return std::clamp(inter / nv, 0.0, 1.0);
+}
+
+double predicted_ratio(const Sketch& v, const Sketch& r) {
+    return 1.0 - sketch_containment(v, r);
+}
+
+std::vector<uint8_t> encode_sketch(const Sketch& s) {
+    std::vector<uint8_t> out(SKETCH_MAGIC, SKETCH_MAGIC + sizeof(SKETCH_MAGIC));
+    write_be(out, s.seed_len, 4);
+    write_be(out, s.k, 4);
+    write_be(out, s.file_size, 8);
+    write_be(out, s.mins.size(), 4);
+    for (uint64_t m : s.mins) { write_be(out, m, 8); }
+    return out;
+}
+
+bool is_sketch(std::span<const uint8_t> data) {
+    return data.size() >= sizeof(SKETCH_MAGIC)
+        && std::memcmp(data.data(), SKETCH_MAGIC, sizeof(SKETCH_MAGIC)) == 0;
+}
+
+Sketch decode_sketch(std::span<const uint8_t> data) {
+    constexpr size_t HEADER = sizeof(SKETCH_MAGIC) + 4 + 4 + 8 + 4;
+    if (!is_sketch(data) || data.size() < HEADER) {
+        throw DeltaError("not a sketch file");
+    }
+    const uint8_t* p = data.data() + sizeof(SKETCH_MAGIC);
+    Sketch s;
+    s.seed_len = read_be(p, 4);
+    s.k = read_be(p + 4, 4);
+    s.file_size = read_be(p + 8, 8);
+    size_t count = read_be(p + 16, 4);
+    if (s.seed_len == 0 || s.k == 0 || count > s.k
+        || data.size() != HEADER + 8 * count) {
+        throw DeltaError("corrupt sketch file");
+    }
+    s.mins.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        s.mins[i] = read_be(data.data() + HEADER + 8 * i, 8);
+        if (i > 0 && s.mins[i] <= s.mins[i - 1]) {
+            throw DeltaError("corrupt sketch file: minima not ascending");
+        }
+    }
+    return s;
+}
+
+} // namespace delta
@@ -0,0 +1,516 @@
+#include "delta/stats.h"
+#include "delta/algorithm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include <sys/resource.h>
+#include <time.h>
+
+namespace delta {
+
+namespace {
+
+double pct(size_t part, size_t whole) {
+    return whole > 0 ? static_cast<double>(part) / whole * 100.0 : 0.0;
+}
+
+double mib(size_t bytes) {
+    return static_cast<double>(bytes) / 1048576.0;
+}
+
+/// Minimal JSON object writer: keys are emitted in call order.
+class JsonObject {
+public:
+    explicit JsonObject(std::string& out) : out_(out) { out_ += '{'; }
+    ~JsonObject() { out_ += '}'; }
+
+    void str(const char* key, const std::string& value) {
+        put_key(key);
+        put_string(value);
+    }
+    void num(const char* key, uint64_t value) {
+        put_key(key);
+        out_ += std::to_string(value);
+    }
+    void num(const char* key, double value) {
+        put_key(key);
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.6f", std::isfinite(value) ? value : 0.0);
+        out_ += buf;
+    }
+    void boolean(const char* key, bool value) {
+        put_key(key);
+        out_ += value ? "true" : "false";
+    }
+    void phase(const char* key, const PhaseTime& t) {
+        put_key(key);
+        JsonObject o(out_);
+        o.num("wall", t.wall);
+        o.num("cpu", t.cpu);
+        o.num("mem_peak_bytes", uint64_t{t.mem_peak});
+        o.num("rss_bytes", uint64_t{t.rss});
+        for (size_t e = 0; e < PERF_EVENT_COUNT; ++e) {
+            if (t.perf.has(static_cast<PerfEvent>(e))) {
+                o.num(PERF_EVENT_NAMES[e], t.perf.value[e]);
+            }
+        }
+    }
+    /// Start a nested object or array value; the caller writes it.
+    std::string& raw(const char* key) {
+        put_key(key);
+        return out_;
+    }
+
+private:
+    void put_string(const std::string& s) {
+        out_ += '"';
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                out_ += '\\';
+                out_ += static_cast<char>(c);
+            } else if (c < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out_ += buf;
+            } else {
+                out_ += static_cast<char>(c);
+            }
+        }
+        out_ += '"';
+    }
+
+    void put_key(const char* key) {
+        if (!first_) { out_ += ','; }
+        first_ = false;
+        put_string(key);
+        out_ += ':';
+    }
+
+    std::string& out_;
+    bool first_ = true;
+};
+
+/// count, min, max, mean, p50/p90/p99, and the non-empty buckets as
+/// [low, high, count].
+void histogram_json(std::string& out, const Histogram& h) {
+    JsonObject o(out);
+    o.num("count", h.count());
+    o.num("min", h.min());
+    o.num("max", h.max());
+    o.num("mean", h.mean());
+    o.num("p50", h.percentile(0.5));
+    o.num("p90", h.percentile(0.9));
+    o.num("p99", h.percentile(0.99));
+    auto& a = o.raw("buckets");
+    a += '[';
+    bool first = true;
+    for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+        if (h.bucket_count(i) == 0) { continue; }
+        if (!first) { a += ','; }
+        first = false;
+        a += '[' + std::to_string(Histogram::bucket_low(i)) + ','
+            + std::to_string(Histogram::bucket_high(i)) + ','
+            + std::to_string(h.bucket_count(i)) + ']';
+    }
+    a += ']';
+}
+
+/// One summary line per non-empty histogram, then its counts per power
+/// of two.
+void print_histogram(std::FILE* out, const char* name, const Histogram& h) {
+    if (h.count() == 0) { return; }
+    std::fprintf(out,
+        "  %s: n=%llu min=%llu p50=%llu p90=%llu p99=%llu max=%llu mean=%.1f\n   ",
+        name, (unsigned long long)h.count(), (unsigned long long)h.min(),
+        (unsigned long long)h.percentile(0.5), (unsigned long long)h.percentile(0.9),
+        (unsigned long long)h.percentile(0.99), (unsigned long long)h.max(), h.mean());
+    uint64_t group = 0;
+    unsigned width = 0;
+    auto flush = [&] {
+        if (group == 0) { return; }
+        uint64_t lo = width == 0 ? 0 : uint64_t{1} << (width - 1);
+        uint64_t hi = width == 0 ? 0 : lo + (lo - 1);
+        std::fprintf(out, " [%llu,%llu]:%llu", (unsigned long long)lo,
+            (unsigned long long)hi, (unsigned long long)group);
+        group = 0;
+    };
+    for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+        auto w = static_cast<unsigned>(std::bit_width(Histogram::bucket_low(i)));
+        if (w != width) {
+            flush();
+            width = w;
+        }
+        group += h.bucket_count(i);
+    }
+    flush();
+    std::fprintf(out, "\n");
+}
+
+/// SIZE_MAX ("did not happen") is written as -1.
+void offset_or_none(JsonObject& o, const char* key, size_t v) {
+    if (v == SIZE_MAX) {
+        o.raw(key) += "-1";
+    } else {
+        o.num(key, uint64_t{v});
+    }
+}
+
+void diff_stats_json(std::string& out, const DiffStats& s) {
+    JsonObject o(out);
+    o.str("algorithm", s.algorithm);
+    o.num("r_size", uint64_t{s.r_size});
+    o.num("v_size", uint64_t{s.v_size});
+    o.num("seed_len", uint64_t{s.seed_len});
+    o.str("table_kind", s.table_kind);
+    o.num("table_capacity", uint64_t{s.table_capacity});
+    o.num("table_entries", uint64_t{s.table_entries});
+    o.num("f_size", s.f_size);
+    o.num("checkpoint_m", s.checkpoint_m);
+    o.num("checkpoint_k", s.checkpoint_k);
+    o.num("coarse_len", uint64_t{s.coarse_len});
+    o.num("coarse_stride", uint64_t{s.coarse_stride});
+    o.num("coarse_copies", uint64_t{s.coarse_copies});
+    o.boolean("index_loaded", s.index_loaded);
+    o.num("build_seeds", uint64_t{s.build_seeds});
+    o.num("build_passed", uint64_t{s.build_passed});
+    o.num("build_stored", uint64_t{s.build_stored});
+    o.num("build_collisions", uint64_t{s.build_collisions});
+    o.num("scan_positions", uint64_t{s.scan_positions});
+    o.num("scan_lookups", uint64_t{s.scan_lookups});
+    o.num("scan_matches", uint64_t{s.scan_matches});
+    o.num("scan_fp_mismatch", uint64_t{s.scan_fp_mismatch});
+    o.num("scan_byte_mismatch", uint64_t{s.scan_byte_mismatch});
+    o.boolean("budget", s.budget);
+    o.num("build_thin", uint64_t{s.build_thin});
+    o.num("scan_thin", uint64_t{s.scan_thin});
+    o.num("build_indexed", uint64_t{s.build_indexed});
+    offset_or_none(o, "scan_stopped_at", s.scan_stopped_at);
+    offset_or_none(o, "tail_v", s.tail_v);
+    o.num("tail_r", uint64_t{s.tail_r});
+    o.num("trim_prefix", uint64_t{s.trim_prefix});
+    o.num("trim_suffix", uint64_t{s.trim_suffix});
+    o.num("rematch_gaps", uint64_t{s.rematch_gaps});
+    o.num("rematch_gap_bytes", uint64_t{s.rematch_gap_bytes});
+    o.num("rematch_searched", uint64_t{s.rematch_searched});
+    o.num("rematch_copies", uint64_t{s.rematch_copies});
+    o.num("rematch_threads", uint64_t{s.rematch_threads});
+    o.boolean("optimized", s.optimized);
+    o.num("optimize_commands_before", uint64_t{s.optimize_commands_before});
+    o.num("optimize_cost_before", uint64_t{s.optimize_cost_before});
+    o.num("optimize_cost_after", uint64_t{s.optimize_cost_after});
+    o.phase("build", s.build);
+    o.phase("scan", s.scan);
+    o.phase("diff", s.diff_time);
+    o.phase("rematch", s.rematch);
+    o.phase("optimize", s.optimize);
+    {
+        auto& a = o.raw("candidates");
+        a += '[';
+        for (size_t i = 0; i < s.candidates.size(); ++i) {
+            if (i > 0) { a += ','; }
+            JsonObject c(a);
+            c.str("label", s.candidates[i].label);
+            if (s.candidates[i].cost) {
+                c.num("cost", uint64_t{*s.candidates[i].cost});
+            } else {
+                c.raw("cost") += "null";
+            }
+            c.boolean("winner", i == s.winner);
+        }
+        a += ']';
+    }
+    o.num("num_copies", uint64_t{s.num_copies});
+    o.num("copy_bytes", uint64_t{s.copy_bytes});
+    o.num("num_adds", uint64_t{s.num_adds});
+    o.num("add_bytes", uint64_t{s.add_bytes});
+    o.num("copy_min", uint64_t{s.copy_min});
+    o.num("copy_max", uint64_t{s.copy_max});
+    o.num("copy_median", uint64_t{s.copy_median});
+    o.num("command_heap_bytes", uint64_t{s.command_heap_bytes});
+    o.num("memory_limit", uint64_t{s.memory_limit});
+    JsonObject h(o.raw("histograms"));
+    for (auto [name, hist] : s.histograms()) { histogram_json(h.raw(name), *hist); }
+}
+
+} // anonymous namespace
+
+Histogram& Histogram::operator+=(const Histogram& o) {
+    for (size_t i = 0; i < BUCKETS; ++i) { counts_[i] += o.counts_[i]; }
+    count_ += o.count_;
+    sum_ += o.sum_;
+    min_ = std::min(min_, o.min_);
+    max_ = std::max(max_, o.max_);
+    return *this;
+}
+
+uint64_t Histogram::percentile(double q) const {
+    if (count_ == 0) { return 0; }
+    auto rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * count_));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) { return std::clamp(bucket_high(i), min_, max_); }
+    }
+    return max_;
+}
+
+double process_cpu_seconds() {
+    timespec ts{};
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+
+size_t peak_rss_bytes() {
+    rusage ru{};
+    ::getrusage(RUSAGE_SELF, &ru);
+    return static_cast<size_t>(ru.ru_maxrss) * 1024; // kilobytes on Linux
+}
+
+PhaseTimer::PhaseTimer()
+    : wall0_(std::chrono::steady_clock::now()), cpu0_(process_cpu_seconds()),
+      perf0_(read_perf_counters()) {}
+
+PhaseTime PhaseTimer::elapsed() const {
+    PhaseTime t;
+    t.perf = read_perf_counters() - perf0_;
+    t.mem_peak = mem_.peak();
+    t.rss = peak_rss_bytes();
+    t.cpu = process_cpu_seconds() - cpu0_;
+    t.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0_).count();
+    return t;
+}
+
+void print_phases(const StatsReport& report, std::FILE* out) {
+    std::fprintf(out, "%-10s %9s %9s %10s %10s\n", "phase", "wall", "cpu",
+        "heap MB", "rss MB");
+    auto row = [&](const std::string& name, const PhaseTime& t) {
+        std::fprintf(out, "%-10s %8.3fs %8.3fs %10.1f %10.1f  %s\n", name.c_str(),
+            t.wall, t.cpu, mib(t.mem_peak), mib(t.rss),
+            format_perf_counts(t.perf).c_str());
+    };
+    for (const auto& [name, t] : report.phases) { row(name, t); }
+    row("total", report.total);
+}
+
+std::string stats_json(const StatsReport& report) {
+    std::string out;
+    {
+        JsonObject o(out);
+        o.str("command", report.command);
+        {
+            JsonObject l(o.raw("labels"));
+            for (const auto& [k, v] : report.labels) { l.str(k.c_str(), v); }
+        }
+        {
+            JsonObject ph(o.raw("phases"));
+            for (const auto& [k, t] : report.phases) { ph.phase(k.c_str(), t); }
+        }
+        o.phase("total", report.total);
+        {
+            JsonObject c(o.raw("counts"));
+            for (const auto& [k, v] : report.counts) { c.num(k.c_str(), v); }
+        }
+        if (report.diff) { diff_stats_json(o.raw("diff"), *report.diff); }
+        {
+            auto usage = memory_usage();
+            JsonObject m(o.raw("memory"));
+            for (size_t i = 0; i < MEM_CATEGORY_COUNT; ++i) {
+                JsonObject cat(m.raw(MEM_CATEGORY_NAMES[i]));
+                cat.num("current_bytes", uint64_t{usage.current[i]});
+                cat.num("peak_bytes", uint64_t{usage.peak[i]});
+            }
+            m.num("peak_bytes", uint64_t{usage.total_peak});
+        }
+        o.num("peak_rss_bytes", uint64_t{peak_rss_bytes()});
+    }
+    out += '\n';
+    return out;
+}
+
+void record_result(DiffStats& stats, const std::vector<Command>& commands) {
+    Histogram copies, adds;
+    size_t literal_capacity = 0;
+    stats.num_copies = stats.copy_bytes = stats.num_adds = stats.add_bytes = 0;
+    for (const auto& cmd : commands) {
+        if (auto* c = std::get_if<CopyCmd>(&cmd)) {
+            stats.copy_bytes += c->length; ++stats.num_copies;
+            copies.record(c->length);
+        } else if (auto* a = std::get_if<AddCmd>(&cmd)) {
+            stats.add_bytes += a->data.size(); ++stats.num_adds;
+            adds.record(a->data.size());
+            literal_capacity += a->data.capacity();
+        }
+    }
+    // Min and max are exact; the median is the histogram's (within 12.5%).
+    stats.copy_min = copies.min();
+    stats.copy_max = copies.max();
+    stats.copy_median = copies.percentile(0.5);
+    stats.copy_lengths = copies;
+    stats.add_lengths = adds;
+    stats.command_heap_bytes = commands.capacity() * sizeof(Command) + literal_capacity;
+}
+
+void print_command_stats(const std::vector<Command>& commands, DiffStats* stats) {
+    DiffStats local;
+    if (!stats) { stats = &local; }
+    record_result(*stats, commands);
+    print_diff_stats(*stats);
+}
+
+void print_diff_stats(const DiffStats& s, std::FILE* out) {
+    if (s.trim_prefix > 0 || s.trim_suffix > 0) {
+        std::fprintf(out, "trim: prefix %zu bytes, suffix %zu bytes\n",
+            s.trim_prefix, s.trim_suffix);
+    }
+
+    std::string algo = s.algorithm;
+    if (algo == "onepass") {
+        std::fprintf(out,
+            "onepass: %s, q=%zu, |R|=%zu, |V|=%zu, seed_len=%zu\n"
+            "  scan: %zu positions, %zu lookups, %zu matches (flushes)\n"
+            "  scan: hit rate %.1f%% (of lookups)\n",
+            s.table_kind, s.table_capacity, s.r_size, s.v_size, s.seed_len,
+            s.scan_positions, s.scan_lookups, s.scan_matches,
+            pct(s.scan_matches, s.scan_lookups));
+        if (s.scan_stopped_at != SIZE_MAX) {
+            std::fprintf(out, "  budget: expired at V offset %zu\n", s.scan_stopped_at);
+        }
+    } else if (algo == "correcting") {
+        uint64_t expected = s.checkpoint_m > 0 ? s.build_seeds / s.checkpoint_m : 0;
+        std::fprintf(out,
+            "correcting: %s, |C|=%zu |F|=%llu m=%llu k=%llu\n"
+            "  checkpoint gap=%llu bytes, expected fill ~%llu (~%llu%% table occupancy)\n"
+            "  table memory %.1f MB (tracked peak of build)\n",
+            s.table_kind, s.table_capacity, (unsigned long long)s.f_size,
+            (unsigned long long)s.checkpoint_m, (unsigned long long)s.checkpoint_k,
+            (unsigned long long)s.checkpoint_m, (unsigned long long)expected,
+            (unsigned long long)(s.table_capacity > 0 ? expected * 100 / s.table_capacity : 0),
+            mib(s.build.mem_peak));
+        std::fprintf(out,
+            "  build: %zu seeds, %zu passed checkpoint (%.2f%%), "
+            "%zu stored, %zu collisions\n"
+            "  build: table occupancy %zu/%zu (%.1f%%)\n",
+            s.build_seeds, s.build_passed, pct(s.build_passed, s.build_seeds),
+            s.build_stored, s.build_collisions,
+            s.table_entries, s.table_capacity, pct(s.table_entries, s.table_capacity));
+        std::fprintf(out,
+            "  scan: %zu V positions, %zu checkpoints (%.3f%%), %zu matches\n"
+            "  scan: hit rate %.1f%% (of checkpoints), "
+            "fp collisions %zu, byte mismatches %zu\n",
+            s.scan_positions, s.scan_lookups, pct(s.scan_lookups, s.scan_positions),
+            s.scan_matches, pct(s.scan_matches, s.scan_lookups),
+            s.scan_fp_mismatch, s.scan_byte_mismatch);
+        if (s.budget) {
+            std::fprintf(out,
+                "  budget: build thinned x%zu, indexed %zu/%zu seeds; "
+                "scan thinned x%zu",
+                s.build_thin, s.build_indexed, s.build_seeds, s.scan_thin);
+            if (s.tail_v != SIZE_MAX) {
+                std::fprintf(out, "; onepass tail from V offset %zu, R offset %zu",
+                    s.tail_v, s.tail_r);
+            }
+            std::fprintf(out, "\n");
+        }
+    } else if (algo == "greedy") {
+        std::fprintf(out,
+            "greedy: %s, |R|=%zu, |V|=%zu, seed_len=%zu\n"
+            "  scan: %zu positions, %zu lookups, %zu matches\n",
+            s.table_kind, s.r_size, s.v_size, s.seed_len,
+            s.scan_positions, s.scan_lookups, s.scan_matches);
+        if (s.budget) {
+            std::fprintf(out,
+                "  budget: build thinned x%zu, stored %zu of %zu seeds, "
+                "scan stopped at V offset %zu\n",
+                s.build_thin, s.build_stored, s.build_indexed,
+                std::min(s.scan_stopped_at, s.v_size));
+        }
+    } else if (algo == "hierarchical") {
+        std::fprintf(out,
+            "hierarchical: |R|=%zu, |V|=%zu, coarse_len=%zu stride=%zu, "
+            "fine seed_len=%zu\n"
+            "  coarse: %zu seeds %s, table capacity %zu\n",
+            s.r_size, s.v_size, s.coarse_len, s.coarse_stride, s.seed_len,
+            s.table_entries, s.index_loaded ? "loaded from index" : "indexed",
+            s.table_capacity);
+        if (s.budget) {
+            std::fprintf(out, "  budget: build thinned x%zu, indexed R to offset %zu",
+                s.build_thin, std::min(s.build_indexed, s.r_size));
+            if (s.tail_v != SIZE_MAX) {
+                std::fprintf(out, "; onepass tail from V offset %zu, R offset %zu",
+                    s.tail_v, s.tail_r);
+            }
+            std::fprintf(out, "\n");
+        }
+        std::fprintf(out, "  coarse: %zu copies\n", s.coarse_copies);
+    } else if (algo == "best") {
+        std::fprintf(out, "best: %zu candidates, %zu threads\n",
+            s.candidates.size(), s.best_threads);
+        for (size_t i = 0; i < s.candidates.size(); ++i) {
+            const auto& c = s.candidates[i];
+            if (c.cost) {
+                std::fprintf(out, "  %-20s %12zu bytes%s\n", c.label.c_str(), *c.cost,
+                    i == s.winner ? "  <- winner" : "");
+            } else {
+                std::fprintf(out, "  %-20s    cancelled\n", c.label.c_str());
+            }
+        }
+    }
+    if (s.build.wall > 0) {
+        std::fprintf(out, "  time: build %.3fs, scan %.3fs\n",
+            s.build.wall, s.scan.wall);
+    } else if (s.scan.wall > 0) {
+        std::fprintf(out, "  time: scan %.3fs\n", s.scan.wall);
+    }
+    if (s.build.mem_peak > 0 || s.scan.mem_peak > 0) {
+        std::fprintf(out, "  memory: tracked peak build %.1f MB, scan %.1f MB",
+            mib(s.build.mem_peak), mib(s.scan.mem_peak));
+        if (s.memory_limit > 0) {
+            std::fprintf(out, " (limit %.1f MB)", mib(s.memory_limit));
+        }
+        std::fprintf(out, "\n");
+    }
+    for (auto [name, t] : {std::pair{"build", &s.build}, {"scan", &s.scan},
+                           {"rematch", &s.rematch}, {"optimize", &s.optimize}}) {
+        if (t->perf.mask) {
+            std::fprintf(out, "  perf %s: %s\n", name, format_perf_counts(t->perf).c_str());
+        }
+    }
+
+    if (s.rematch_threads > 0) {
+        std::fprintf(out,
+            "rematch: %zu adds >= %zu bytes (%zu bytes), seed_len=%zu, "
+            "%zu threads, %zu copies found, %.3fs\n",
+            s.rematch_gaps, s.rematch_min_add, s.rematch_gap_bytes,
+            s.rematch_seed_len, s.rematch_threads, s.rematch_copies,
+            s.rematch.wall);
+        if (s.rematch_searched < s.rematch_gaps) {
+            std::fprintf(out, "  budget: %zu of %zu gaps searched\n",
+                s.rematch_searched, s.rematch_gaps);
+        }
+    }
+    if (s.optimized) {
+        std::fprintf(out,
+            "optimize: %zu -> %zu commands, %zu -> %zu encoded bytes, %.3fs\n",
+            s.optimize_commands_before, s.num_copies + s.num_adds,
+            s.optimize_cost_before, s.optimize_cost_after, s.optimize.wall);
+    }
+
+    size_t total_out = s.copy_bytes + s.add_bytes;
+    std::fprintf(out,
+        "  result: %zu copies (%zu bytes), %zu adds (%zu bytes)\n"
+        "  result: copy coverage %.1f%%, output %zu bytes\n",
+        s.num_copies, s.copy_bytes, s.num_adds, s.add_bytes,
+        pct(s.copy_bytes, total_out), total_out);
+    if (s.num_copies > 0) {
+        std::fprintf(out,
+            "  copies: %zu regions, min=%zu max=%zu mean=%.1f median=%zu bytes\n",
+            s.num_copies, s.copy_min, s.copy_max,
+            static_cast<double>(s.copy_bytes) / s.num_copies, s.copy_median);
+    }
+    for (auto [name, hist] : s.histograms()) { print_histogram(out, name, *hist); }
+}
+
+} // namespace delta
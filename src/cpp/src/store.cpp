@@ -0,0 +1,336 @@
+#include "delta/store.h"
+#include "delta/algorithm.h"
+#include "delta/apply.h"
+#include "delta/compose.h"
+#include "delta/crc64.h"
+#include "delta/encoding.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
+// POSIX pwrite / fsync
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace delta {
+
+namespace {
+
+constexpr size_t ENTRY_SIZE = 1 + 4 + 4 + 8 + 8 + 8 + 8 + DELTA_CRC_SIZE;
+constexpr size_t FOOTER_SIZE = 8 + sizeof(STORE_INDEX_MAGIC);
+
+void put_be(std::vector<uint8_t>& out, uint64_t val, size_t n) {
+    for (size_t i = n; i-- > 0;) {
+        out.push_back(static_cast<uint8_t>(val >> (8 * i)));
+    }
+}
+
+uint64_t get_be(const uint8_t* p, size_t n) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < n; ++i) { val = (val << 8) | p[i]; }
+    return val;
+}
+
+std::vector<uint8_t> read_at(const std::string& path, uint64_t off,
+                             uint64_t len) {
+    std::ifstream f(path, std::ios::binary);
+    std::vector<uint8_t> buf(len);
+    f.seekg(static_cast<std::streamoff>(off));
+    f.read(reinterpret_cast<char*>(buf.data()),
+           static_cast<std::streamsize>(len));
+    if (!f) { throw DeltaError("store: cannot read " + path); }
+    return buf;
+}
+
+/// Write data at off and flush it to disk before returning.
+void write_durable(const std::string& path, uint64_t off,
+                   std::span<const uint8_t> data) {
+    int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd < 0) { throw DeltaError("store: cannot write " + path); }
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = ::pwrite(fd, data.data() + done, data.size() - done,
+                             static_cast<off_t>(off + done));
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { break; }
+        done += static_cast<size_t>(n);
+    }
+    bool ok = done == data.size() && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok) { throw DeltaError("store: cannot write " + path); }
+}
+
+void create_pack(const std::string& path) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(reinterpret_cast<const char*>(STORE_MAGIC), sizeof(STORE_MAGIC));
+    if (!f) { throw DeltaError("store: cannot create " + path); }
+}
+
+/// Parse the index whose footer ends at `end`.  False if there is no
+/// well-formed footer and index there.
+bool load_index(const std::string& path, uint64_t end,
+                std::vector<StoreEntry>& entries, uint64_t& index_offset) {
+    if (end < sizeof(STORE_MAGIC) + 4 + FOOTER_SIZE) { return false; }
+    auto footer = read_at(path, end - FOOTER_SIZE, FOOTER_SIZE);
+    if (std::memcmp(footer.data() + 8, STORE_INDEX_MAGIC,
+                    sizeof(STORE_INDEX_MAGIC)) != 0) {
+        return false;
+    }
+    uint64_t off = get_be(footer.data(), 8);
+    if (off < sizeof(STORE_MAGIC) || off + 4 + FOOTER_SIZE > end) { return false; }
+    uint64_t len = end - FOOTER_SIZE - off;
+    if ((len - 4) % ENTRY_SIZE != 0
+        || get_be(read_at(path, off, 4).data(), 4) != (len - 4) / ENTRY_SIZE) {
+        return false;
+    }
+    auto index = read_at(path, off, len);
+    size_t count = (len - 4) / ENTRY_SIZE;
+    std::vector<StoreEntry> out(count);
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* p = index.data() + 4 + i * ENTRY_SIZE;
+        auto& e = out[i];
+        e.kind = static_cast<StoreKind>(p[0]);
+        e.parent = static_cast<uint32_t>(get_be(p + 1, 4));
+        e.depth = static_cast<uint32_t>(get_be(p + 5, 4));
+        e.offset = get_be(p + 9, 8);
+        e.length = get_be(p + 17, 8);
+        e.version_size = get_be(p + 25, 8);
+        e.chain_bytes = get_be(p + 33, 8);
+        std::memcpy(e.crc.data(), p + 41, DELTA_CRC_SIZE);
+        bool bad_kind = p[0] > static_cast<uint8_t>(StoreKind::Delta);
+        bool bad_parent = e.kind == StoreKind::Delta && e.parent >= i;
+        if (bad_kind || bad_parent || e.offset + e.length > off) { return false; }
+    }
+    entries = std::move(out);
+    index_offset = off;
+    return true;
+}
+
+} // anonymous namespace
+
+DeltaStore DeltaStore::open(const std::string& path) {
+    DeltaStore s;
+    s.path_ = path;
+    if (!std::filesystem::exists(path)) {
+        create_pack(path);
+        s.write_tail(sizeof(STORE_MAGIC), {});
+        return s;
+    }
+
+    uint64_t size = std::filesystem::file_size(path);
+    if (size < sizeof(STORE_MAGIC) + 4 + FOOTER_SIZE
+        || std::memcmp(read_at(path, 0, sizeof(STORE_MAGIC)).data(), STORE_MAGIC,
+                       sizeof(STORE_MAGIC)) != 0) {
+        throw DeltaError("store: " + path + " is not a delta store");
+    }
+    if (load_index(path, size, s.entries_, s.index_offset_)) {
+        s.end_ = size;
+        return s;
+    }
+
+    // An add() cut short leaves a torn tail after the last durable
+    // footer: fall back to the newest footer whose index parses, and
+    // drop the tail.
+    constexpr uint64_t BLOCK = uint64_t{1} << 20;
+    for (uint64_t hi = size; hi > sizeof(STORE_MAGIC);) {
+        uint64_t lo = hi > BLOCK ? hi - BLOCK : 0;
+        auto block = read_at(path, lo, hi - lo);
+        for (size_t j = block.size(); j-- > sizeof(STORE_INDEX_MAGIC) - 1;) {
+            size_t at = j + 1 - sizeof(STORE_INDEX_MAGIC);
+            if (std::memcmp(block.data() + at, STORE_INDEX_MAGIC,
+                            sizeof(STORE_INDEX_MAGIC)) == 0
+                && load_index(path, lo + j + 1, s.entries_, s.index_offset_)) {
+                s.end_ = lo + j + 1;
+                std::filesystem::resize_file(path, s.end_);
+                return s;
+            }
+        }
+        if (lo == 0) { break; }
+        hi = lo + sizeof(STORE_INDEX_MAGIC) - 1;
+    }
+    throw DeltaError("store: corrupt index in " + path);
+}
+
+void DeltaStore::write_tail(uint64_t offset, std::span<const uint8_t> records) {
+    std::vector<uint8_t> out(records.begin(), records.end());
+    uint64_t index_offset = offset + records.size();
+    put_be(out, entries_.size(), 4);
+    for (const auto& e : entries_) {
+        out.push_back(static_cast<uint8_t>(e.kind));
+        put_be(out, e.parent, 4);
+        put_be(out, e.depth, 4);
+        put_be(out, e.offset, 8);
+        put_be(out, e.length, 8);
+        put_be(out, e.version_size, 8);
+        put_be(out, e.chain_bytes, 8);
+        out.insert(out.end(), e.crc.begin(), e.crc.end());
+    }
+    write_durable(path_, offset, out);
+
+    // Only a footer at the end of the file is authoritative, and it goes
+    // out after the records and index it points to are on disk.
+    std::vector<uint8_t> footer;
+    put_be(footer, index_offset, 8);
+    footer.insert(footer.end(), STORE_INDEX_MAGIC,
+                  STORE_INDEX_MAGIC + sizeof(STORE_INDEX_MAGIC));
+    uint64_t end = offset + out.size() + footer.size();
+    write_durable(path_, offset + out.size(), footer);
+    if (std::filesystem::file_size(path_) > end) {
+        std::filesystem::resize_file(path_, end);
+    }
+    index_offset_ = index_offset;
+    end_ = end;
+}
+
+std::vector<uint8_t> DeltaStore::read_record(const StoreEntry& e) const {
+    return read_at(path_, e.offset, e.length);
+}
+
+uint32_t DeltaStore::add(std::span<const uint8_t> version,
+                         const StoreOptions& opts) {
+    auto id = static_cast<uint32_t>(entries_.size());
+    StoreEntry e{};
+    e.version_size = version.size();
+    e.crc = crc64_xz(version.data(), version.size());
+
+    // Delta against the previous version unless the chain would grow past
+    // its limits; then a snapshot restarts it.
+    std::vector<uint8_t> record;
+    if (id > 0 && entries_.back().kind != StoreKind::Pruned
+        && entries_.back().depth + 1 <= opts.max_depth) {
+        const auto& prev = entries_.back();
+        auto base = get(id - 1);
+        auto placed = place_commands(diff(opts.algo, base, version, opts.diff));
+        auto d = encode_delta(placed, false, version.size(), prev.crc, e.crc);
+        uint64_t chain = prev.chain_bytes + d.size();
+        if (d.size() < version.size()
+            && chain <= opts.max_chain_ratio * static_cast<double>(version.size())) {
+            e.kind = StoreKind::Delta;
+            e.parent = id - 1;
+            e.depth = prev.depth + 1;
+            e.chain_bytes = chain;
+            record = std::move(d);
+        }
+    }
+    if (e.kind != StoreKind::Delta) {
+        e.kind = StoreKind::Snapshot;
+        e.parent = id;
+        record.assign(version.begin(), version.end());
+    }
+
+    // Append after the current footer, which stays authoritative until
+    // the new one is durable.
+    e.offset = end_;
+    e.length = record.size();
+    entries_.push_back(e);
+    try {
+        write_tail(end_, record);
+    } catch (...) {
+        entries_.pop_back();
+        throw;
+    }
+
+    // Each add leaves the previous index behind as dead space; compact
+    // once it outweighs the records.
+    uint64_t live = 0;
+    for (const auto& x : entries_) { live += x.length; }
+    if (index_offset_ - sizeof(STORE_MAGIC) - live > live) { rewrite(0); }
+    return id;
+}
+
+std::vector<uint8_t> DeltaStore::get(uint32_t id) const {
+    if (id >= entries_.size() || entries_[id].kind == StoreKind::Pruned) {
+        throw DeltaError("store: no version " + std::to_string(id));
+    }
+
+    // Walk back to the snapshot (at most max_depth links), then compose
+    // the deltas oldest first and apply once.
+    std::vector<uint32_t> chain;
+    uint32_t x = id;
+    while (entries_[x].kind == StoreKind::Delta) {
+        chain.push_back(x);
+        x = entries_[x].parent;
+    }
+    if (entries_[x].kind != StoreKind::Snapshot) {
+        throw DeltaError("store: version " + std::to_string(id)
+                         + " depends on a pruned version");
+    }
+    auto base = read_record(entries_[x]);
+
+    std::vector<uint8_t> out;
+    if (chain.empty()) {
+        out = std::move(base);
+    } else {
+        std::reverse(chain.begin(), chain.end());
+        std::vector<PlacedCommand> placed;
+        size_t size = entries_[x].version_size;
+        for (size_t i = 0; i < chain.size(); ++i) {
+            auto [cmds, ip, vsize, src, dst] =
+                decode_delta(read_record(entries_[chain[i]]));
+            placed = i == 0 ? std::move(cmds)
+                            : compose_deltas(placed, size, cmds);
+            size = vsize;
+        }
+        out.assign(size, 0);
+        apply_placed_to(base, placed, out);
+    }
+    if (crc64_xz(out.data(), out.size()) != entries_[id].crc) {
+        throw DeltaError("store: version " + std::to_string(id)
+                         + " failed its CRC check");
+    }
+    return out;
+}
+
+void DeltaStore::prune(size_t keep) {
+    if (keep == 0) { throw DeltaError("store: prune must keep >= 1 version"); }
+    if (keep >= entries_.size()) { return; }
+    rewrite(entries_.size() - keep);
+}
+
+void DeltaStore::rewrite(size_t first) {
+    // Rewrite into a temporary pack, then rename over the original.
+    DeltaStore next;
+    next.path_ = path_ + ".tmp";
+    create_pack(next.path_);
+    uint64_t offset = sizeof(STORE_MAGIC);
+    next.entries_.resize(entries_.size());
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        auto e = entries_[i];
+        std::vector<uint8_t> record;
+        if (i < first) {
+            e.kind = StoreKind::Pruned;
+            e.offset = e.length = 0;
+            next.entries_[i] = e;
+            continue;
+        }
+        if (i == first && e.kind == StoreKind::Delta) {
+            record = get(static_cast<uint32_t>(i));
+            e.kind = StoreKind::Snapshot;
+            e.parent = static_cast<uint32_t>(i);
+        } else if (e.kind != StoreKind::Pruned) {
+            record = read_record(e);
+        }
+        if (e.kind == StoreKind::Snapshot) {
+            e.depth = 0;
+            e.chain_bytes = 0;
+        } else if (e.kind == StoreKind::Delta) {
+            e.depth = next.entries_[e.parent].depth + 1;
+            e.chain_bytes = next.entries_[e.parent].chain_bytes + record.size();
+        }
+        e.offset = offset;
+        e.length = record.size();
+        write_durable(next.path_, e.offset, record);
+        offset += record.size();
+        next.entries_[i] = e;
+    }
+    next.write_tail(offset, {});
+    std::filesystem::rename(next.path_, path_);
+    next.path_ = path_;
+    *this = std::move(next);
+}
+
+} // namespace delta
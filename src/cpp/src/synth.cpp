@@ -0,0 +1,400 @@
+#include "delta/synth.h"
+#include "delta/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <thread>
+
+namespace delta {
+
+namespace {
+
+constexpr uint64_t GOLDEN = 0x9E3779B97F4A7C15ULL;
+
+/// Text is generated in independent pages, so any offset is reachable.
+constexpr size_t TEXT_PAGE = 4096;
+constexpr uint64_t TEXT_VOCABULARY_BITS = 14;   // 16383 distinct words
+
+/// Stream keys derived from the seed.
+enum StreamId : uint64_t { STREAM_REFERENCE = 1, STREAM_FRESH, STREAM_MUTATE, STREAM_VOCAB };
+
+/// splitmix64's output function.
+uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t stream_key(uint64_t seed, StreamId id) {
+    return mix(seed * GOLDEN + mix(id));
+}
+
+/// splitmix64; unlike <random>'s distributions, the same on every
+/// platform.
+class SynthRng {
+public:
+    explicit SynthRng(uint64_t seed) : state_(seed) {}
+    uint64_t next() { return mix(state_ += GOLDEN); }
+    /// Uniform in [0, n).
+    uint64_t below(uint64_t n) {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * n) >> 64);
+    }
+    /// Uniform in [0, 1).
+    double uniform() { return static_cast<double>(next() >> 11) * 0x1p-53; }
+
+private:
+    uint64_t state_;
+};
+
+/// Word i of a random stream is mix(key + (i + 1) * GOLDEN), little-endian.
+void fill_random(uint64_t key, uint64_t offset, std::span<uint8_t> out) {
+    size_t i = 0;
+    while (i < out.size()) {
+        uint64_t pos = offset + i;
+        uint64_t v = mix(key + (pos / 8 + 1) * GOLDEN);
+        size_t skip = pos % 8;
+        size_t n = std::min<size_t>(8 - skip, out.size() - i);
+        if constexpr (std::endian::native == std::endian::little) {
+            std::memcpy(out.data() + i, reinterpret_cast<const uint8_t*>(&v) + skip, n);
+        } else {
+            for (size_t j = 0; j < n; ++j) {
+                out[i + j] = static_cast<uint8_t>(v >> (8 * (skip + j)));
+            }
+        }
+        i += n;
+    }
+}
+
+/// A content stream addressed by offset.
+class Stream {
+public:
+    enum Kind { Random, Image, Text };
+
+    Stream(Kind kind, uint64_t key, uint64_t vocab_key) : kind_(kind), key_(key) {
+        if (kind == Text) { build_vocabulary(vocab_key); }
+    }
+
+    void fill(uint64_t offset, std::span<uint8_t> out) {
+        switch (kind_) {
+        case Random:
+            fill_random(key_, offset, out);
+            break;
+        case Image:
+            // A quarter of the sectors hold data; the rest are zero.
+            for (size_t i = 0; i < out.size(); ) {
+                uint64_t pos = offset + i;
+                uint64_t sector = pos / SYNTH_SECTOR;
+                size_t n = std::min<size_t>(SYNTH_SECTOR - pos % SYNTH_SECTOR,
+                                            out.size() - i);
+                if (mix(key_ ^ mix(sector)) % 4 == 0) {
+                    fill_random(key_, pos, out.subspan(i, n));
+                } else {
+                    std::memset(out.data() + i, 0, n);
+                }
+                i += n;
+            }
+            break;
+        case Text:
+            for (size_t i = 0; i < out.size(); ) {
+                uint64_t pos = offset + i;
+                const uint8_t* page = text_page(pos / TEXT_PAGE);
+                size_t at = pos % TEXT_PAGE;
+                size_t n = std::min(TEXT_PAGE - at, out.size() - i);
+                std::memcpy(out.data() + i, page + at, n);
+                i += n;
+            }
+            break;
+        }
+    }
+
+private:
+    /// Word w is spelled by mix(vocab_key + w); higher ranks are longer.
+    /// Each sits in a 16-byte slot so that it copies in one fixed move.
+    void build_vocabulary(uint64_t vocab_key) {
+        size_t n = (size_t{1} << TEXT_VOCABULARY_BITS) - 1;
+        words_.assign(n * 16, ' ');
+        word_len_.resize(n);
+        for (uint64_t w = 0; w < n; ++w) {
+            uint64_t h = mix(vocab_key + w * GOLDEN);
+            uint64_t letters = mix(h);
+            size_t len = std::min<size_t>(1 + h % 4 + std::bit_width(w + 1) / 2, 12);
+            for (size_t j = 0; j < len; ++j) {
+                words_[w * 16 + j] = static_cast<uint8_t>('a' + ((letters >> (5 * j)) & 31) % 26);
+            }
+            word_len_[w] = static_cast<uint8_t>(len);
+        }
+    }
+
+    /// Words drawn log-uniformly by rank (a Zipf distribution: a uniform
+    /// bit width, then a uniform rank of that width), separated by
+    /// spaces, commas and line breaks.
+    const uint8_t* text_page(uint64_t index) {
+        if (index == page_index_) { return page_.data(); }
+        page_.resize(TEXT_PAGE + 32);
+        uint8_t* out = page_.data();
+        uint8_t* const stop = out + TEXT_PAGE;
+        SynthRng rng(key_ ^ mix(index));
+        while (out < stop) {
+            uint64_t x = rng.next();
+            uint64_t width = 1 + (x & 15) % TEXT_VOCABULARY_BITS;
+            uint64_t half = uint64_t{1} << (width - 1);
+            uint64_t rank = half - 1 + ((x >> 8) & (half - 1));
+            std::memcpy(out, words_.data() + rank * 16, 16);   // slack covers the overrun
+            out += word_len_[rank];
+            uint64_t sep = (x >> 32) & 63;
+            if (sep < 4) {
+                *out++ = '.';
+                *out++ = '\n';
+            } else if (sep < 8) {
+                *out++ = ',';
+                *out++ = ' ';
+            } else {
+                *out++ = ' ';
+            }
+        }
+        page_index_ = index;
+        return page_.data();
+    }
+
+    Kind kind_;
+    uint64_t key_;
+    std::vector<uint8_t> words_;          // text: the vocabulary
+    std::vector<uint8_t> word_len_;
+    std::vector<uint8_t> page_;
+    uint64_t page_index_ = UINT64_MAX;
+};
+
+Stream reference_stream(const SynthOptions& o) {
+    auto kind = o.scenario == SynthScenario::Image ? Stream::Image
+        : o.scenario == SynthScenario::Text ? Stream::Text : Stream::Random;
+    return {kind, stream_key(o.seed, STREAM_REFERENCE), stream_key(o.seed, STREAM_VOCAB)};
+}
+
+Stream fresh_stream(const SynthOptions& o) {
+    auto kind = o.scenario == SynthScenario::Text ? Stream::Text : Stream::Random;
+    return {kind, stream_key(o.seed, STREAM_FRESH), stream_key(o.seed, STREAM_VOCAB)};
+}
+
+/// Appends version segments, merging contiguous runs.
+class PlanBuilder {
+public:
+    explicit PlanBuilder(SynthPlan& plan) : plan_(plan) {}
+
+    void copy(uint64_t src, uint64_t len) { add(SynthSegment::Copy, src, len); }
+    void fresh(uint64_t len) {
+        add(SynthSegment::Fresh, fresh_, len);
+        fresh_ += len;
+    }
+    void zero(uint64_t len) { add(SynthSegment::Zero, 0, len); }
+
+private:
+    void add(SynthSegment::Kind kind, uint64_t src, uint64_t len) {
+        if (len == 0) { return; }
+        auto& segs = plan_.segments;
+        if (!segs.empty() && segs.back().kind == kind
+            && (kind == SynthSegment::Zero
+                || segs.back().source + segs.back().length == src)) {
+            segs.back().length += len;
+        } else {
+            segs.push_back({plan_.version_size, len, src, kind});
+        }
+        plan_.version_size += len;
+    }
+
+    SynthPlan& plan_;
+    uint64_t fresh_ = 0;
+};
+
+} // anonymous namespace
+
+SynthScenario synth_scenario(const std::string& name) {
+    for (size_t i = 0; i < std::size(SYNTH_SCENARIO_NAMES); ++i) {
+        if (name == SYNTH_SCENARIO_NAMES[i]) { return static_cast<SynthScenario>(i); }
+    }
+    throw DeltaError("unknown synth scenario '" + name + "'");
+}
+
+SynthPlan synth_plan(const SynthOptions& opts) {
+    if (opts.block_min == 0 || opts.block_min > opts.block_max) {
+        throw DeltaError("synth: need 0 < block_min <= block_max");
+    }
+    if (!(opts.rate >= 0) || (opts.rate > 1 && opts.scenario != SynthScenario::Append)) {
+        throw DeltaError("synth: rate must be in [0, 1]");
+    }
+
+    SynthPlan plan;
+    plan.opts = opts;
+    plan.ref_size = opts.size;
+    PlanBuilder b(plan);
+    SynthRng rng(stream_key(opts.seed, STREAM_REFERENCE) ^ static_cast<uint64_t>(opts.scenario));
+    const uint64_t size = opts.size;
+    auto block_len = [&] {
+        return opts.block_min + rng.below(opts.block_max - opts.block_min + 1);
+    };
+
+    switch (opts.scenario) {
+    case SynthScenario::Transpose: {
+        std::vector<uint64_t> starts;
+        for (uint64_t off = 0; off < size; off += block_len()) { starts.push_back(off); }
+        size_t n = starts.size();
+        starts.push_back(size);
+
+        // Displace k blocks: pick them, then shuffle them among themselves.
+        auto k = static_cast<size_t>(std::llround(opts.rate * n));
+        std::vector<uint64_t> chosen(n);
+        std::iota(chosen.begin(), chosen.end(), 0);
+        for (size_t i = 0; i < k; ++i) {
+            std::swap(chosen[i], chosen[i + rng.below(n - i)]);
+        }
+        chosen.resize(k);
+        std::vector<uint64_t> perm(n);
+        std::iota(perm.begin(), perm.end(), 0);
+        std::vector<uint64_t> values = chosen;
+        for (size_t i = k; i > 1; --i) { std::swap(values[i - 1], values[rng.below(i)]); }
+        for (size_t i = 0; i < k; ++i) { perm[chosen[i]] = values[i]; }
+
+        for (size_t i = 0; i < n; ++i) {
+            b.copy(starts[perm[i]], starts[perm[i] + 1] - starts[perm[i]]);
+            plan.blocks_changed += perm[i] != i;
+        }
+        break;
+    }
+    case SynthScenario::Edits:
+    case SynthScenario::Text:
+        for (uint64_t off = 0; off < size; ) {
+            uint64_t end = std::min(off + block_len(), size);
+            if (rng.uniform() < opts.rate) {
+                uint64_t p = off + rng.below(end - off);
+                uint64_t len = 1 + rng.below(SYNTH_MAX_EDIT);
+                b.copy(off, p - off);
+                if (rng.next() & 1) {
+                    b.fresh(len);
+                    b.copy(p, end - p);
+                } else {
+                    uint64_t cut = std::min(len, end - p);
+                    b.copy(p + cut, end - p - cut);
+                }
+                ++plan.blocks_changed;
+            } else {
+                b.copy(off, end - off);
+            }
+            off = end;
+        }
+        break;
+    case SynthScenario::Mutate:
+        b.copy(0, size);
+        for (uint64_t off = 0; off < size; ) {
+            uint64_t end = std::min(off + block_len(), size);
+            if (rng.uniform() < opts.rate) {
+                plan.mutations.push_back(off + rng.below(end - off));
+                ++plan.blocks_changed;
+            }
+            off = end;
+        }
+        break;
+    case SynthScenario::Append:
+        b.copy(0, size);
+        b.fresh(static_cast<uint64_t>(std::llround(opts.rate * static_cast<double>(size))));
+        break;
+    case SynthScenario::Image:
+        for (uint64_t off = 0; off < size; off += SYNTH_SECTOR) {
+            uint64_t len = std::min<uint64_t>(SYNTH_SECTOR, size - off);
+            if (rng.uniform() < opts.rate) {
+                if (rng.below(4) == 0) { b.zero(len); } else { b.fresh(len); }
+                ++plan.blocks_changed;
+            } else {
+                b.copy(off, len);
+            }
+        }
+        break;
+    }
+    return plan;
+}
+
+void synth_fill_reference(const SynthPlan& plan, uint64_t offset, std::span<uint8_t> out) {
+    reference_stream(plan.opts).fill(offset, out);
+}
+
+void synth_fill_version(const SynthPlan& plan, uint64_t offset, std::span<uint8_t> out) {
+    if (out.empty()) { return; }
+    auto ref = reference_stream(plan.opts);
+    auto fresh = fresh_stream(plan.opts);
+    const auto& segs = plan.segments;
+    auto it = std::upper_bound(segs.begin(), segs.end(), offset,
+        [](uint64_t pos, const SynthSegment& s) { return pos < s.start; });
+    size_t i = 0;
+    for (--it; i < out.size(); ++it) {
+        uint64_t into = offset + i - it->start;
+        size_t n = static_cast<size_t>(std::min<uint64_t>(it->length - into, out.size() - i));
+        auto piece = out.subspan(i, n);
+        switch (it->kind) {
+        case SynthSegment::Copy:  ref.fill(it->source + into, piece); break;
+        case SynthSegment::Fresh: fresh.fill(it->source + into, piece); break;
+        case SynthSegment::Zero:  std::memset(piece.data(), 0, n); break;
+        }
+        i += n;
+    }
+
+    uint64_t key = stream_key(plan.opts.seed, STREAM_MUTATE);
+    for (auto m = std::lower_bound(plan.mutations.begin(), plan.mutations.end(), offset);
+         m != plan.mutations.end() && *m < offset + out.size(); ++m) {
+        out[*m - offset] ^= static_cast<uint8_t>(1 + mix(key + *m) % 255);
+    }
+}
+
+void synth_generate(const SynthPlan& plan, std::span<uint8_t> ref, std::span<uint8_t> ver) {
+    TraceSpan tr("synth");
+    if (!ref.empty() && ref.size() != plan.ref_size) {
+        throw DeltaError("synth: reference buffer is not ref_size bytes");
+    }
+    if (!ver.empty() && ver.size() != plan.version_size) {
+        throw DeltaError("synth: version buffer is not version_size bytes");
+    }
+    size_t ref_chunks = (ref.size() + SYNTH_CHUNK - 1) / SYNTH_CHUNK;
+    size_t chunks = ref_chunks + (ver.size() + SYNTH_CHUNK - 1) / SYNTH_CHUNK;
+    size_t n_threads = plan.opts.threads > 0
+        ? plan.opts.threads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    n_threads = std::max<size_t>(std::min(n_threads, chunks), 1);
+
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        if (n_threads > 1) { trace_thread_name("synth worker"); }
+        for (size_t c = next++; c < chunks; c = next++) {
+            bool is_ref = c < ref_chunks;
+            auto out = is_ref ? ref : ver;
+            size_t off = (is_ref ? c : c - ref_chunks) * SYNTH_CHUNK;
+            auto piece = out.subspan(off, std::min(SYNTH_CHUNK, out.size() - off));
+            TraceSpan tr_chunk(is_ref ? "synth reference" : "synth version", "task",
+                               "offset", off);
+            if (is_ref) {
+                synth_fill_reference(plan, off, piece);
+            } else {
+                synth_fill_version(plan, off, piece);
+            }
+        }
+    };
+
+    if (n_threads == 1) {
+        worker();
+    } else {
+        std::vector<std::thread> pool;
+        pool.reserve(n_threads);
+        for (size_t t = 0; t < n_threads; ++t) { pool.emplace_back(worker); }
+        for (auto& th : pool) { th.join(); }
+    }
+}
+
+SynthPair synth_pair(const SynthOptions& opts) {
+    auto plan = synth_plan(opts);
+    SynthPair pair;
+    pair.reference.resize(plan.ref_size);
+    pair.version.resize(plan.version_size);
+    synth_generate(plan, pair.reference, pair.version);
+    return pair;
+}
+
+} // namespace delta
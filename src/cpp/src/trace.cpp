@@ -0,0 +1,209 @@
+#include "delta/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <unistd.h>
+
+namespace delta {
+
+namespace {
+
+struct TraceEvent {
+    uint64_t begin, end;          // trace_clock() nanoseconds
+    const char* name;
+    const char* cat;
+    const char* arg_name;         // nullptr: no args
+    uint64_t arg;
+};
+
+/// One thread's ring.  Only its thread writes (and grows) it;
+/// trace_json() reads it once the writers are quiet.
+struct ThreadBuffer {
+    uint32_t tid;
+    const char* name = nullptr;
+    size_t capacity;                   // ring stops growing here
+    std::vector<TraceEvent> ring;
+    std::atomic<uint64_t> written{0};
+};
+
+struct Tracer {
+    std::atomic<bool> enabled{false};
+    std::atomic<uint64_t> generation{0};   // bumped by start_tracing()
+    std::atomic<int64_t> t0{0};            // steady_clock ns at start
+    std::mutex mu;                         // guards the members below
+    size_t capacity = TRACE_DEFAULT_EVENTS;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+    std::set<std::string> interned;
+};
+
+Tracer& tracer() {
+    static Tracer t;
+    return t;
+}
+
+int64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// The calling thread's buffer for the current trace, registered on
+/// first use.
+ThreadBuffer& thread_buffer() {
+    thread_local ThreadBuffer* buf = nullptr;
+    thread_local uint64_t buf_generation = 0;
+    auto& t = tracer();
+    uint64_t gen = t.generation.load(std::memory_order_acquire);
+    if (!buf || buf_generation != gen) {
+        std::lock_guard lock(t.mu);
+        auto b = std::make_unique<ThreadBuffer>();
+        b->tid = static_cast<uint32_t>(t.threads.size() + 1);
+        b->capacity = t.capacity;
+        b->ring.resize(std::min(TRACE_INITIAL_EVENTS, t.capacity));
+        buf = b.get();
+        buf_generation = gen;
+        t.threads.push_back(std::move(b));
+    }
+    return *buf;
+}
+
+void put_json_string(std::string& out, const char* s) {
+    out += '"';
+    for (; *s; ++s) {
+        auto c = static_cast<unsigned char>(*s);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    out += '"';
+}
+
+} // anonymous namespace
+
+void start_tracing(size_t events_per_thread) {
+    auto& t = tracer();
+    std::lock_guard lock(t.mu);
+    t.threads.clear();
+    t.capacity = std::max<size_t>(events_per_thread, 1);
+    t.t0.store(steady_ns(), std::memory_order_relaxed);
+    t.generation.fetch_add(1, std::memory_order_release);
+    t.enabled.store(true, std::memory_order_release);
+}
+
+void stop_tracing() {
+    tracer().enabled.store(false, std::memory_order_release);
+}
+
+bool tracing_enabled() {
+    return tracer().enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t trace_clock() {
+    return static_cast<uint64_t>(
+        steady_ns() - tracer().t0.load(std::memory_order_relaxed));
+}
+
+void trace_complete(const char* name, const char* cat, uint64_t begin,
+                    const char* arg_name, uint64_t arg) {
+    if (!tracing_enabled()) { return; }
+    auto& buf = thread_buffer();
+    uint64_t n = buf.written.load(std::memory_order_relaxed);
+    if (n == buf.ring.size() && n < buf.capacity) {
+        // Not wrapped yet, so the events are in order at [0, n).
+        buf.ring.resize(std::min<size_t>(n * 2, buf.capacity));
+    }
+    buf.ring[n % buf.ring.size()] = {begin, trace_clock(), name, cat, arg_name, arg};
+    buf.written.store(n + 1, std::memory_order_release);
+}
+
+void trace_thread_name(const char* name) {
+    if (!tracing_enabled()) { return; }
+    thread_buffer().name = name;
+}
+
+const char* trace_intern(const std::string& name) {
+    auto& t = tracer();
+    std::lock_guard lock(t.mu);
+    return t.interned.insert(name).first->c_str();
+}
+
+uint64_t trace_dropped_events() {
+    auto& t = tracer();
+    std::lock_guard lock(t.mu);
+    uint64_t dropped = 0;
+    for (const auto& b : t.threads) {
+        uint64_t n = b->written.load(std::memory_order_acquire);
+        if (n > b->ring.size()) { dropped += n - b->ring.size(); }
+    }
+    return dropped;
+}
+
+std::string trace_json() {
+    auto& t = tracer();
+    uint64_t dropped = trace_dropped_events();
+    std::lock_guard lock(t.mu);
+    std::string out = "{\"traceEvents\":[";
+    char buf[128];
+    int pid = static_cast<int>(::getpid());
+    bool first = true;
+    auto sep = [&] {
+        if (!first) { out += ",\n"; }
+        first = false;
+    };
+    auto metadata = [&](const char* what, uint32_t tid, const char* name) {
+        sep();
+        std::snprintf(buf, sizeof(buf),
+            "{\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"name\":\"%s\",\"args\":{\"name\":",
+            pid, tid, what);
+        out += buf;
+        put_json_string(out, name);
+        out += "}}";
+    };
+
+    metadata("process_name", 0, "delta");
+    for (const auto& b : t.threads) {
+        std::string fallback = "thread " + std::to_string(b->tid);
+        metadata("thread_name", b->tid, b->name ? b->name : fallback.c_str());
+        uint64_t n = b->written.load(std::memory_order_acquire);
+        uint64_t cap = b->ring.size();
+        for (uint64_t i = n > cap ? n - cap : 0; i < n; ++i) {
+            const auto& e = b->ring[i % cap];
+            sep();
+            out += "{\"ph\":\"X\",\"name\":";
+            put_json_string(out, e.name);
+            out += ",\"cat\":";
+            put_json_string(out, e.cat);
+            // Microseconds, nanosecond precision.
+            std::snprintf(buf, sizeof(buf),
+                ",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u",
+                e.begin / 1e3, (e.end - e.begin) / 1e3, pid, b->tid);
+            out += buf;
+            if (e.arg_name) {
+                out += ",\"args\":{";
+                put_json_string(out, e.arg_name);
+                out += ':' + std::to_string(e.arg) + '}';
+            }
+            out += '}';
+        }
+    }
+    std::snprintf(buf, sizeof(buf),
+        "],\n\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":%llu}}\n",
+        static_cast<unsigned long long>(dropped));
+    out += buf;
+    return out;
+}
+
+} // namespace delta
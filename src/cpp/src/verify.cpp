@@ -0,0 +1,171 @@
+#include "delta/verify.h"
+#include "delta/apply.h"
+#include "delta/crc64.h"
+#include "delta/encoding.h"
+#include "delta/trace.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <vector>
+
+namespace delta {
+
+namespace {
+
+/// True if, executed in file order, some copy reads bytes that an
+/// earlier command wrote (so the standard reading would differ).
+bool reads_overwritten(const std::vector<PlacedCommand>& commands) {
+    std::map<size_t, size_t> written; // start -> end, disjoint
+    auto overlaps = [&](size_t lo, size_t hi) {
+        auto it = written.upper_bound(lo);
+        if (it != written.begin() && std::prev(it)->second > lo) { return true; }
+        return it != written.end() && it->first < hi;
+    };
+    auto mark = [&](size_t lo, size_t hi) {
+        auto it = written.upper_bound(lo);
+        if (it != written.begin() && std::prev(it)->second >= lo) {
+            --it;
+            lo = it->first;
+            hi = std::max(hi, it->second);
+            it = written.erase(it);
+        }
+        while (it != written.end() && it->first <= hi) {
+            hi = std::max(hi, it->second);
+            it = written.erase(it);
+        }
+        written.emplace(lo, hi);
+    };
+    for (const auto& cmd : commands) {
+        if (const auto* c = std::get_if<PlacedCopy>(&cmd)) {
+            if (c->length == 0) { continue; }
+            if (overlaps(c->src, c->src + c->length)) { return true; }
+            mark(c->dst, c->dst + c->length);
+        } else {
+            const auto& a = std::get<PlacedAdd>(cmd);
+            if (!a.data.empty()) { mark(a.dst, a.dst + a.data.size()); }
+        }
+    }
+    return false;
+}
+
+} // anonymous namespace
+
+VerifyResult verify_delta(
+    std::span<const uint8_t> r,
+    std::span<const uint8_t> delta,
+    const std::array<uint8_t, DELTA_CRC_SIZE>* r_crc) {
+
+    TraceSpan tr_verify("verify", "phase", "delta_bytes", delta.size());
+    VerifyResult res;
+    std::vector<PlacedCommand> commands;
+    bool ip;
+    size_t version_size;
+    std::array<uint8_t, DELTA_CRC_SIZE> src_crc, dst_crc;
+    try {
+        std::tie(commands, ip, version_size, src_crc, dst_crc) = decode_delta(delta);
+    } catch (const DeltaError& e) {
+        res.error = e.what();
+        return res;
+    }
+    res.inplace = ip;
+    res.version_size = version_size;
+
+    auto have = r_crc ? *r_crc : crc64_xz(r.data(), r.size());
+    if (have != src_crc) {
+        res.error = "reference does not match delta";
+        return res;
+    }
+
+    // Bounds first, so neither path below can read or write out of range.
+    size_t buf_size = ip ? std::max(r.size(), version_size) : r.size();
+    for (const auto& cmd : commands) {
+        if (const auto* c = std::get_if<PlacedCopy>(&cmd)) {
+            if (c->src + c->length > buf_size || c->dst + c->length > version_size) {
+                res.error = "copy out of range";
+                return res;
+            }
+        } else {
+            const auto& a = std::get<PlacedAdd>(cmd);
+            if (a.dst + a.data.size() > version_size) {
+                res.error = "add out of range";
+                return res;
+            }
+        }
+    }
+
+    std::array<uint8_t, DELTA_CRC_SIZE> out_crc;
+    if (ip && reads_overwritten(commands)) {
+        res.streamed = false;
+        auto out = apply_delta_inplace(r, commands, version_size);
+        out_crc = crc64_xz(out.data(), out.size());
+    } else {
+        if (ip && std::any_of(commands.begin(), commands.end(), [&](const PlacedCommand& cmd) {
+                const auto* c = std::get_if<PlacedCopy>(&cmd);
+                return c && c->src + c->length > r.size();
+            })) {
+            res.error = "copy out of range";
+            return res;
+        }
+        // Sweep the output in destination order.  Where commands overlap,
+        // each byte comes from the last of them in file order, as in a
+        // full decode.  A byte no command writes stays zero, or in an
+        // in-place delta keeps the reference byte the buffer started with.
+        struct Piece { size_t at, len; const uint8_t* p; };
+        std::vector<Piece> pieces; // file order
+        pieces.reserve(commands.size());
+        for (const auto& cmd : commands) {
+            if (const auto* c = std::get_if<PlacedCopy>(&cmd)) {
+                if (c->length > 0) { pieces.push_back({c->dst, c->length, r.data() + c->src}); }
+            } else {
+                const auto& a = std::get<PlacedAdd>(cmd);
+                if (!a.data.empty()) { pieces.push_back({a.dst, a.data.size(), a.data.data()}); }
+            }
+        }
+        std::vector<size_t> order(pieces.size());
+        for (size_t i = 0; i < order.size(); ++i) { order[i] = i; }
+        std::sort(order.begin(), order.end(),
+                  [&](size_t a, size_t b) { return pieces[a].at < pieces[b].at; });
+        static const uint8_t zeros[4096] = {};
+        Crc64Xz crc;
+        std::priority_queue<size_t> active; // pieces covering pos, latest on top
+        size_t pos = 0, next = 0;
+        while (pos < version_size) {
+            while (next < order.size() && pieces[order[next]].at <= pos) {
+                active.push(order[next++]);
+            }
+            while (!active.empty()
+                   && pieces[active.top()].at + pieces[active.top()].len <= pos) {
+                active.pop(); // finished; pieces below the top are popped as they surface
+            }
+            size_t until = next < order.size() ? pieces[order[next]].at : version_size;
+            if (active.empty()) {
+                if (ip && pos < r.size()) {
+                    size_t n = std::min(until, r.size()) - pos;
+                    crc.update(r.data() + pos, n);
+                    pos += n;
+                }
+                for (size_t n; pos < until; pos += n) {
+                    n = std::min(sizeof(zeros), until - pos);
+                    crc.update(zeros, n);
+                }
+                continue;
+            }
+            const auto& top = pieces[active.top()];
+            until = std::min(until, top.at + top.len);
+            crc.update(top.p + (pos - top.at), until - pos);
+            pos = until;
+        }
+        out_crc = crc.digest();
+    }
+
+    if (out_crc != dst_crc) {
+        res.error = "output integrity check failed";
+        return res;
+    }
+    res.ok = true;
+    return res;
+}
+
+} // namespace delta
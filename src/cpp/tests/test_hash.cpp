@@ -153,3 +153,25 @@ TEST_CASE("crc64_xz differs on different input", "[hash]") {
     uint8_t b[] = {'a', 'b', 'd'};
     CHECK(crc64_xz(a, 3) != crc64_xz(b, 3));
 }
+
+TEST_CASE("crc64_xz_combine matches the CRC of the concatenation", "[hash]") {
+    std::vector<uint8_t> data(10000);
+    for (size_t i = 0; i < data.size(); ++i) { data[i] = static_cast<uint8_t>(i * 131 + 7); }
+    auto whole = crc64_xz(data.data(), data.size());
+    for (size_t cut : {size_t{0}, size_t{1}, size_t{9}, size_t{4096}, data.size()}) {
+        auto a = crc64_xz(data.data(), cut);
+        auto b = crc64_xz(data.data() + cut, data.size() - cut);
+        CHECK(crc64_xz_combine(a, b, data.size() - cut) == whole);
+    }
+}
+
+TEST_CASE("Crc64Xz streams to the same CRC as crc64_xz", "[hash]") {
+    std::vector<uint8_t> data(10000);
+    for (size_t i = 0; i < data.size(); ++i) { data[i] = static_cast<uint8_t>(i * 57 + 3); }
+    Crc64Xz crc;
+    for (size_t pos = 0, step = 1; pos < data.size(); pos += step, step = step * 2 + 1) {
+        crc.update(data.data() + pos, std::min(step, data.size() - pos));
+    }
+    CHECK(crc.digest() == crc64_xz(data.data(), data.size()));
+    CHECK(Crc64Xz().digest() == crc64_xz(nullptr, 0));
+}
@@ -2,10 +2,24 @@
 #include <delta/delta.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <numeric>
 #include <random>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 using namespace delta;
 
 // ── helpers ──────────────────────────────────────────────────────────────
@@ -64,6 +78,7 @@ static std::vector<AlgoEntry> all_algos() {
         {"greedy", diff_greedy},
         {"onepass", diff_onepass},
         {"correcting", diff_correcting},
+        {"hierarchical", diff_hierarchical},
     };
 }
 
@@ -71,6 +86,37 @@ static std::vector<CyclePolicy> all_policies() {
     return {CyclePolicy::Constant, CyclePolicy::Localmin};
 }
 
+/// Scratch directory under the system temp dir, named per test and
+/// process, and removed on scope exit (also when a REQUIRE fails).
+struct TempDir {
+    std::filesystem::path path;
+
+    explicit TempDir(const std::string& name)
+        : path(std::filesystem::temp_directory_path()
+               / ("delta_" + name + "_test_" + std::to_string(::getpid()))) {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~TempDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(path, ec);
+    }
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    std::string file(const char* name) const { return (path / name).string(); }
+};
+
+static void write_bytes(const std::filesystem::path& path, std::span<const uint8_t> data) {
+    std::ofstream(path, std::ios::binary).write(
+        reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+}
+
+static std::vector<uint8_t> read_bytes(const std::filesystem::path& path) {
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
 static std::vector<uint8_t> repeat(std::span<const uint8_t> base, size_t count) {
     std::vector<uint8_t> out;
     out.reserve(base.size() * count);
@@ -645,6 +691,1203 @@ TEST_CASE("correcting checkpointing various sizes", "[correcting]") {
     }
 }
 
+// ── hierarchical tests ──────────────────────────────────────────────────
+
+TEST_CASE("hierarchical coarse and fine matches", "[hierarchical]") {
+    std::mt19937 rng(7);
+    std::vector<uint8_t> r(200000);
+    for (auto& b : r) b = rng() & 0xFF;
+    // Large moved block, small edits near copies, and a short insertion.
+    std::vector<uint8_t> v(r.begin() + 100000, r.begin() + 150000);
+    v.insert(v.end(), r.begin(), r.begin() + 100000);
+    v.insert(v.end(), r.begin() + 150000, r.end());
+    std::uniform_int_distribution<size_t> dist(0, v.size() - 1);
+    for (int i = 0; i < 50; ++i) {
+        v[dist(rng)] ^= 0x5A;
+    }
+    v.insert(v.begin() + 60000, {'n','e','w',' ','b','y','t','e','s'});
+
+    DiffOptions o;
+    o.p = 16;
+    o.coarse_p = 256;
+    auto cmds = diff_hierarchical(r, v, o);
+    REQUIRE(apply_delta(r, cmds) == v);
+
+    // The fine pass recovers the bytes between edits: nearly all of V
+    // is copied even though most gaps are shorter than coarse_p.
+    auto stats = delta_summary(cmds);
+    CHECK(stats.add_bytes < 50 * 32 + 9);
+}
+
+TEST_CASE("hierarchical coarse_p smaller than p", "[hierarchical]") {
+    std::vector<uint8_t> r(3000);
+    std::iota(r.begin(), r.end(), 0);
+    std::vector<uint8_t> v(r.begin() + 1000, r.end());
+    v.insert(v.end(), r.begin(), r.begin() + 1000);
+    DiffOptions o;
+    o.p = 16;
+    o.coarse_p = 4;
+    REQUIRE(apply_delta(r, diff_hierarchical(r, v, o)) == v);
+}
+
+// ── post-pass tests ─────────────────────────────────────────────────────
+
+TEST_CASE("rematch recovers copies inside adds", "[postpass]") {
+    std::mt19937 rng(11);
+    std::vector<uint8_t> r(6000);
+    for (auto& b : r) b = rng() & 0xFF;
+    // The middle 2000 bytes arrive as one literal with two edits; the
+    // surrounding copies anchor the local index.
+    std::vector<uint8_t> mid(r.begin() + 2000, r.begin() + 4000);
+    mid[500] ^= 1;
+    mid[1500] ^= 1;
+    std::vector<Command> cmds = {
+        CopyCmd{0, 2000}, AddCmd{mid}, CopyCmd{4000, 2000}};
+    auto v = apply_delta(r, cmds);
+
+    for (size_t threads : {size_t{1}, size_t{4}}) {
+        DiffOptions o;
+        o.threads = threads;
+        auto out = rematch_adds(r, cmds, o);
+        REQUIRE(apply_delta(r, out) == v);
+        auto stats = delta_summary(out);
+        CHECK(stats.num_copies == 5);
+        CHECK(stats.add_bytes == 2);
+    }
+
+    // A gap far wider than the reach: the local index stays within the
+    // memory limit, and matches found near an anchor still extend over
+    // the whole gap.
+    std::vector<uint8_t> big(600000);
+    for (auto& b : big) b = rng() & 0xFF;
+    std::vector<Command> wide = {
+        CopyCmd{0, 1000},
+        AddCmd{std::vector<uint8_t>(big.begin() + 1000, big.end() - 1000)},
+        CopyCmd{big.size() - 1000, 1000}};
+    DiffOptions o;
+    o.threads = 1;
+    o.memory_limit = 1 << 20;
+    auto base = memory_usage().total_current;
+    MemoryWatch watch;
+    auto out = rematch_adds(big, wide, o);
+    CHECK(watch.peak() <= base + o.memory_limit);
+    REQUIRE(apply_delta(big, out) == big);
+    CHECK(delta_summary(out).add_bytes == 0);
+}
+
+TEST_CASE("rematch via dispatcher roundtrips", "[postpass]") {
+    std::mt19937 rng(5);
+    std::vector<uint8_t> r(20000);
+    for (auto& b : r) b = rng() & 0xFF;
+    auto v = r;
+    for (size_t i = 0; i < v.size(); i += 997) { v[i] ^= 0xFF; }
+    for (auto algo : {Algorithm::Greedy, Algorithm::Onepass,
+                      Algorithm::Correcting, Algorithm::Hierarchical}) {
+        DiffOptions o;
+        o.rematch = true;
+        o.rematch_min = 16;
+        auto cmds = diff(algo, r, v, o);
+        REQUIRE(apply_delta(r, cmds) == v);
+    }
+}
+
+TEST_CASE("optimize merges contiguous copies and absorbs short ones", "[postpass]") {
+    std::vector<uint8_t> r(256);
+    std::iota(r.begin(), r.end(), 0);
+    std::vector<Command> cmds = {
+        CopyCmd{0, 50}, CopyCmd{50, 50},              // R-contiguous
+        AddCmd{{1, 2, 3}}, CopyCmd{200, 5}, AddCmd{{4}}, // short copy
+        CopyCmd{10, 12},                                // 12 < 13 bytes
+        CopyCmd{100, 40},
+    };
+    auto v = apply_delta(r, cmds);
+    auto out = optimize_commands(r, cmds);
+    REQUIRE(apply_delta(r, out) == v);
+    REQUIRE(out.size() == 3);
+    CHECK(std::get<CopyCmd>(out[0]) == CopyCmd{0, 100});
+    CHECK(std::get<AddCmd>(out[1]).data.size() == 3 + 5 + 1 + 12);
+    CHECK(std::get<CopyCmd>(out[2]) == CopyCmd{100, 40});
+    CHECK(encoded_cost(out) < encoded_cost(cmds));
+}
+
+TEST_CASE("optimize roundtrip never grows the delta", "[postpass]") {
+    std::mt19937 rng(3);
+    std::vector<uint8_t> r(5000);
+    for (auto& b : r) b = rng() & 0x03; // low entropy: many short matches
+    auto v = r;
+    for (size_t i = 0; i < v.size(); i += 37) { v[i] = rng() & 0xFF; }
+    for (auto& [name, algo] : all_algos()) {
+        auto cmds = algo(r, v, opts(4));
+        auto out = optimize_commands(r, cmds);
+        CHECK(encoded_cost(out) <= encoded_cost(cmds));
+        CHECK(out.size() <= cmds.size());
+
+        auto placed = place_commands(out);
+        auto src_c = crc64_xz(r.data(), r.size());
+        auto dst_c = crc64_xz(v.data(), v.size());
+        auto delta_bytes = encode_delta(placed, false, v.size(), src_c, dst_c);
+        CHECK(delta_bytes.size() == DELTA_HEADER_SIZE + encoded_cost(out) + 1);
+        auto [placed2, ip, vs, sc, dc] = decode_delta(delta_bytes);
+        std::vector<uint8_t> recovered(vs, 0);
+        apply_placed_to(r, placed2, recovered);
+        REQUIRE(recovered == v);
+    }
+}
+
+// ── effort levels ───────────────────────────────────────────────────────
+
+TEST_CASE("trim emits common prefix and suffix as copies", "[effort]") {
+    std::vector<uint8_t> r(1000);
+    std::iota(r.begin(), r.end(), 0);
+    auto v = r;
+    v[500] ^= 0xFF;
+    DiffOptions o;
+    o.trim = true;
+    auto cmds = diff(Algorithm::Onepass, r, v, o);
+    REQUIRE(apply_delta(r, cmds) == v);
+    REQUIRE(cmds.size() == 3);
+    CHECK(std::get<CopyCmd>(cmds.front()) == CopyCmd{0, 500});
+    CHECK(std::get<CopyCmd>(cmds.back()) == CopyCmd{501, 499});
+}
+
+TEST_CASE("every effort level roundtrips", "[effort]") {
+    std::mt19937 rng(9);
+    std::vector<uint8_t> r(50000);
+    for (auto& b : r) b = rng() & 0xFF;
+    std::vector<uint8_t> v(r.begin() + 20000, r.end());
+    v.insert(v.end(), r.begin(), r.begin() + 20000);
+    for (size_t i = 0; i < v.size(); i += 1500) { v[i] ^= 0x42; }
+    for (int level = MIN_EFFORT; level <= MAX_EFFORT; ++level) {
+        auto preset = effort_preset(level, r.size());
+        REQUIRE(apply_delta(r, diff(preset.algo, r, v, preset.opts)) == v);
+    }
+    // Level 1 follows moved blocks, unlike a onepass scan.
+    std::vector<uint8_t> moved(r.begin() + 20000, r.end());
+    moved.insert(moved.end(), r.begin(), r.begin() + 20000);
+    auto fast = effort_preset(MIN_EFFORT, r.size());
+    auto fast_cmds = diff(fast.algo, r, moved, fast.opts);
+    REQUIRE(apply_delta(r, fast_cmds) == moved);
+    CHECK(delta_summary(fast_cmds).copy_bytes > moved.size() * 9 / 10);
+    CHECK_THROWS_AS(effort_preset(0, r.size()), DeltaError);
+    CHECK_THROWS_AS(effort_preset(MAX_EFFORT + 1, r.size()), DeltaError);
+}
+
+// ── time budget ─────────────────────────────────────────────────────────
+
+TEST_CASE("expired time budget still yields a valid delta", "[budget]") {
+    std::mt19937 rng(80);
+    std::vector<uint8_t> r(400000);
+    for (auto& b : r) b = rng() & 0xFF;
+    std::vector<uint8_t> v(r.begin() + 150000, r.end());
+    v.insert(v.end(), r.begin(), r.begin() + 150000);
+
+    DiffOptions expired;
+    expired.deadline = std::chrono::steady_clock::now();
+    expired.rematch = true;
+    expired.optimize = true;
+    for (auto& [name, fn] : all_algos()) {
+        auto cmds = fn(r, v, expired);
+        REQUIRE(apply_delta(r, cmds) == v);
+        CHECK(delta_summary(cmds).add_bytes > 0);
+    }
+    REQUIRE(apply_delta(r, diff(Algorithm::Correcting, r, v, expired)) == v);
+
+    DiffOptions generous;
+    generous.time_budget = 3600;
+    CHECK(diff(Algorithm::Correcting, r, v, generous)
+          == diff(Algorithm::Correcting, r, v));
+    CHECK(diff(Algorithm::Hierarchical, r, v, generous)
+          == diff(Algorithm::Hierarchical, r, v));
+
+    // Called directly, hierarchical's clock starts before its build, and
+    // the build stops indexing once the budget is gone.
+    DiffStats st;
+    DiffOptions tiny;
+    tiny.time_budget = 1e-9;
+    tiny.coarse_p = 16; // enough inserts to reach a deadline check
+    tiny.stats = &st;
+    REQUIRE(apply_delta(r, diff_hierarchical(r, v, tiny)) == v);
+    CHECK(st.budget);
+    CHECK(st.build_indexed < r.size());
+}
+
+// ── best-of-N ───────────────────────────────────────────────────────────
+
+TEST_CASE("best keeps the smallest candidate", "[best]") {
+    std::mt19937 rng(81);
+    std::vector<uint8_t> r(200000);
+    for (auto& b : r) b = rng() & 0xFF;
+    std::vector<uint8_t> v(r.begin() + 70000, r.end());
+    v.insert(v.end(), r.begin(), r.begin() + 70000);
+    for (size_t i = 0; i < v.size(); i += 997) { v[i] ^= 0x5A; }
+
+    auto cands = best_candidates({}, r.size());
+    auto res = diff_best(r, v, cands);
+    REQUIRE(apply_delta(r, res.commands) == v);
+    REQUIRE(res.costs[res.winner] == encoded_cost(res.commands));
+    for (const auto& c : cands) {
+        CHECK(encoded_cost(diff(c.algo, r, v, c.opts))
+              >= encoded_cost(res.commands));
+    }
+    CHECK(apply_delta(r, diff(Algorithm::Best, r, v)) == v);
+}
+
+TEST_CASE("size bound cancels a run that cannot win", "[best]") {
+    std::mt19937 rng(82);
+    std::vector<uint8_t> r(200000);
+    for (auto& b : r) b = rng() & 0xFF;
+    auto v = r;
+    for (size_t i = 0; i < v.size(); i += 200) { v[i] ^= 0x5A; }
+    std::atomic<size_t> bound{1000};
+    DiffOptions o;
+    o.size_bound = &bound;
+    CHECK_THROWS_AS(diff_onepass(r, v, o), DiffCancelled);
+    CHECK_THROWS_AS(diff_correcting(r, v, o), DiffCancelled);
+    CHECK_THROWS_AS(diff_greedy(r, v, o), DiffCancelled);
+    CHECK_THROWS_AS(diff_hierarchical(r, v, o), DiffCancelled);
+    CHECK_THROWS_AS(rematch_adds(r, {AddCmd{v}}, o), DiffCancelled);
+
+    // Hierarchical's coarse scan and its fine pass (rematch_adds) meter a
+    // lower bound: cancelled early on a tight bound, never on its own cost.
+    auto moved = r;
+    for (size_t i = 0; i < moved.size(); i += 2000) { moved[i] ^= 0x5A; }
+    DiffOptions coarse_only = o;
+    coarse_only.fine_pass = false;
+    CHECK_THROWS_AS(diff_hierarchical(r, moved, coarse_only), DiffCancelled);
+    bound = encoded_cost(diff_hierarchical(r, moved));
+    CHECK_NOTHROW(diff_hierarchical(r, moved, o));
+    bound = encoded_cost(rematch_adds(r, {AddCmd{v}}));
+    CHECK_NOTHROW(rematch_adds(r, {AddCmd{v}}, o));
+}
+
+TEST_CASE("best breaks cost ties by candidate index", "[best]") {
+    std::mt19937 rng(181);
+    std::vector<uint8_t> r(200000);
+    for (auto& b : r) b = rng() & 0xFF;
+    auto v = r;
+    for (size_t i = 0; i < v.size(); i += 300) { v[i] ^= 0x5A; }
+
+    // Committed cost equal to the bound is a tie, not a loss.
+    auto cmds = diff_onepass(r, v);
+    size_t cost = encoded_cost(cmds);
+    std::atomic<size_t> bound{cost};
+    DiffOptions o;
+    o.size_bound = &bound;
+    CostMeter tie(o);
+    CHECK_NOTHROW(tie.check(cmds));
+    bound = cost - 1;
+    CostMeter over(o);
+    CHECK_THROWS_AS(over.check(cmds), DiffCancelled);
+
+    // Identical candidates racing: whichever finishes first, the lower
+    // index wins and neither is cancelled.
+    std::vector<BestCandidate> cands(2, BestCandidate{Algorithm::Onepass, {}, "onepass"});
+    DiffOptions race;
+    race.threads = 2;
+    for (int round = 0; round < 8; ++round) {
+        auto res = diff_best(r, v, cands, race);
+        CHECK(res.winner == 0);
+        CHECK(res.costs[0] == std::optional<size_t>(cost));
+        CHECK(res.costs[1] == std::optional<size_t>(cost));
+    }
+}
+
+// ── sketches ────────────────────────────────────────────────────────────
+
+TEST_CASE("sketch estimates shared content", "[sketch]") {
+    std::mt19937 rng(82);
+    std::vector<uint8_t> a(400000), b(400000);
+    for (auto& x : a) x = rng() & 0xFF;
+    for (auto& x : b) x = rng() & 0xFF;
+    // Half of v comes from a, the other half is new.
+    std::vector<uint8_t> v(a.begin(), a.begin() + 200000);
+    v.insert(v.end(), b.begin(), b.begin() + 200000);
+
+    auto sa = make_sketch(a), sb = make_sketch(b), sv = make_sketch(v);
+    CHECK(sketch_jaccard(sa, sa) == 1.0);
+    CHECK(predicted_ratio(sa, sa) == 0.0);
+    double distinct = sketch_distinct(sa);
+    CHECK(distinct > 360000);
+    CHECK(distinct < 440000);
+    double contained = sketch_containment(sv, sa);
+    CHECK(contained > 0.4);
+    CHECK(contained < 0.6);
+    std::vector<uint8_t> unrelated(b.begin() + 300000, b.end());
+    CHECK(predicted_ratio(sv, sa) < predicted_ratio(sv, make_sketch(unrelated)));
+
+    auto bytes = encode_sketch(sv);
+    REQUIRE(is_sketch(bytes));
+    CHECK(decode_sketch(bytes) == sv);
+    bytes.pop_back();
+    CHECK_THROWS_AS(decode_sketch(bytes), DeltaError);
+    CHECK_THROWS_AS(sketch_jaccard(sa, make_sketch(a, 8)), DeltaError);
+
+    // Small inputs are sketched exactly.
+    std::vector<uint8_t> tiny(100, 7);
+    CHECK(make_sketch(tiny).mins.size() == 1);
+}
+
+// ── composition ─────────────────────────────────────────────────────────
+
+TEST_CASE("compose chains deltas without the intermediate", "[compose]") {
+    std::mt19937 rng(83);
+    std::vector<uint8_t> a(60000);
+    for (auto& x : a) x = rng() & 0xFF;
+    auto mutate = [&](std::vector<uint8_t> x) {
+        // Move a block, insert new bytes, flip a few.
+        std::rotate(x.begin() + 1000, x.begin() + 9000, x.begin() + 20000);
+        std::vector<uint8_t> ins(700);
+        for (auto& y : ins) y = rng() & 0xFF;
+        x.insert(x.begin() + 30000, ins.begin(), ins.end());
+        for (size_t i = 0; i < x.size(); i += 4099) { x[i] ^= 0x33; }
+        return x;
+    };
+    auto b = mutate(a), c = mutate(b), d = mutate(c);
+
+    for (auto& [name, fn] : all_algos()) {
+        auto ab = place_commands(fn(a, b, {}));
+        auto bc = place_commands(fn(b, c, {}));
+        auto cd = make_inplace(c, fn(c, d, {}), CyclePolicy::Localmin);
+        auto ac = compose_deltas(ab, b.size(), bc);
+        std::vector<uint8_t> out(c.size());
+        apply_placed_to(a, ac, out);
+        CHECK(out == c);
+
+        // An in-place link composes like a standard one.
+        auto ad = compose_deltas(ac, c.size(), cd);
+        out.assign(d.size(), 0);
+        apply_placed_to(a, ad, out);
+        CHECK(out == d);
+    }
+
+    auto ab = place_commands(diff_onepass(a, b));
+    CHECK_THROWS_AS(compose_deltas(ab, b.size() + 1, ab), DeltaError);
+    std::vector<PlacedCommand> past_end{PlacedCopy{b.size() - 10, 0, 20}};
+    CHECK_THROWS_AS(compose_deltas(ab, b.size(), past_end), DeltaError);
+}
+
+TEST_CASE("store bounds chain depth and survives prune", "[store]") {
+    auto path = (std::filesystem::temp_directory_path()
+                 / ("delta_store_test_" + std::to_string(::getpid()))).string();
+    std::filesystem::remove(path);
+
+    std::mt19937 rng(84);
+    std::vector<uint8_t> v(40000);
+    for (auto& x : v) x = rng() & 0xFF;
+    std::vector<std::vector<uint8_t>> versions;
+    StoreOptions sopts;
+    sopts.max_depth = 4;
+    {
+        auto store = DeltaStore::open(path);
+        for (uint32_t i = 0; i < 30; ++i) {
+            for (int k = 0; k < 5; ++k) { v[rng() % v.size()] ^= 0x5A; }
+            v.insert(v.begin() + rng() % v.size(), 64, static_cast<uint8_t>(i));
+            versions.push_back(v);
+            CHECK(store.add(v, sopts) == i);
+        }
+    }
+
+    // Reopen from disk: every version comes back, no chain deeper than 4.
+    auto store = DeltaStore::open(path);
+    REQUIRE(store.entries().size() == versions.size());
+    size_t deltas = 0;
+    for (uint32_t i = 0; i < versions.size(); ++i) {
+        CHECK(store.entries()[i].depth <= 4);
+        deltas += store.entries()[i].kind == StoreKind::Delta;
+        CHECK(store.get(i) == versions[i]);
+    }
+    CHECK(deltas > versions.size() / 2);
+
+    auto before = std::filesystem::file_size(path);
+    store.prune(7);
+    CHECK(std::filesystem::file_size(path) < before);
+    store = DeltaStore::open(path);
+    CHECK_THROWS_AS(store.get(22), DeltaError);
+    CHECK(store.entries()[23].kind == StoreKind::Snapshot);
+    for (uint32_t i = 23; i < versions.size(); ++i) {
+        CHECK(store.get(i) == versions[i]);
+    }
+    CHECK(store.add(versions[0], sopts) == versions.size());
+    CHECK(store.get(static_cast<uint32_t>(versions.size())) == versions[0]);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("store reopens at the last durable add after a torn one", "[store]") {
+    auto dir = std::filesystem::temp_directory_path();
+    auto path = (dir / ("delta_store_torn_" + std::to_string(::getpid()))).string();
+    auto copy = path + ".copy";
+    std::filesystem::remove(path);
+
+    std::mt19937 rng(184);
+    std::vector<std::vector<uint8_t>> versions(3, std::vector<uint8_t>(30000));
+    for (auto& x : versions[0]) x = rng() & 0xFF;
+    for (size_t i = 1; i < versions.size(); ++i) {
+        versions[i] = versions[i - 1];
+        for (int k = 0; k < 20; ++k) { versions[i][rng() % 30000] ^= 0x33; }
+    }
+    uint64_t before = 0, after = 0;
+    {
+        auto store = DeltaStore::open(path);
+        store.add(versions[0]);
+        store.add(versions[1]);
+        before = std::filesystem::file_size(path);
+        store.add(versions[2]);
+        after = std::filesystem::file_size(path);
+    }
+    REQUIRE(after > before + 1);
+
+    // Cut the last add short: inside its record, inside its index, and
+    // one byte short of its footer.
+    for (uint64_t cut : {before + 1, (before + after) / 2, after - 1}) {
+        std::filesystem::copy_file(path, copy,
+                                   std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::resize_file(copy, cut);
+        auto store = DeltaStore::open(copy);
+        REQUIRE(store.entries().size() == 2);
+        CHECK(std::filesystem::file_size(copy) == before);
+        CHECK(store.get(1) == versions[1]);
+        CHECK(store.add(versions[2]) == 2);
+        CHECK(DeltaStore::open(copy).get(2) == versions[2]);
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(copy);
+}
+
+TEST_CASE("reverse delta from forward matches", "[reverse]") {
+    std::mt19937 rng(85);
+    std::vector<uint8_t> r(50000);
+    for (auto& x : r) x = rng() & 0xFF;
+    // V drops a block of R, moves another and inserts fresh bytes.
+    std::vector<uint8_t> v(r.begin(), r.begin() + 10000);
+    v.insert(v.end(), r.begin() + 30000, r.end());
+    v.insert(v.end(), r.begin() + 15000, r.begin() + 30000);
+    for (int i = 0; i < 2000; ++i) v.push_back(rng() & 0xFF);
+
+    for (auto& [name, fn] : all_algos()) {
+        auto fwd = fn(r, v, {});
+        auto rev = reverse_commands(r, fwd);
+        CHECK(apply_delta(v, rev) == r);
+        // No worse than differencing V -> R from scratch.
+        INFO(name);
+        CHECK(encoded_cost(rev) <= encoded_cost(fn(v, r, {})) + 64);
+    }
+    CHECK(reverse_commands(r, {}).size() == 1);
+    CHECK(reverse_commands({}, diff_onepass({}, v)).empty());
+
+    // Overlapping copies of R[0, 400): past R[0, 100) the span reaching
+    // furthest wins, so R[10, 300) is never used.
+    std::vector<uint8_t> small(r.begin(), r.begin() + 400);
+    std::vector<Command> overlapping = {CopyCmd{0, 100}, CopyCmd{10, 290}, CopyCmd{20, 380}};
+    auto small_v = apply_delta(small, overlapping);
+    auto rev = reverse_commands(small, overlapping);
+    CHECK(apply_delta(small_v, rev) == small);
+    CHECK(rev == std::vector<Command>{CopyCmd{0, 100}, CopyCmd{470, 300}});
+}
+
+TEST_CASE("reference index survives an update through a delta", "[refindex]") {
+    std::mt19937 rng(86);
+    std::vector<uint8_t> r(200000);
+    for (auto& x : r) x = rng() & 0xFF;
+    auto r2 = r;
+    std::rotate(r2.begin() + 5000, r2.begin() + 60000, r2.begin() + 90000);
+    for (int i = 0; i < 20; ++i) {
+        size_t at = rng() % r2.size();
+        std::vector<uint8_t> ins(rng() % 300);
+        for (auto& x : ins) x = rng() & 0xFF;
+        r2.insert(r2.begin() + at, ins.begin(), ins.end());
+    }
+    auto v = r2;
+    for (size_t i = 0; i < v.size(); i += 997) { v[i] ^= 0x11; }
+
+    auto index = build_ref_index(r);
+    auto delta = place_commands(diff_correcting(r, r2));
+    auto crc2 = crc64_xz(r2.data(), r2.size());
+    auto updated = update_ref_index(index, delta, r2, crc2);
+
+    // Every seed is genuine and no gap is wider than the stride.
+    const auto& seeds = updated.seeds;
+    REQUIRE(!seeds.empty());
+    CHECK(seeds.front().offset < updated.stride);
+    CHECK(seeds.back().offset + updated.seed_len + updated.stride > r2.size());
+    for (size_t i = 0; i < seeds.size(); ++i) {
+        CHECK(seeds[i].fp == fingerprint(r2, seeds[i].offset, updated.seed_len));
+        if (i > 0) { CHECK(seeds[i].offset - seeds[i - 1].offset <= updated.stride); }
+    }
+    CHECK(decode_ref_index(encode_ref_index(updated)) == updated);
+
+    // Hierarchical with the updated index matches a fresh run's quality.
+    DiffOptions o;
+    o.ref_index = &updated;
+    auto cmds = diff_hierarchical(r2, v, o);
+    CHECK(apply_delta(r2, cmds) == v);
+    CHECK(encoded_cost(cmds) <= encoded_cost(diff_hierarchical(r2, v)) * 11 / 10);
+    CHECK_THROWS_AS(diff_hierarchical(r, v, o), DeltaError);
+}
+
+TEST_CASE("server encodes and decodes against cached references", "[server]") {
+    TempDir dir("server");
+    auto file = [&](const char* name) { return dir.file(name); };
+
+    std::mt19937 rng(87);
+    std::vector<uint8_t> r(100000);
+    for (auto& x : r) x = rng() & 0xFF;
+    auto v = r;
+    std::rotate(v.begin() + 1000, v.begin() + 40000, v.begin() + 70000);
+    for (size_t i = 0; i < v.size(); i += 3001) { v[i] ^= 0x42; }
+    write_bytes(file("r"), r);
+    write_bytes(file("v"), v);
+
+    std::string sock = file("sock");
+    std::thread server([&] { serve(sock, {}); });
+    auto call = [&](ServerRequest req) {
+        for (int i = 0; i < 200; ++i) {
+            try { return server_call(sock, req); } catch (const DeltaError&) {}
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return server_call(sock, req);
+    };
+
+    ServerRequest enc{ServerOp::Encode, false, "hierarchical", file("r"), file("v"), file("d")};
+    auto first = call(enc);
+    REQUIRE(first.ok);
+    CHECK(first.message.find("loaded") != std::string::npos);
+    enc.inplace = true;
+    auto second = call(enc);
+    REQUIRE(second.ok);
+    CHECK(second.message.find("cached") != std::string::npos);
+
+    auto dec = call({ServerOp::Decode, false, "", file("r"), file("d"), file("out")});
+    REQUIRE(dec.ok);
+    CHECK(read_bytes(file("out")) == v);
+
+    auto bad = call({ServerOp::Encode, false, "nosuch", file("r"), file("v"), file("d")});
+    CHECK_FALSE(bad.ok);
+    struct stat st{};
+    REQUIRE(::stat(sock.c_str(), &st) == 0);
+    CHECK((st.st_mode & 0777) == 0600);
+
+    // An idle client that never closes its connection does not hold up
+    // shutdown.
+    int idle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, sock.c_str(), sizeof(addr.sun_path) - 1);
+    REQUIRE(::connect(idle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    CHECK(call({ServerOp::Shutdown, false, "", "", "", ""}).ok);
+    server.join();
+    ::close(idle);
+}
+
+TEST_CASE("crc cache hits only while the file is unchanged", "[crccache]") {
+    auto dir = std::filesystem::temp_directory_path()
+               / ("delta_crc_cache_test_" + std::to_string(::getpid()));
+    std::filesystem::create_directories(dir);
+    auto file = (dir / "ref").string();
+    auto cache_path = (dir / "cache" / "crc64").string();
+    CrcCache cache(cache_path);
+
+    std::vector<uint8_t> data(5000, 7);
+    std::ofstream(file, std::ios::binary).write(
+        reinterpret_cast<const char*>(data.data()), data.size());
+    int fd = ::open(file.c_str(), O_RDONLY);
+    REQUIRE(fd >= 0);
+    // Just written: hashed but not cached until the file has settled.
+    bool hit = true;
+    auto crc = cached_file_crc(cache, fd, data, &hit);
+    CHECK_FALSE(hit);
+    CHECK(crc == crc64_xz(data.data(), data.size()));
+    CHECK_FALSE(cache.lookup(*file_identity(fd)));
+    CHECK(file_identity(fd) == file_identity(file));
+
+    // A store through another handle is seen by the first one's next lookup.
+    CrcCache(cache_path).store(*file_identity(fd), crc);
+    CHECK(cached_file_crc(cache, fd, data, &hit) == crc);
+    CHECK(hit);
+
+    // Any change to the file changes its identity; the stale entry is ignored.
+    std::filesystem::last_write_time(file, std::filesystem::last_write_time(file)
+                                           - std::chrono::hours(1));
+    CHECK(cached_file_crc(cache, fd, data, &hit) == crc);
+    CHECK_FALSE(hit);
+    CHECK_FALSE(file_identity((dir / "missing").string()));
+    ::close(fd);
+
+    // Past CRC_CACHE_MAX_RECORDS distinct files the oldest are evicted
+    // down to CRC_CACHE_LOW_WATER.
+    std::array<uint8_t, DELTA_CRC_SIZE> fake{};
+    auto fake_id = [](uint64_t i) { return FileIdentity{1, i, 10, 20, 30}; };
+    for (uint64_t i = 0; i < CRC_CACHE_MAX_RECORDS; ++i) { // the last one compacts
+        fake[0] = static_cast<uint8_t>(i);
+        cache.store(fake_id(i), fake);
+    }
+    size_t records = (std::filesystem::file_size(cache_path) - sizeof(CRC_CACHE_MAGIC))
+                     / (5 * 8 + DELTA_CRC_SIZE);
+    CHECK(records == CRC_CACHE_LOW_WATER);
+    CHECK_FALSE(cache.lookup(fake_id(0)));
+    CHECK_FALSE(cache.lookup(*file_identity(file)));
+    auto newest = cache.lookup(fake_id(CRC_CACHE_MAX_RECORDS - 1));
+    REQUIRE(newest);
+    CHECK((*newest)[0] == static_cast<uint8_t>(CRC_CACHE_MAX_RECORDS - 1));
+    CHECK(cache.lookup(fake_id(CRC_CACHE_MAX_RECORDS - CRC_CACHE_LOW_WATER)));
+    CHECK_FALSE(cache.lookup(fake_id(CRC_CACHE_MAX_RECORDS - CRC_CACHE_LOW_WATER - 1)));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("merged shards reconstruct the whole version", "[shard]") {
+    std::mt19937 rng(89);
+    std::vector<uint8_t> r(120000);
+    for (auto& x : r) x = rng() & 0xFF;
+    auto v = r;
+    std::rotate(v.begin() + 2000, v.begin() + 50000, v.begin() + 90000);
+    for (size_t i = 0; i < v.size(); i += 5003) { v[i] ^= 0x77; }
+    auto r_crc = crc64_xz(r.data(), r.size());
+
+    const uint32_t n = 3;
+    std::vector<DeltaShard> shards;
+    for (uint32_t i = n; i-- > 0;) {
+        auto [b, e] = shard_range(v.size(), i, n);
+        auto slice = std::span<const uint8_t>(v).subspan(b, e - b);
+        auto placed = place_commands(diff_correcting(r, slice));
+        auto d = encode_delta(placed, false, slice.size(), r_crc,
+                              crc64_xz(slice.data(), slice.size()));
+        shards.push_back(decode_shard(encode_shard({i, n, b, v.size(), d})));
+    }
+
+    auto whole = diff_correcting(r, v);
+    for (bool seam : {false, true}) {
+        auto merged = merge_shards(shards, seam ? std::span<const uint8_t>(r)
+                                                : std::span<const uint8_t>());
+        auto [placed, ip, size, src, dst] = decode_delta(merged);
+        CHECK(size == v.size());
+        CHECK(src == r_crc);
+        CHECK(dst == crc64_xz(v.data(), v.size()));
+        std::vector<uint8_t> out(size);
+        apply_placed_to(r, placed, out);
+        CHECK(out == v);
+        if (seam) { CHECK(encoded_cost(unplace_commands(placed)) <= encoded_cost(whole) + 64); }
+    }
+
+    shards.pop_back();
+    CHECK_THROWS_AS(merge_shards(shards), DeltaError);
+}
+
+TEST_CASE("verify_delta checks deltas without reconstructing them", "[verify]") {
+    std::mt19937 rng(90);
+    std::vector<uint8_t> r(60000);
+    for (auto& x : r) x = rng() & 0xFF;
+    auto v = r;
+    std::rotate(v.begin() + 1000, v.begin() + 20000, v.begin() + 45000);
+    for (size_t i = 0; i < v.size(); i += 3001) { v[i] ^= 0x5A; }
+    v.resize(70000, 0x11);
+    auto r_crc = crc64_xz(r.data(), r.size());
+    auto v_crc = crc64_xz(v.data(), v.size());
+    auto cmds = diff_correcting(r, v);
+
+    auto standard = encode_delta(place_commands(cmds), false, v.size(), r_crc, v_crc);
+    auto res = verify_delta(r, standard);
+    CHECK(res.ok);
+    CHECK(res.streamed);
+    CHECK(res.version_size == v.size());
+    CHECK(verify_delta(r, standard, &r_crc).ok);
+
+    auto inplace = encode_delta(make_inplace(r, cmds, CyclePolicy::Localmin), true,
+                                v.size(), r_crc, v_crc);
+    res = verify_delta(r, inplace);
+    CHECK(res.ok);
+    CHECK(res.inplace);
+    CHECK(res.streamed);
+
+    // A copy reading bytes an earlier copy overwrote needs the full apply.
+    std::vector<PlacedCommand> chained = {PlacedCopy{0, 100, 100}, PlacedCopy{100, 0, 100}};
+    auto out = apply_delta_inplace(r, chained, 200);
+    auto overlap = encode_delta(chained, true, 200, r_crc, crc64_xz(out.data(), out.size()));
+    res = verify_delta(r, overlap);
+    CHECK(res.ok);
+    CHECK_FALSE(res.streamed);
+
+    // Overlapping output ranges resolve as in decode: the later command
+    // wins, and bytes no command writes stay zero.
+    std::vector<PlacedCommand> clash = {
+        PlacedCopy{0, 0, 100}, PlacedAdd{30, std::vector<uint8_t>(10, 0x7e)},
+        PlacedCopy{200, 50, 100}, PlacedCopy{400, 20, 20}, PlacedCopy{600, 180, 40}};
+    std::vector<uint8_t> clash_out(240);
+    apply_placed_to(r, clash, clash_out);
+    auto clash_crc = crc64_xz(clash_out.data(), clash_out.size());
+    res = verify_delta(r, encode_delta(clash, false, 240, r_crc, clash_crc));
+    CHECK(res.ok);
+    CHECK(res.streamed);
+    auto clash_ip = apply_delta_inplace(r, clash, 240); // the gap keeps R's bytes
+    res = verify_delta(r, encode_delta(clash, true, 240, r_crc,
+                                       crc64_xz(clash_ip.data(), clash_ip.size())));
+    CHECK(res.ok);
+    CHECK(res.streamed);
+    auto wrong = clash_out;
+    std::memcpy(&wrong[20], &r[20], 20); // as if the earlier copy won
+    res = verify_delta(r, encode_delta(clash, false, 240, r_crc,
+                                       crc64_xz(wrong.data(), wrong.size())));
+    CHECK_FALSE(res.ok);
+
+    auto corrupt = standard;
+    corrupt[corrupt.size() - 1] ^= 1;
+    CHECK_FALSE(verify_delta(r, corrupt).ok);
+    auto other = r;
+    other[0] ^= 1;
+    res = verify_delta(other, standard);
+    CHECK_FALSE(res.ok);
+    CHECK(res.error == "reference does not match delta");
+    res = verify_delta(r, std::span<const uint8_t>(standard).first(20));
+    CHECK_FALSE(res.ok);
+    CHECK_FALSE(res.error.empty());
+}
+
+TEST_CASE("diff fills DiffStats for every algorithm", "[stats]") {
+    std::mt19937 rng(91);
+    std::vector<uint8_t> r(40000);
+    for (auto& x : r) x = rng() & 0xFF;
+    auto v = r;
+    std::rotate(v.begin() + 500, v.begin() + 9000, v.begin() + 30000);
+    for (size_t i = 0; i < v.size(); i += 997) { v[i] ^= 0x33; }
+
+    for (auto algo : {Algorithm::Greedy, Algorithm::Onepass, Algorithm::Correcting,
+                      Algorithm::Hierarchical, Algorithm::Best}) {
+        DiffStats st;
+        DiffOptions opts;
+        opts.coarse_p = 64;
+        opts.rematch = true;
+        opts.stats = &st;
+        auto cmds = diff(algo, r, v, opts);
+        auto summary = placed_summary(place_commands(cmds));
+        CHECK(std::string(st.algorithm) != "");
+        CHECK(st.r_size == r.size());
+        CHECK(st.num_copies == summary.num_copies);
+        CHECK(st.copy_bytes + st.add_bytes == v.size());
+        if (algo == Algorithm::Best) {
+            CHECK(st.candidates.size() == best_candidates(opts, r.size()).size());
+            CHECK(st.candidates[st.winner].cost.has_value());
+            continue;
+        }
+        if (DELTA_STATS_ENABLED) {
+            CHECK(st.scan_matches > 0);
+            CHECK(st.scan_matches <= st.scan_lookups);
+        }
+        if (DELTA_STATS_ENABLED && algo == Algorithm::Hierarchical) {
+            // Every coarse position probes the table, hit or not.
+            CHECK(st.scan_lookups == st.scan_positions);
+            CHECK(st.scan_matches + st.scan_byte_mismatch < st.scan_lookups);
+        }
+        if (algo == Algorithm::Correcting) {
+            CHECK(st.build_seeds == r.size() - opts.p + 1);
+            CHECK(st.build_stored + st.build_collisions == st.build_passed);
+            CHECK(st.table_entries == st.build_stored);
+        }
+    }
+
+    // Direct calls with opts.verbose print their own stats, recording
+    // the result as diff() does (the text goes to stderr).
+    for (auto fn : {diff_greedy, diff_onepass, diff_correcting, diff_hierarchical}) {
+        DiffStats st;
+        DiffOptions opts;
+        opts.coarse_p = 64;
+        opts.verbose = true;
+        opts.stats = &st;
+        auto cmds = fn(r, v, opts);
+        CHECK(st.num_copies == delta_summary(cmds).num_copies);
+        CHECK(st.copy_bytes + st.add_bytes == v.size());
+    }
+}
+
+TEST_CASE("stats_json reports phases, counts and the diff", "[stats]") {
+    std::vector<uint8_t> r(20000, 7), v(20000, 7);
+    v[10000] = 9;
+    DiffStats st;
+    DiffOptions opts;
+    opts.stats = &st;
+    diff(Algorithm::Correcting, r, v, opts);
+
+    StatsReport report;
+    report.command = "encode";
+    report.labels = {{"reference", "dir/\"odd\"\tname"}};
+    PhaseTimer t;
+    report.phases.emplace_back("crc", t.elapsed());
+    report.counts = {{"copies", st.num_copies}};
+    report.diff = &st;
+    auto json = stats_json(report);
+
+    CHECK(json.find("\"command\":\"encode\"") != std::string::npos);
+    CHECK(json.find("\"reference\":\"dir/\\\"odd\\\"\\u0009name\"") != std::string::npos);
+    CHECK(json.find("\"crc\":{\"wall\":") != std::string::npos);
+    CHECK(json.find("\"algorithm\":\"correcting\"") != std::string::npos);
+    CHECK(json.find("\"peak_rss_bytes\":") != std::string::npos);
+    CHECK(std::count(json.begin(), json.end(), '{') == std::count(json.begin(), json.end(), '}'));
+    CHECK(t.elapsed().wall >= 0);
+    CHECK(peak_rss_bytes() > 0);
+}
+
+TEST_CASE("Histogram buckets within 12.5% and feeds DiffStats", "[stats]") {
+    Histogram h;
+    for (uint64_t v = 0; v < 16; ++v) { CHECK(Histogram::bucket_of(v) == v); }
+    for (uint64_t v : {16ull, 17ull, 1000ull, 123456789ull, ~0ull}) {
+        size_t b = Histogram::bucket_of(v);
+        CHECK(Histogram::bucket_low(b) <= v);
+        CHECK(Histogram::bucket_high(b) >= v);
+        CHECK(Histogram::bucket_high(b) - Histogram::bucket_low(b)
+              <= Histogram::bucket_low(b) / 8);
+    }
+    for (uint64_t v = 1; v <= 1000; ++v) { h.record(v); }
+    // Under DELTA_NO_STATS record() does nothing; only the bucket math
+    // above holds there.
+    if (DELTA_STATS_ENABLED) {
+        CHECK(h.count() == 1000);
+        CHECK(h.min() == 1);
+        CHECK(h.max() == 1000);
+        CHECK(h.sum() == 500500);
+        CHECK(h.percentile(0.5) >= 500);
+        CHECK(h.percentile(0.5) <= 500 * 9 / 8);
+        CHECK(h.percentile(1.0) == 1000);
+        Histogram twice = h;
+        twice += h;
+        CHECK(twice.count() == 2000);
+        CHECK(twice.percentile(0.5) == h.percentile(0.5));
+    } else {
+        CHECK(h.count() == 0);
+    }
+
+    std::mt19937 rng(95);
+    std::vector<uint8_t> r(30000);
+    for (auto& x : r) x = rng() & 0xFF;
+    auto v = r;
+    for (size_t i = 0; i < v.size(); i += 700) { v[i] ^= 0x11; }
+    for (auto algo : {Algorithm::Greedy, Algorithm::Correcting, Algorithm::Hierarchical}) {
+        DiffStats st;
+        DiffOptions opts;
+        opts.coarse_p = 64;
+        opts.stats = &st;
+        auto cmds = diff(algo, r, v, opts);
+        REQUIRE(apply_delta(r, cmds) == v);
+        if (!DELTA_STATS_ENABLED) { continue; }
+        CHECK(st.copy_lengths.count() == st.num_copies);
+        CHECK(st.copy_lengths.sum() == st.copy_bytes);
+        CHECK(st.add_lengths.sum() == st.add_bytes);
+        CHECK(st.match_extension.count() > 0);
+        if (algo == Algorithm::Correcting) { CHECK(st.checkpoint_gaps.count() > 0); }
+        if (algo == Algorithm::Greedy) {
+            CHECK(st.bucket_occupancy.sum() == st.build_seeds);
+        }
+        if (algo == Algorithm::Hierarchical) {
+            CHECK(st.probe_lengths.count() == st.table_entries);
+            CHECK(st.probe_lengths.min() == 1);
+        }
+    }
+}
+
+TEST_CASE("memory_limit sizes tables to a tracked byte budget", "[memory]") {
+    auto before = memory_usage();
+    {
+        MemoryWatch watch;
+        TrackedVector<uint64_t> table(1000);
+        auto during = memory_usage();
+        CHECK(during.current[MEM_TABLES] == before.current[MEM_TABLES] + 8000);
+        CHECK(watch.peak() >= during.total_current);
+    }
+    CHECK(memory_usage().current[MEM_TABLES] == before.current[MEM_TABLES]);
+
+    DiffOptions small;
+    small.memory_limit = 24000;
+    CHECK(table_slots(small, 24) == 1000);
+    small.max_table = 500;
+    CHECK(table_slots(small, 24) == 500);
+
+    std::mt19937 rng(96);
+    std::vector<uint8_t> r(200000);
+    for (auto& x : r) x = rng() & 0xFF;
+    auto v = r;
+    for (size_t i = 0; i < v.size(); i += 1500) { v[i] ^= 0x77; }
+    for (auto algo : {Algorithm::Greedy, Algorithm::Onepass, Algorithm::Correcting,
+                      Algorithm::Hierarchical}) {
+        DiffStats st;
+        DiffOptions opts;
+        opts.q = 1009;
+        opts.memory_limit = 100000;
+        opts.stats = &st;
+        auto cmds = diff(algo, r, v, opts);
+        CHECK(apply_delta(r, cmds) == v);
+        CHECK(st.memory_limit == opts.memory_limit);
+        CHECK(std::max(st.build.mem_peak, st.scan.mem_peak)
+              <= before.total_current + opts.memory_limit + 4096);
+        if (algo == Algorithm::Greedy) {
+            // Thinned over all of R, not cut off after its first seeds.
+            CHECK(st.build_thin > 1);
+            CHECK(st.build_indexed == r.size() - opts.p + 1);
+            size_t furthest = 0;
+            for (const auto& c : cmds) {
+                if (auto* cp = std::get_if<CopyCmd>(&c)) {
+                    furthest = std::max(furthest, cp->offset + cp->length);
+                }
+            }
+            CHECK(furthest > r.size() * 9 / 10);
+        }
+    }
+
+    // Splay nodes are charged in coarse steps, and released with the tree.
+    auto base = memory_usage().current[MEM_TABLES];
+    {
+        SplayTree<size_t> tree;
+        for (uint64_t k = 0; k < 5000; ++k) { tree.insert(k * 7919, k); }
+        auto charged = memory_usage().current[MEM_TABLES] - base;
+        CHECK(charged >= 5000 * 4 * sizeof(uint64_t));
+        CHECK(charged < 10000 * 4 * sizeof(uint64_t));
+    }
+    CHECK(memory_usage().current[MEM_TABLES] == base);
+}
+
+TEST_CASE("synth pairs are deterministic and addressable by offset", "[synth]") {
+    for (const char* name : SYNTH_SCENARIO_NAMES) {
+        SynthOptions o;
+        o.scenario = synth_scenario(name);
+        o.size = 300000;
+        o.seed = 42;
+        o.block_min = 512;
+        o.block_max = 4096;
+        o.rate = 0.2;
+        o.threads = 1;
+        auto a = synth_pair(o);
+        o.threads = 3;
+        auto b = synth_pair(o);
+        CHECK(a.reference == b.reference);
+        CHECK(a.version == b.version);
+        CHECK(a.reference.size() == o.size);
+
+        // Any slice can be generated on its own.
+        auto plan = synth_plan(o);
+        std::vector<uint8_t> slice(7777);
+        synth_fill_version(plan, 123457, slice);
+        CHECK(std::equal(slice.begin(), slice.end(), a.version.begin() + 123457));
+        synth_fill_reference(plan, 99999, slice);
+        CHECK(std::equal(slice.begin(), slice.end(), a.reference.begin() + 99999));
+
+        auto cmds = diff(Algorithm::Correcting, a.reference, a.version);
+        CHECK(apply_delta(a.reference, cmds) == a.version);
+    }
+
+    SynthOptions o;
+    o.size = 100000;
+    o.scenario = SynthScenario::Mutate;
+    auto m = synth_pair(o);
+    auto plan = synth_plan(o);
+    size_t differ = 0;
+    for (size_t i = 0; i < m.version.size(); ++i) { differ += m.reference[i] != m.version[i]; }
+    CHECK(differ == plan.mutations.size());
+    CHECK(differ == plan.blocks_changed);
+
+    o.scenario = SynthScenario::Append;
+    o.rate = 0.5;
+    CHECK(synth_plan(o).version_size == 150000);
+
+    o.seed = 2;
+    o.scenario = SynthScenario::Transpose;
+    CHECK(synth_pair(o).reference != m.reference);
+    CHECK_THROWS_AS(synth_scenario("nope"), DeltaError);
+    o.block_min = 0;
+    CHECK_THROWS_AS(synth_plan(o), DeltaError);
+}
+
+TEST_CASE("bench matrix runs, round-trips CSV and flags regressions", "[bench]") {
+    BenchAxes axes;
+    axes.algorithms = {Algorithm::Onepass, Algorithm::Hierarchical};
+    axes.splay = {false, true};
+    axes.inplace = {false, true};
+    axes.policies = {CyclePolicy::Localmin, CyclePolicy::Constant};
+    // onepass: 2 splay x (1 + 2 policies); hierarchical has no splay: 3.
+    auto configs = bench_matrix(axes);
+    CHECK(configs.size() == 9);
+    CHECK(configs[0].name() == "onepass p16 t1073741827");
+    CHECK(configs.back().name() == "hierarchical+inplace/constant p16 t1073741827");
+
+    TempDir dir("bench");
+    SynthOptions so;
+    so.size = 200000;
+    auto pair = synth_pair(so);
+    write_bytes(dir.file("t.ref"), pair.reference);
+    write_bytes(dir.file("t.ver"), pair.version);
+    auto corpus = bench_corpus(dir.path.string());
+    REQUIRE(corpus.size() == 1);
+    CHECK(corpus[0].name == "t");
+
+    std::vector<BenchResult> results;
+    for (const auto& c : {configs[0], configs[2]}) {
+        auto res = bench_run_isolated(corpus[0], c, 2);
+        CHECK(res.ok);
+        CHECK(res.runs == 2);
+        CHECK(res.v_size == pair.version.size());
+        CHECK(res.peak_rss > 0);
+        CHECK(res.encode_p95 >= res.encode_median);
+        results.push_back(res);
+    }
+    auto parsed = parse_bench_csv(bench_csv(results));
+    REQUIRE(parsed.size() == 2);
+    CHECK(parsed[1].config == results[1].config);
+    CHECK(parsed[1].delta_bytes == results[1].delta_bytes);
+    CHECK(bench_compare(results, parsed, 0.10).empty());
+
+    auto slower = parsed;
+    slower[0].encode_median = results[0].encode_median * 2 + 1;
+    slower[1].delta_bytes += 1;
+    auto changes = bench_compare(results, slower, 0.10);
+    REQUIRE(changes.size() == 2);
+    CHECK(changes[0].metric == "encode_median");
+    CHECK(changes[0].regression);
+    CHECK(changes[1].metric == "delta_bytes");
+    slower.pop_back();
+    CHECK(bench_compare(results, slower, 0.10).back().metric == "missing");
+    CHECK_THROWS_AS(parse_bench_csv("pair,config\nx,y\n"), DeltaError);
+}
+
+TEST_CASE("loadtest replays deltas and reports latency percentiles", "[loadtest]") {
+    TempDir dir("loadtest");
+    SynthOptions so;
+    so.size = 100000;
+    auto pair = synth_pair(so);
+    auto crc_r = crc64_xz(pair.reference.data(), pair.reference.size());
+    auto crc_v = crc64_xz(pair.version.data(), pair.version.size());
+    auto cmds = diff(Algorithm::Onepass, pair.reference, pair.version);
+    write_bytes(dir.file("a.ref"), pair.reference);
+    write_bytes(dir.file("a.delta"), encode_delta(place_commands(cmds), false,
+                                                  pair.version.size(), crc_r, crc_v));
+    write_bytes(dir.file("b.ref"), pair.reference);
+    write_bytes(dir.file("b.delta"),
+                encode_delta(make_inplace(pair.reference, cmds, CyclePolicy::Localmin), true,
+                             pair.version.size(), crc_r, crc_v));
+    auto corpus = load_corpus(dir.path.string());
+    REQUIRE(corpus.size() == 2);
+    CHECK(corpus[1].name == "b");
+
+    LoadOptions opts;
+    opts.concurrency = 3;
+    opts.requests = 40;
+    for (auto cache : {LoadCache::Memory, LoadCache::Hot, LoadCache::Cold}) {
+        opts.cache = cache;
+        opts.reuse_buffers = cache == LoadCache::Hot;
+        auto res = load_run(corpus, opts);
+        CHECK(res.requests == 40);
+        CHECK(res.errors == 0);
+        CHECK(res.output_bytes == 40 * pair.version.size());
+        CHECK(res.p50 <= res.p99);
+        CHECK(res.p99 <= res.p999);
+        CHECK(res.p999 <= res.max);
+        CHECK(res.throughput() > 0);
+    }
+
+    // Open loop at 2000/s: 20 requests cannot finish before the last is due.
+    opts.rate = 2000;
+    opts.requests = 20;
+    CHECK(load_run(corpus, opts).wall >= 19 / 2000.0);
+
+    // A reference that no longer matches fails every request against it.
+    auto other = pair.reference;
+    other[0] ^= 1;
+    write_bytes(dir.file("a.ref"), other);
+    opts.rate = 0;
+    auto res = load_run(corpus, opts);
+    CHECK(res.errors == 10);
+    CHECK(res.first_error.find("does not match") != std::string::npos);
+    CHECK(load_csv({res}).find("\n3,0.000,cold,0,20,10,") != std::string::npos);
+    CHECK_THROWS_AS(load_cache_from_name("warm"), DeltaError);
+}
+
+TEST_CASE("PhaseTimer carries perf counts when counters open", "[perf]") {
+    PerfCounts a, b;
+    a.value[PERF_CYCLES] = 100;
+    a.value[PERF_PAGE_FAULTS] = 7;
+    a.mask = (1u << PERF_CYCLES) | (1u << PERF_PAGE_FAULTS);
+    b.value[PERF_CYCLES] = 40;
+    b.mask = 1u << PERF_CYCLES;
+    auto d = a - b;
+    CHECK(d.mask == (1u << PERF_CYCLES));
+    CHECK(d.value[PERF_CYCLES] == 60);
+    CHECK(format_perf_counts(d) == "cycles=60");
+
+    // Multiplexed: the interval's raw count is scaled by its own times,
+    // not the difference of two separately scaled totals.
+    a.value[PERF_CYCLES] = 1000;
+    a.enabled[PERF_CYCLES] = 300;
+    a.running[PERF_CYCLES] = 200;
+    b.value[PERF_CYCLES] = 400;
+    b.enabled[PERF_CYCLES] = 100;
+    b.running[PERF_CYCLES] = 100;
+    CHECK((a - b).value[PERF_CYCLES] == 1200);
+    CHECK((b - a).value[PERF_CYCLES] == 0);
+
+    // Where perf_event_open is refused the run continues without counts.
+    std::string error;
+    size_t opened = enable_perf_counters(&error);
+    CHECK(perf_counters_enabled() == (opened > 0));
+    PhaseTimer t;
+    auto elapsed = t.elapsed();
+    if (opened == 0) {
+        CHECK_FALSE(error.empty());
+        CHECK(elapsed.perf.mask == 0);
+    } else {
+        CHECK(elapsed.perf.mask != 0);
+    }
+}
+
+TEST_CASE("trace_json records phases and worker tasks", "[trace]") {
+    std::mt19937 rng(94);
+    std::vector<uint8_t> r(40000);
+    for (auto& x : r) x = rng() & 0xFF;
+    auto v = r;
+    for (size_t i = 0; i < v.size(); i += 501) { v[i] ^= 0x5A; }
+
+    DiffOptions opts;
+    opts.rematch = true;
+    opts.rematch_min = 32;
+    opts.threads = 2;
+    start_tracing();
+    trace_thread_name("test \"main\"");
+    diff(Algorithm::Best, r, v, opts);
+    stop_tracing();
+    auto json = trace_json();
+    CHECK(json.rfind("{\"traceEvents\":[", 0) == 0);
+    CHECK(json.find("\"name\":\"test \\\"main\\\"\"") != std::string::npos);
+    for (const char* name : {"\"diff\"", "\"build\"", "\"scan\"", "\"rematch\"",
+                             "\"best worker\"", "\"correcting p=16\""}) {
+        CHECK(json.find(name) != std::string::npos);
+    }
+    CHECK(trace_dropped_events() == 0);
+
+    // Nothing is recorded while tracing is off; a full ring keeps the
+    // newest events.
+    start_tracing(2);
+    stop_tracing();
+    { TraceSpan off("off"); }
+    CHECK(trace_json().find("\"off\"") == std::string::npos);
+    start_tracing(2);
+    for (const char* name : {"first", "second", "third"}) { TraceSpan s(name); }
+    stop_tracing();
+    json = trace_json();
+    CHECK(json.find("\"first\"") == std::string::npos);
+    CHECK(json.find("\"third\"") != std::string::npos);
+    CHECK(trace_dropped_events() == 1);
+
+    // A ring that grew from TRACE_INITIAL_EVENTS keeps its events in order.
+    size_t cap = TRACE_INITIAL_EVENTS * 3;
+    start_tracing(cap);
+    for (size_t i = 0; i < cap + 10; ++i) {
+        TraceSpan s(trace_intern("span " + std::to_string(i)));
+    }
+    stop_tracing();
+    json = trace_json();
+    CHECK(trace_dropped_events() == 10);
+    CHECK(json.find("\"span 9\"") == std::string::npos);
+    auto pos = json.find("\"span 10\"");
+    for (size_t i = 11; i < cap + 10; ++i) {
+        auto next = json.find("\"span " + std::to_string(i) + "\"");
+        REQUIRE(next != std::string::npos);
+        CHECK(next > pos);
+        pos = next;
+    }
+}
+
 TEST_CASE("next_prime is prime", "[hash]") {
     CHECK(is_prime(TABLE_SIZE));
     CHECK(is_prime(next_prime(1048574)));